@@ -75,6 +75,26 @@ typedef struct cups_dither_s		/**** Dithering State ****/
   int		errors[96];		/* Error values */
 } cups_dither_t;
 
+typedef enum cups_screen_type_e	/**** Screen Types ****/
+{
+  CUPS_SCREEN_CLUSTERED,		/* Clustered-dot ordered dither */
+  CUPS_SCREEN_BLUENOISE			/* Blue-noise threshold matrix */
+} cups_screen_type_t;
+
+typedef struct cups_screen_s		/**** Threshold Matrix Screen ****/
+{
+  int		width;			/* Width of output in pixels */
+  int		row;			/* Current row */
+  int		size;			/* Width and height of matrix */
+  int		xoffset,		/* Horizontal phase of matrix */
+		yoffset;		/* Vertical phase of matrix */
+  const unsigned short *matrix;		/* Thresholds, shared */
+  unsigned char	lower[CUPS_MAX_LUT + 1],/* Pixel value below each input */
+		upper[CUPS_MAX_LUT + 1];/* Pixel value above each input */
+  short		fraction[CUPS_MAX_LUT + 1];
+					/* Position between the two */
+} cups_screen_t;
+
 typedef struct cups_sample_s		/**** Color sample point ****/
 {
   unsigned char	rgb[3];			/* sRGB values */
@@ -148,6 +168,26 @@ extern void		cupsDitherLine(cups_dither_t *d, const cups_lut_t *lut,
 extern cups_dither_t	*cupsDitherNew(int width);
 extern void		cupsDitherDelete(cups_dither_t *);
 
+/*
+ * Screening functions...
+ */
+
+extern void		cupsScreenDelete(cups_screen_t *s);
+extern void		cupsScreenLine(cups_screen_t *s, const short *data,
+			               int num_channels, unsigned char *p);
+extern cups_screen_t	*cupsScreenLoad(ppd_file_t *ppd,
+			                const char *colormodel,
+					const char *media,
+					const char *resolution,
+					const cups_lut_t *lut, int width,
+					int channel);
+extern cups_screen_t	*cupsScreenNew(cups_screen_type_t type,
+			               const cups_lut_t *lut, int width,
+				       int channel);
+extern void		cupsScreenRow(const cups_screen_t *s, int y,
+			              const short *data, int num_channels,
+				      unsigned char *p);
+
 /*
  * Lookup table functions for dithering...
  */
@@ -0,0 +1,1006 @@
+/*
+ *   Vectorized colorspace conversions for CUPS.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2006 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ *   Each kernel converts as many whole blocks of pixels as it can and
+ *   returns the number of pixels it converted; the scalar code in
+ *   image-colorspace.c does the rest.  The results must be identical to
+ *   the scalar code for every input, including out-of-range profile and
+ *   density values, so all arithmetic is done in integers (or in floats
+ *   where that has been checked to be exact for all 8-bit inputs).
+ *
+ * Contents:
+ *
+ *   _cupsImageGetSIMD()             - Get the SIMD level in use.
+ *   _cupsImageSetSIMD()             - Enable or disable the SIMD kernels.
+ *   _cupsImageSIMDCMYKToRGB()       - Convert CMYK colors to RGB.
+ *   _cupsImageSIMDLut()             - Adjust pixel values with a LUT.
+ *   _cupsImageSIMDRGBAdjust()       - Adjust the hue and saturation of RGB
+ *                                     colors.
+ *   _cupsImageSIMDRGBToCMYK()       - Convert RGB colors to CMYK.
+ *   _cupsImageSIMDRGBToRGB()        - Convert RGB colors to calibrated RGB.
+ *   _cupsImageSIMDRGBToWhite()      - Convert RGB colors to luminance.
+ *   avx2_clut()                     - Look up one row of the profile
+ *                                     matrix.
+ *   avx2_cmyk_to_rgb()              - Convert CMYK colors to RGB.
+ *   avx2_density()                  - Look up clamped density values.
+ *   avx2_k()                        - Compute the black generation value.
+ *   avx2_load_rgb()                 - Load 8 RGB pixels.
+ *   avx2_lut()                      - Adjust pixel values with a LUT.
+ *   avx2_rgb_adjust()               - Adjust the hue and saturation of RGB
+ *                                     colors.
+ *   avx2_rgb_to_cmyk()              - Convert RGB colors to CMYK.
+ *   avx2_rgb_to_rgb()               - Convert RGB colors to calibrated RGB.
+ *   avx2_rgb_to_white()             - Convert RGB colors to luminance.
+ *   avx2_store_rgb()                - Store 8 RGB pixels.
+ *   avx2_store_white()              - Store 8 luminance pixels.
+ *   get_level()                     - Get the SIMD level for this CPU.
+ *   neon_cmyk_to_rgb()              - Convert CMYK colors to RGB.
+ *   neon_lut()                      - Adjust pixel values with a LUT.
+ *   neon_rgb_to_cmyk()              - Convert RGB colors to CMYK.
+ *   neon_rgb_to_white()             - Convert RGB colors to luminance.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+
+#if defined(HAVE_IMMINTRIN_H) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_AVX2_KERNELS 1
+#  include <immintrin.h>
+#  define AVX2_FUNC	__attribute__((target("avx2")))
+#endif /* HAVE_IMMINTRIN_H && __GNUC__ && (__x86_64__ || __i386__) */
+
+#if defined(HAVE_ARM_NEON_H) && defined(__aarch64__)
+#  define HAVE_NEON_KERNELS 1
+#  include <arm_neon.h>
+#endif /* HAVE_ARM_NEON_H && __aarch64__ */
+
+
+/*
+ * Local globals...
+ */
+
+static int	simd_level = -1;	/* SIMD level, -1 = not detected */
+
+
+/*
+ * Local functions...
+ */
+
+static int	get_level(void);
+
+#ifdef HAVE_AVX2_KERNELS
+static inline __m256i avx2_clut(const int *matrix, int row, __m256i c,
+		                __m256i m, __m256i y) AVX2_FUNC;
+static int	avx2_cmyk_to_rgb(const cups_ib_t *in, cups_ib_t *out, int count,
+		                 const int *matrix, const int *density);
+static inline __m256i avx2_density(const int *density, __m256i v) AVX2_FUNC;
+static inline __m256i avx2_k(__m256i k, __m256i km) AVX2_FUNC;
+static inline __m256i avx2_load_rgb(const cups_ib_t *in) AVX2_FUNC;
+static int	avx2_lut(cups_ib_t *pixels, int count, const cups_ib_t *lut);
+static int	avx2_rgb_adjust(cups_ib_t *pixels, int count, const int *lut);
+static int	avx2_rgb_to_cmyk(const cups_ib_t *in, cups_ib_t *out, int count,
+		                 const int *matrix, const int *density);
+static int	avx2_rgb_to_rgb(const cups_ib_t *in, cups_ib_t *out, int count,
+		                const int *matrix, const int *density);
+static int	avx2_rgb_to_white(const cups_ib_t *in, cups_ib_t *out,
+		                  int count, const int *density);
+static inline void avx2_store_rgb(cups_ib_t *out, __m256i px) AVX2_FUNC;
+static inline void avx2_store_white(cups_ib_t *out, __m256i w) AVX2_FUNC;
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+static int	neon_cmyk_to_rgb(const cups_ib_t *in, cups_ib_t *out,
+		                 int count);
+static int	neon_lut(cups_ib_t *pixels, int count, const cups_ib_t *lut);
+static int	neon_rgb_to_cmyk(const cups_ib_t *in, cups_ib_t *out,
+		                 int count);
+static int	neon_rgb_to_white(const cups_ib_t *in, cups_ib_t *out,
+		                  int count);
+#endif /* HAVE_NEON_KERNELS */
+
+
+/*
+ * '_cupsImageGetSIMD()' - Get the SIMD level in use.
+ */
+
+int					/* O - CUPS_ISIMD_xxx constant */
+_cupsImageGetSIMD(void)
+{
+  if (simd_level < 0)
+    simd_level = get_level();
+
+  return (simd_level);
+}
+
+
+/*
+ * '_cupsImageSetSIMD()' - Enable or disable the SIMD kernels.
+ *
+ * This is used by the test program to compare the kernels against the
+ * scalar code.
+ */
+
+void
+_cupsImageSetSIMD(int enable)		/* I - 1 to use SIMD kernels, 0 not */
+{
+  simd_level = enable ? get_level() : CUPS_ISIMD_NONE;
+}
+
+
+/*
+ * '_cupsImageSIMDCMYKToRGB()' - Convert CMYK colors to RGB.
+ *
+ * "matrix" is NULL when there is no color profile.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDCMYKToRGB(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count,		/* I - Number of pixels */
+    const int       *matrix,		/* I - Profile matrix LUT or NULL */
+    const int       *density)		/* I - Density LUT */
+{
+  switch (_cupsImageGetSIMD())
+  {
+#ifdef HAVE_AVX2_KERNELS
+    case CUPS_ISIMD_AVX2 :
+        return (avx2_cmyk_to_rgb(in, out, count, matrix, density));
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+    case CUPS_ISIMD_NEON :
+        if (!matrix)
+          return (neon_cmyk_to_rgb(in, out, count));
+        break;
+#endif /* HAVE_NEON_KERNELS */
+
+    default :
+        break;
+  }
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageSIMDLut()' - Adjust pixel values with a LUT.
+ */
+
+int					/* O - Number of bytes adjusted */
+_cupsImageSIMDLut(cups_ib_t       *pixels,/* IO - Input/output pixels */
+                  int             count,/* I  - Number of bytes */
+                  const cups_ib_t *lut)	/* I  - Lookup table */
+{
+  switch (_cupsImageGetSIMD())
+  {
+#ifdef HAVE_AVX2_KERNELS
+    case CUPS_ISIMD_AVX2 :
+        return (avx2_lut(pixels, count, lut));
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+    case CUPS_ISIMD_NEON :
+        return (neon_lut(pixels, count, lut));
+#endif /* HAVE_NEON_KERNELS */
+
+    default :
+        break;
+  }
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBAdjust()' - Adjust the hue and saturation of RGB colors.
+ */
+
+int					/* O - Number of pixels adjusted */
+_cupsImageSIMDRGBAdjust(
+    cups_ib_t *pixels,			/* IO - Input/output pixels */
+    int       count,			/* I  - Number of pixels */
+    const int *lut)			/* I  - Adjustment matrix LUT */
+{
+  switch (_cupsImageGetSIMD())
+  {
+#ifdef HAVE_AVX2_KERNELS
+    case CUPS_ISIMD_AVX2 :
+        return (avx2_rgb_adjust(pixels, count, lut));
+#endif /* HAVE_AVX2_KERNELS */
+
+    default :
+        break;
+  }
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBToCMYK()' - Convert RGB colors to CMYK.
+ *
+ * "matrix" is NULL when there is no color profile.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDRGBToCMYK(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count,		/* I - Number of pixels */
+    const int       *matrix,		/* I - Profile matrix LUT or NULL */
+    const int       *density)		/* I - Density LUT */
+{
+  switch (_cupsImageGetSIMD())
+  {
+#ifdef HAVE_AVX2_KERNELS
+    case CUPS_ISIMD_AVX2 :
+        return (avx2_rgb_to_cmyk(in, out, count, matrix, density));
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+    case CUPS_ISIMD_NEON :
+        if (!matrix)
+          return (neon_rgb_to_cmyk(in, out, count));
+        break;
+#endif /* HAVE_NEON_KERNELS */
+
+    default :
+        break;
+  }
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBToRGB()' - Convert RGB colors to calibrated RGB.
+ *
+ * Only the profile case is handled here; without a profile the conversion
+ * is a copy.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDRGBToRGB(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count,		/* I - Number of pixels */
+    const int       *matrix,		/* I - Profile matrix LUT */
+    const int       *density)		/* I - Density LUT */
+{
+  switch (_cupsImageGetSIMD())
+  {
+#ifdef HAVE_AVX2_KERNELS
+    case CUPS_ISIMD_AVX2 :
+        return (avx2_rgb_to_rgb(in, out, count, matrix, density));
+#endif /* HAVE_AVX2_KERNELS */
+
+    default :
+        break;
+  }
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBToWhite()' - Convert RGB colors to luminance.
+ *
+ * "density" is NULL when there is no color profile.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDRGBToWhite(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count,		/* I - Number of pixels */
+    const int       *density)		/* I - Density LUT or NULL */
+{
+  switch (_cupsImageGetSIMD())
+  {
+#ifdef HAVE_AVX2_KERNELS
+    case CUPS_ISIMD_AVX2 :
+        return (avx2_rgb_to_white(in, out, count, density));
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+    case CUPS_ISIMD_NEON :
+        if (!density)
+          return (neon_rgb_to_white(in, out, count));
+        break;
+#endif /* HAVE_NEON_KERNELS */
+
+    default :
+        break;
+  }
+
+  return (0);
+}
+
+
+#ifdef HAVE_AVX2_KERNELS
+/*
+ * 'avx2_clut()' - Look up one row of the profile matrix.
+ *
+ * Returns matrix[row][0][c] + matrix[row][1][m] + matrix[row][2][y].
+ */
+
+static inline AVX2_FUNC __m256i		/* O - Sum of matrix values */
+avx2_clut(const int *matrix,		/* I - Profile matrix LUT */
+          int       row,		/* I - Output channel */
+          __m256i   c,			/* I - First input channel */
+          __m256i   m,			/* I - Second input channel */
+          __m256i   y)			/* I - Third input channel */
+{
+  const int	*t = matrix + row * 768;/* Tables for this row */
+
+
+  return (_mm256_add_epi32(_mm256_add_epi32(_mm256_i32gather_epi32(t, c, 4),
+                                            _mm256_i32gather_epi32(t + 256,
+					                           m, 4)),
+                           _mm256_i32gather_epi32(t + 512, y, 4)));
+}
+
+
+/*
+ * 'avx2_cmyk_to_rgb()' - Convert CMYK colors to RGB.
+ */
+
+static AVX2_FUNC int			/* O - Number of pixels converted */
+avx2_cmyk_to_rgb(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out,	/* I - Output pixels */
+                 int             count,	/* I - Number of pixels */
+                 const int       *matrix,/* I - Profile matrix LUT or NULL */
+                 const int       *density)/* I - Density LUT */
+{
+  int		done;			/* Pixels converted */
+  __m256i	px,			/* CMYK pixels */
+		c, m, y, k,		/* CMYK values */
+		r, g, b;		/* RGB values */
+  const __m256i	mask = _mm256_set1_epi32(255),
+		ones = _mm256_set1_epi32(-1),
+		kdup = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7,
+		                        11, 11, 11, 11, 15, 15, 15, 15,
+		                        3, 3, 3, 3, 7, 7, 7, 7,
+		                        11, 11, 11, 11, 15, 15, 15, 15);
+
+
+  for (done = 0; count - done >= 8; done += 8, in += 32, out += 24)
+  {
+    px = _mm256_loadu_si256((const __m256i *)in);
+
+    if (matrix)
+    {
+      c = _mm256_and_si256(px, mask);
+      m = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+      y = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+      k = _mm256_srli_epi32(px, 24);
+
+      r = avx2_density(density,
+                       _mm256_add_epi32(avx2_clut(matrix, 0, c, m, y), k));
+      g = avx2_density(density,
+                       _mm256_add_epi32(avx2_clut(matrix, 1, c, m, y), k));
+      b = avx2_density(density,
+                       _mm256_add_epi32(avx2_clut(matrix, 2, c, m, y), k));
+
+      r = _mm256_and_si256(_mm256_sub_epi32(mask, r), mask);
+      g = _mm256_and_si256(_mm256_sub_epi32(mask, g), mask);
+      b = _mm256_and_si256(_mm256_sub_epi32(mask, b), mask);
+
+      px = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8),
+                                              _mm256_slli_epi32(b, 16)));
+    }
+    else
+    {
+     /*
+      * 255 - c - k clamped at 0 is a saturating subtract of k from the
+      * complemented bytes...
+      */
+
+      px = _mm256_subs_epu8(_mm256_xor_si256(px, ones),
+                            _mm256_shuffle_epi8(px, kdup));
+    }
+
+    avx2_store_rgb(out, px);
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'avx2_density()' - Look up clamped density values.
+ *
+ * Negative values map to 0 and values over 255 to density[255], just like
+ * the scalar code.
+ */
+
+static inline AVX2_FUNC __m256i		/* O - Density values */
+avx2_density(const int *density,	/* I - Density LUT */
+             __m256i   v)		/* I - Calibrated values */
+{
+  const __m256i	zero = _mm256_setzero_si256();
+  __m256i	idx;			/* Clamped index */
+
+
+  idx = _mm256_max_epi32(_mm256_min_epi32(v, _mm256_set1_epi32(255)), zero);
+
+  return (_mm256_andnot_si256(_mm256_cmpgt_epi32(zero, v),
+                              _mm256_i32gather_epi32(density, idx, 4)));
+}
+
+
+/*
+ * 'avx2_k()' - Compute the black generation value.
+ *
+ * k * k * k / (km * km) is at most 2^24 and so is exact in single
+ * precision, and the truncated quotient has been checked against the
+ * integer division for every k < km <= 255.
+ */
+
+static inline AVX2_FUNC __m256i		/* O - Black values */
+avx2_k(__m256i k,			/* I - Minimum of C, M, and Y */
+       __m256i km)			/* I - Maximum of C, M, and Y */
+{
+  __m256	kf = _mm256_cvtepi32_ps(_mm256_mullo_epi32(k,
+                                          _mm256_mullo_epi32(k, k)));
+  __m256	kmf = _mm256_cvtepi32_ps(_mm256_mullo_epi32(km, km));
+  __m256i	kk;			/* Scaled black */
+
+
+  kmf = _mm256_max_ps(kmf, _mm256_set1_ps(1.0f));
+  kk  = _mm256_cvttps_epi32(_mm256_div_ps(kf, kmf));
+
+  return (_mm256_blendv_epi8(k, kk, _mm256_cmpgt_epi32(km, k)));
+}
+
+
+/*
+ * 'avx2_load_rgb()' - Load 8 RGB pixels.
+ *
+ * Each pixel is returned as 0x00BBGGRR.  Exactly 24 bytes are read.
+ */
+
+static inline AVX2_FUNC __m256i		/* O - Pixels */
+avx2_load_rgb(const cups_ib_t *in)	/* I - Input pixels */
+{
+  const __m128i	shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                     6, 7, 8, -1, 9, 10, 11, -1);
+  __m128i	lo, hi;			/* Input bytes */
+
+
+  lo = _mm_loadu_si128((const __m128i *)in);
+  hi = _mm_loadl_epi64((const __m128i *)(in + 16));
+
+  return (_mm256_inserti128_si256(
+              _mm256_castsi128_si256(_mm_shuffle_epi8(lo, shuf)),
+	      _mm_shuffle_epi8(_mm_alignr_epi8(hi, lo, 12), shuf), 1));
+}
+
+
+/*
+ * 'avx2_lut()' - Adjust pixel values with a LUT.
+ *
+ * The table is split into 16 rows of 16 entries that are looked up with
+ * byte shuffles and selected by the high nibble of each pixel.
+ */
+
+static AVX2_FUNC int			/* O - Number of bytes adjusted */
+avx2_lut(cups_ib_t       *pixels,	/* IO - Input/output pixels */
+         int             count,		/* I  - Number of bytes */
+         const cups_ib_t *lut)		/* I  - Lookup table */
+{
+  int		i,			/* Looping var */
+		done;			/* Bytes adjusted */
+  __m256i	rows[16],		/* LUT rows */
+		px,			/* Pixels */
+		lo, hi,			/* Low and high nibbles */
+		result;			/* Adjusted pixels */
+  const __m256i	nibble = _mm256_set1_epi8(15);
+
+
+  if (count < 128)
+    return (0);
+
+  for (i = 0; i < 16; i ++)
+    rows[i] = _mm256_broadcastsi128_si256(
+                  _mm_loadu_si128((const __m128i *)(lut + 16 * i)));
+
+  for (done = 0; count - done >= 32; done += 32, pixels += 32)
+  {
+    px     = _mm256_loadu_si256((const __m256i *)pixels);
+    lo     = _mm256_and_si256(px, nibble);
+    hi     = _mm256_and_si256(_mm256_srli_epi16(px, 4), nibble);
+    result = _mm256_setzero_si256();
+
+    for (i = 0; i < 16; i ++)
+      result = _mm256_or_si256(result,
+                               _mm256_and_si256(
+			           _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(i)),
+				   _mm256_shuffle_epi8(rows[i], lo)));
+
+    _mm256_storeu_si256((__m256i *)pixels, result);
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'avx2_rgb_adjust()' - Adjust the hue and saturation of RGB colors.
+ *
+ * Like the scalar code, the adjusted red and green values are used for
+ * the green and blue channels.
+ */
+
+static AVX2_FUNC int			/* O - Number of pixels adjusted */
+avx2_rgb_adjust(cups_ib_t *pixels,	/* IO - Input/output pixels */
+                int       count,	/* I  - Number of pixels */
+                const int *lut)		/* I  - Adjustment matrix LUT */
+{
+  int		done;			/* Pixels adjusted */
+  __m256i	px,			/* Pixels */
+		r, g, b;		/* RGB values */
+  const __m256i	mask = _mm256_set1_epi32(255),
+		zero = _mm256_setzero_si256();
+
+
+  for (done = 0; count - done >= 8; done += 8, pixels += 24)
+  {
+    px = avx2_load_rgb(pixels);
+    r  = _mm256_and_si256(px, mask);
+    g  = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+    b  = _mm256_srli_epi32(px, 16);
+
+    r = _mm256_add_epi32(_mm256_add_epi32(
+                             _mm256_i32gather_epi32(lut, r, 4),
+                             _mm256_i32gather_epi32(lut + 768, g, 4)),
+                         _mm256_i32gather_epi32(lut + 1536, b, 4));
+    r = _mm256_max_epi32(_mm256_min_epi32(r, mask), zero);
+
+    g = _mm256_add_epi32(_mm256_add_epi32(
+                             _mm256_i32gather_epi32(lut + 256, r, 4),
+                             _mm256_i32gather_epi32(lut + 1024, g, 4)),
+                         _mm256_i32gather_epi32(lut + 1792, b, 4));
+    g = _mm256_max_epi32(_mm256_min_epi32(g, mask), zero);
+
+    b = _mm256_add_epi32(_mm256_add_epi32(
+                             _mm256_i32gather_epi32(lut + 512, r, 4),
+                             _mm256_i32gather_epi32(lut + 1280, g, 4)),
+                         _mm256_i32gather_epi32(lut + 2048, b, 4));
+    b = _mm256_max_epi32(_mm256_min_epi32(b, mask), zero);
+
+    avx2_store_rgb(pixels,
+                   _mm256_or_si256(r,
+                                   _mm256_or_si256(_mm256_slli_epi32(g, 8),
+                                                   _mm256_slli_epi32(b, 16))));
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'avx2_rgb_to_cmyk()' - Convert RGB colors to CMYK.
+ */
+
+static AVX2_FUNC int			/* O - Number of pixels converted */
+avx2_rgb_to_cmyk(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out,	/* I - Output pixels */
+                 int             count,	/* I - Number of pixels */
+                 const int       *matrix,/* I - Profile matrix LUT or NULL */
+                 const int       *density)/* I - Density LUT */
+{
+  int		done;			/* Pixels converted */
+  __m256i	px,			/* RGB pixels */
+		c, m, y, k,		/* CMYK values */
+		cc, cm, cy;		/* Calibrated CMY values */
+  const __m256i	mask = _mm256_set1_epi32(255);
+
+
+  for (done = 0; count - done >= 8; done += 8, in += 24, out += 32)
+  {
+    px = _mm256_xor_si256(avx2_load_rgb(in), _mm256_set1_epi32(0xffffff));
+    c  = _mm256_and_si256(px, mask);
+    m  = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+    y  = _mm256_srli_epi32(px, 16);
+    k  = avx2_k(_mm256_min_epi32(c, _mm256_min_epi32(m, y)),
+                _mm256_max_epi32(c, _mm256_max_epi32(m, y)));
+
+    c = _mm256_sub_epi32(c, k);
+    m = _mm256_sub_epi32(m, k);
+    y = _mm256_sub_epi32(y, k);
+
+    if (matrix)
+    {
+      cc = avx2_density(density, avx2_clut(matrix, 0, c, m, y));
+      cm = avx2_density(density, avx2_clut(matrix, 1, c, m, y));
+      cy = avx2_density(density, avx2_clut(matrix, 2, c, m, y));
+      k  = _mm256_i32gather_epi32(density, k, 4);
+
+      c = _mm256_and_si256(cc, mask);
+      m = _mm256_and_si256(cm, mask);
+      y = _mm256_and_si256(cy, mask);
+      k = _mm256_and_si256(k, mask);
+    }
+
+    _mm256_storeu_si256((__m256i *)out,
+                        _mm256_or_si256(
+			    _mm256_or_si256(c, _mm256_slli_epi32(m, 8)),
+			    _mm256_or_si256(_mm256_slli_epi32(y, 16),
+			                    _mm256_slli_epi32(k, 24))));
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'avx2_rgb_to_rgb()' - Convert RGB colors to calibrated RGB.
+ */
+
+static AVX2_FUNC int			/* O - Number of pixels converted */
+avx2_rgb_to_rgb(const cups_ib_t *in,	/* I - Input pixels */
+                cups_ib_t       *out,	/* I - Output pixels */
+                int             count,	/* I - Number of pixels */
+                const int       *matrix,/* I - Profile matrix LUT */
+                const int       *density)/* I - Density LUT */
+{
+  int		done;			/* Pixels converted */
+  __m256i	px,			/* RGB pixels */
+		c, m, y, k,		/* CMYK values */
+		r, g, b;		/* Calibrated RGB values */
+  const __m256i	mask = _mm256_set1_epi32(255);
+
+
+  for (done = 0; count - done >= 8; done += 8, in += 24, out += 24)
+  {
+    px = _mm256_xor_si256(avx2_load_rgb(in), _mm256_set1_epi32(0xffffff));
+    c  = _mm256_and_si256(px, mask);
+    m  = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+    y  = _mm256_srli_epi32(px, 16);
+    k  = _mm256_min_epi32(c, _mm256_min_epi32(m, y));
+    c  = _mm256_sub_epi32(c, k);
+    m  = _mm256_sub_epi32(m, k);
+    y  = _mm256_sub_epi32(y, k);
+
+    r = avx2_density(density,
+                     _mm256_add_epi32(avx2_clut(matrix, 0, c, m, y), k));
+    g = avx2_density(density,
+                     _mm256_add_epi32(avx2_clut(matrix, 1, c, m, y), k));
+    b = avx2_density(density,
+                     _mm256_add_epi32(avx2_clut(matrix, 2, c, m, y), k));
+
+    r = _mm256_and_si256(_mm256_sub_epi32(mask, r), mask);
+    g = _mm256_and_si256(_mm256_sub_epi32(mask, g), mask);
+    b = _mm256_and_si256(_mm256_sub_epi32(mask, b), mask);
+
+    avx2_store_rgb(out,
+                   _mm256_or_si256(r,
+                                   _mm256_or_si256(_mm256_slli_epi32(g, 8),
+                                                   _mm256_slli_epi32(b, 16))));
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'avx2_rgb_to_white()' - Convert RGB colors to luminance.
+ *
+ * The division by 100 is done as (x * 5243) >> 19, which is exact for the
+ * whole 0 to 25500 range of the weighted sum.
+ */
+
+static AVX2_FUNC int			/* O - Number of pixels converted */
+avx2_rgb_to_white(const cups_ib_t *in,	/* I - Input pixels */
+                  cups_ib_t       *out,	/* I - Output pixels */
+                  int             count,/* I - Number of pixels */
+                  const int       *density)/* I - Density LUT or NULL */
+{
+  int		done;			/* Pixels converted */
+  __m256i	px,			/* RGB pixels */
+		w;			/* Luminance */
+  const __m256i	mask = _mm256_set1_epi32(255);
+
+
+  for (done = 0; count - done >= 8; done += 8, in += 24, out += 8)
+  {
+    px = avx2_load_rgb(in);
+    w  = _mm256_add_epi32(
+             _mm256_add_epi32(
+	         _mm256_mullo_epi32(_mm256_and_si256(px, mask),
+	                            _mm256_set1_epi32(31)),
+	         _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(px, 8),
+		                                     mask),
+		                    _mm256_set1_epi32(61))),
+	     _mm256_slli_epi32(_mm256_srli_epi32(px, 16), 3));
+    w  = _mm256_srli_epi32(_mm256_mullo_epi32(w, _mm256_set1_epi32(5243)),
+                           19);
+
+    if (density)
+      w = _mm256_sub_epi32(mask,
+                           _mm256_i32gather_epi32(density,
+			                          _mm256_sub_epi32(mask, w),
+						  4));
+
+    avx2_store_white(out, w);
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'avx2_store_rgb()' - Store 8 RGB pixels.
+ *
+ * Each pixel is passed as 0x??BBGGRR.  Exactly 24 bytes are written so
+ * that in-place conversions do not clobber pixels that are not read yet.
+ */
+
+static inline AVX2_FUNC void
+avx2_store_rgb(cups_ib_t *out,		/* I - Output pixels */
+               __m256i   px)		/* I - Pixels */
+{
+  const __m128i	shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+                                     10, 12, 13, 14, -1, -1, -1, -1);
+  __m128i	lo, hi;			/* Packed pixels */
+
+
+  lo = _mm_shuffle_epi8(_mm256_castsi256_si128(px), shuf);
+  hi = _mm_shuffle_epi8(_mm256_extracti128_si256(px, 1), shuf);
+
+  _mm_storeu_si128((__m128i *)out, _mm_or_si128(lo, _mm_slli_si128(hi, 12)));
+  _mm_storel_epi64((__m128i *)(out + 16), _mm_srli_si128(hi, 4));
+}
+
+
+/*
+ * 'avx2_store_white()' - Store 8 luminance pixels.
+ *
+ * The low byte of each value is stored.
+ */
+
+static inline AVX2_FUNC void
+avx2_store_white(cups_ib_t *out,	/* I - Output pixels */
+                 __m256i   w)		/* I - Luminance values */
+{
+  const __m256i	shuf = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1, -1, -1,
+                                        0, 4, 8, 12, -1, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1, -1, -1);
+
+
+  w = _mm256_shuffle_epi8(w, shuf);
+
+  _mm_storel_epi64((__m128i *)out,
+                   _mm_unpacklo_epi32(_mm256_castsi256_si128(w),
+                                      _mm256_extracti128_si256(w, 1)));
+}
+#endif /* HAVE_AVX2_KERNELS */
+
+
+/*
+ * 'get_level()' - Get the SIMD level for this CPU.
+ */
+
+static int				/* O - CUPS_ISIMD_xxx constant */
+get_level(void)
+{
+#ifdef HAVE_AVX2_KERNELS
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return (CUPS_ISIMD_AVX2);
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+  return (CUPS_ISIMD_NEON);
+#else
+  return (CUPS_ISIMD_NONE);
+#endif /* HAVE_NEON_KERNELS */
+}
+
+
+#ifdef HAVE_NEON_KERNELS
+/*
+ * 'neon_cmyk_to_rgb()' - Convert CMYK colors to RGB.
+ */
+
+static int				/* O - Number of pixels converted */
+neon_cmyk_to_rgb(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out,	/* I - Output pixels */
+                 int             count)	/* I - Number of pixels */
+{
+  int		done;			/* Pixels converted */
+  uint8x16x4_t	cmyk;			/* CMYK values */
+  uint8x16x3_t	rgb;			/* RGB values */
+
+
+  for (done = 0; count - done >= 16; done += 16, in += 64, out += 48)
+  {
+    cmyk       = vld4q_u8(in);
+    rgb.val[0] = vqsubq_u8(vmvnq_u8(cmyk.val[0]), cmyk.val[3]);
+    rgb.val[1] = vqsubq_u8(vmvnq_u8(cmyk.val[1]), cmyk.val[3]);
+    rgb.val[2] = vqsubq_u8(vmvnq_u8(cmyk.val[2]), cmyk.val[3]);
+
+    vst3q_u8(out, rgb);
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'neon_lut()' - Adjust pixel values with a LUT.
+ */
+
+static int				/* O - Number of bytes adjusted */
+neon_lut(cups_ib_t       *pixels,	/* IO - Input/output pixels */
+         int             count,		/* I  - Number of bytes */
+         const cups_ib_t *lut)		/* I  - Lookup table */
+{
+  int		i,			/* Looping var */
+		done;			/* Bytes adjusted */
+  uint8x16x4_t	t0, t1, t2, t3;		/* 64-entry pieces of the LUT */
+  uint8x16_t	px,			/* Pixels */
+		result;			/* Adjusted pixels */
+  const uint8x16_t step = vdupq_n_u8(64);
+
+
+  if (count < 128)
+    return (0);
+
+  for (i = 0; i < 4; i ++)
+  {
+    t0.val[i] = vld1q_u8(lut + 16 * i);
+    t1.val[i] = vld1q_u8(lut + 16 * i + 64);
+    t2.val[i] = vld1q_u8(lut + 16 * i + 128);
+    t3.val[i] = vld1q_u8(lut + 16 * i + 192);
+  }
+
+  for (done = 0; count - done >= 16; done += 16, pixels += 16)
+  {
+    px     = vld1q_u8(pixels);
+    result = vqtbl4q_u8(t0, px);
+    px     = vsubq_u8(px, step);
+    result = vqtbx4q_u8(result, t1, px);
+    px     = vsubq_u8(px, step);
+    result = vqtbx4q_u8(result, t2, px);
+    px     = vsubq_u8(px, step);
+    result = vqtbx4q_u8(result, t3, px);
+
+    vst1q_u8(pixels, result);
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'neon_rgb_to_cmyk()' - Convert RGB colors to CMYK.
+ *
+ * See avx2_k() for why the float division is exact.
+ */
+
+static int				/* O - Number of pixels converted */
+neon_rgb_to_cmyk(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out,	/* I - Output pixels */
+                 int             count)	/* I - Number of pixels */
+{
+  int		i,			/* Looping var */
+		done;			/* Pixels converted */
+  uint8x16x3_t	rgb;			/* RGB values */
+  uint8x16x4_t	cmyk;			/* CMYK values */
+  uint8x16_t	k, km;			/* Minimum and maximum of C, M, Y */
+  uint16x8_t	k16, km16;		/* Widened values */
+  uint32x4_t	k32[4],			/* Scaled black */
+		kn, kd;			/* Numerator and denominator */
+
+
+  for (done = 0; count - done >= 16; done += 16, in += 48, out += 64)
+  {
+    rgb = vld3q_u8(in);
+    cmyk.val[0] = vmvnq_u8(rgb.val[0]);
+    cmyk.val[1] = vmvnq_u8(rgb.val[1]);
+    cmyk.val[2] = vmvnq_u8(rgb.val[2]);
+
+    k  = vminq_u8(cmyk.val[0], vminq_u8(cmyk.val[1], cmyk.val[2]));
+    km = vmaxq_u8(cmyk.val[0], vmaxq_u8(cmyk.val[1], cmyk.val[2]));
+
+    for (i = 0; i < 4; i ++)
+    {
+      k16  = (i & 2) ? vmovl_high_u8(k) : vmovl_u8(vget_low_u8(k));
+      km16 = (i & 2) ? vmovl_high_u8(km) : vmovl_u8(vget_low_u8(km));
+
+      if (i & 1)
+      {
+        kn = vmovl_high_u16(k16);
+        kd = vmovl_high_u16(km16);
+      }
+      else
+      {
+        kn = vmovl_u16(vget_low_u16(k16));
+        kd = vmovl_u16(vget_low_u16(km16));
+      }
+
+      k32[i] = vcvtq_u32_f32(vdivq_f32(vcvtq_f32_u32(vmulq_u32(kn,
+                                                        vmulq_u32(kn, kn))),
+                                       vcvtq_f32_u32(vmaxq_u32(vmulq_u32(kd,
+				                                         kd),
+							       vdupq_n_u32(1)))));
+      k32[i] = vbslq_u32(vcgtq_u32(kd, kn), k32[i], kn);
+    }
+
+    k = vcombine_u8(vmovn_u16(vcombine_u16(vmovn_u32(k32[0]),
+                                           vmovn_u32(k32[1]))),
+                    vmovn_u16(vcombine_u16(vmovn_u32(k32[2]),
+                                           vmovn_u32(k32[3]))));
+
+    cmyk.val[0] = vsubq_u8(cmyk.val[0], k);
+    cmyk.val[1] = vsubq_u8(cmyk.val[1], k);
+    cmyk.val[2] = vsubq_u8(cmyk.val[2], k);
+    cmyk.val[3] = k;
+
+    vst4q_u8(out, cmyk);
+  }
+
+  return (done);
+}
+
+
+/*
+ * 'neon_rgb_to_white()' - Convert RGB colors to luminance.
+ *
+ * See avx2_rgb_to_white() for the division by 100.
+ */
+
+static int				/* O - Number of pixels converted */
+neon_rgb_to_white(const cups_ib_t *in,	/* I - Input pixels */
+                  cups_ib_t       *out,	/* I - Output pixels */
+                  int             count)/* I - Number of pixels */
+{
+  int		done;			/* Pixels converted */
+  uint8x16x3_t	rgb;			/* RGB values */
+  uint16x8_t	lo, hi;			/* Weighted sums */
+
+
+  for (done = 0; count - done >= 16; done += 16, in += 48, out += 16)
+  {
+    rgb = vld3q_u8(in);
+
+    lo = vmull_u8(vget_low_u8(rgb.val[0]), vdup_n_u8(31));
+    lo = vmlal_u8(lo, vget_low_u8(rgb.val[1]), vdup_n_u8(61));
+    lo = vmlal_u8(lo, vget_low_u8(rgb.val[2]), vdup_n_u8(8));
+    hi = vmull_high_u8(rgb.val[0], vdupq_n_u8(31));
+    hi = vmlal_high_u8(hi, rgb.val[1], vdupq_n_u8(61));
+    hi = vmlal_high_u8(hi, rgb.val[2], vdupq_n_u8(8));
+
+    lo = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo),
+                                            vdup_n_u16(5243)), 16),
+                      vshrn_n_u32(vmull_high_u16(lo, vdupq_n_u16(5243)),
+		                  16));
+    hi = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi),
+                                            vdup_n_u16(5243)), 16),
+                      vshrn_n_u32(vmull_high_u16(hi, vdupq_n_u16(5243)),
+		                  16));
+
+    vst1q_u8(out, vcombine_u8(vmovn_u16(vshrq_n_u16(lo, 3)),
+                              vmovn_u16(vshrq_n_u16(hi, 3))));
+  }
+
+  return (done);
+}
+#endif /* HAVE_NEON_KERNELS */
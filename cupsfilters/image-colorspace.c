@@ -336,8 +336,23 @@ cupsImageCMYKToRGB(
 {
   int	c, m, y, k;			/* CMYK values */
   int	cr, cg, cb;			/* Calibrated RGB values */
+  int	done;				/* Pixels converted by SIMD code */
 
 
+  if (cupsImageHaveProfile ||
+      (cupsImageColorSpace != CUPS_CSPACE_CIELab &&
+       cupsImageColorSpace != CUPS_CSPACE_CIEXYZ &&
+       cupsImageColorSpace < CUPS_CSPACE_ICC1))
+  {
+    done  = _cupsImageSIMDCMYKToRGB(in, out, count,
+                                    cupsImageHaveProfile ?
+				        cupsImageMatrix[0][0] : NULL,
+				    cupsImageDensity);
+    in    += 4 * done;
+    out   += 3 * done;
+    count -= done;
+  }
+
   if (cupsImageHaveProfile)
   {
     while (count > 0)
@@ -476,6 +491,13 @@ cupsImageLut(cups_ib_t       *pixels,	/* IO - Input/output pixels */
              int             count,	/* I  - Number of pixels/bytes to adjust */
              const cups_ib_t *lut)	/* I  - Lookup table */
 {
+  int	done;				/* Bytes adjusted by SIMD code */
+
+
+  done   = _cupsImageSIMDLut(pixels, count, lut);
+  pixels += done;
+  count  -= done;
+
   while (count > 0)
   {
     *pixels = lut[*pixels];
@@ -496,6 +518,7 @@ cupsImageRGBAdjust(cups_ib_t *pixels,	/* IO - Input/output pixels */
         	   int       hue)	/* I - Color hue (degrees) */
 {
   int			i, j, k;	/* Looping vars */
+  int			done;		/* Pixels adjusted by SIMD code */
   float			mat[3][3];	/* Color adjustment matrix */
   static int		last_sat = 100,	/* Last saturation used */
 			last_hue = 0;	/* Last hue used */
@@ -543,6 +566,10 @@ cupsImageRGBAdjust(cups_ib_t *pixels,	/* IO - Input/output pixels */
   * Adjust each pixel in the given buffer.
   */
 
+  done   = _cupsImageSIMDRGBAdjust(pixels, count, lut[0][0]);
+  pixels += 3 * done;
+  count  -= done;
+
   while (count > 0)
   {
     i = lut[0][0][pixels[0]] +
@@ -696,7 +723,16 @@ cupsImageRGBToCMYK(
   int	c, m, y, k,			/* CMYK values */
 	km;				/* Maximum K value */
   int	cc, cm, cy;			/* Calibrated CMY values */
+  int	done;				/* Pixels converted by SIMD code */
+
 
+  done  = _cupsImageSIMDRGBToCMYK(in, out, count,
+                                  cupsImageHaveProfile ?
+				      cupsImageMatrix[0][0] : NULL,
+				  cupsImageDensity);
+  in    += 3 * done;
+  out   += 4 * done;
+  count -= done;
 
   if (cupsImageHaveProfile)
     while (count > 0)
@@ -785,10 +821,17 @@ cupsImageRGBToRGB(
 {
   int	c, m, y, k;			/* CMYK values */
   int	cr, cg, cb;			/* Calibrated RGB values */
+  int	done;				/* Pixels converted by SIMD code */
 
 
   if (cupsImageHaveProfile)
   {
+    done  = _cupsImageSIMDRGBToRGB(in, out, count, cupsImageMatrix[0][0],
+                                   cupsImageDensity);
+    in    += 3 * done;
+    out   += 3 * done;
+    count -= done;
+
     while (count > 0)
     {
       c = 255 - *in++;
@@ -873,6 +916,16 @@ cupsImageRGBToWhite(
     cups_ib_t       *out,		/* I - Output pixels */
     int             count)		/* I - Number of pixels */
 {
+  int	done;				/* Pixels converted by SIMD code */
+
+
+  done  = _cupsImageSIMDRGBToWhite(in, out, count,
+                                   cupsImageHaveProfile ? cupsImageDensity :
+				                          NULL);
+  in    += 3 * done;
+  out   += done;
+  count -= done;
+
   if (cupsImageHaveProfile)
   {
     while (count > 0)
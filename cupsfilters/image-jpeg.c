@@ -44,6 +44,7 @@ _cupsImageReadJPEG(
 			*out;		/* Output pixels */
   jpeg_saved_marker_ptr	marker;		/* Pointer to marker data */
   int			psjpeg = 0;	/* Non-zero if Photoshop CMYK JPEG */
+  unsigned		denom;		/* Scale denominator */
   static const char	*cspaces[] =
 			{		/* JPEG colorspaces... */
 			  "JCS_UNKNOWN",
@@ -155,6 +156,61 @@ _cupsImageReadJPEG(
     }
   }
 
+ /*
+  * A streaming image waits here until the caller knows which size it
+  * needs...
+  */
+
+  if (_cupsImageWaitMinSize(img))
+  {
+    jpeg_destroy_decompress(&cinfo);
+
+    fclose(fp);
+    return (0);
+  }
+
+  if (img->min_xsize > 0 && img->min_ysize > 0)
+  {
+   /*
+    * The image is only needed at a smaller size, so let the decoder scale
+    * it down in the DCT domain, which is much faster than decoding it at
+    * full size...
+    */
+
+    for (denom = 8; denom > 1; denom /= 2)
+      if ((cinfo.image_width + denom - 1) / denom >= img->min_xsize &&
+          (cinfo.image_height + denom - 1) / denom >= img->min_ysize)
+	break;
+
+    cinfo.scale_num   = 1;
+    cinfo.scale_denom = denom;
+
+    jpeg_calc_output_dimensions(&cinfo);
+
+    img->xsize = cinfo.output_width;
+    img->ysize = cinfo.output_height;
+  }
+
+  if (cinfo.output_width != cinfo.image_width)
+  {
+   /*
+    * Keep the size in inches of a reduced image...
+    */
+
+    fprintf(stderr, "DEBUG: Decoding JPEG image at 1/%d size\n",
+            cinfo.scale_denom);
+
+    img->xppi = (img->xppi * cinfo.output_width + cinfo.image_width / 2) /
+                cinfo.image_width;
+    img->yppi = (img->yppi * cinfo.output_height + cinfo.image_height / 2) /
+                cinfo.image_height;
+
+    if (img->xppi == 0)
+      img->xppi = 1;
+    if (img->yppi == 0)
+      img->yppi = 1;
+  }
+
   fprintf(stderr, "DEBUG: JPEG image %dx%dx%d, %dx%d PPI\n",
           img->xsize, img->ysize, cinfo.output_components,
 	  img->xppi, img->yppi);
@@ -212,7 +268,9 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(in, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, in);
+      if (_cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize,
+                           in))
+        break;
     }
     else if (cinfo.out_color_space == JCS_GRAYSCALE)
     {
@@ -238,7 +296,9 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      if (_cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize,
+                           out))
+        break;
     }
     else if (cinfo.out_color_space == JCS_RGB)
     {
@@ -267,7 +327,9 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      if (_cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize,
+                           out))
+        break;
     }
     else /* JCS_CMYK */
     {
@@ -295,14 +357,25 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      if (_cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize,
+                           out))
+        break;
     }
   }
 
   free(in);
   free(out);
 
-  jpeg_finish_decompress(&cinfo);
+ /*
+  * Stop early if the image could not take more rows (a streaming reader
+  * has been closed)...
+  */
+
+  if (cinfo.output_scanline < cinfo.output_height)
+    jpeg_abort_decompress(&cinfo);
+  else
+    jpeg_finish_decompress(&cinfo);
+
   jpeg_destroy_decompress(&cinfo);
 
   fclose(fp);
@@ -219,7 +219,7 @@ _cupsImageReadPNG(
   * Read the image, interlacing as needed...
   */
 
-  for (pass = 1; pass <= passes; pass ++)
+  for (pass = 1, y = 0; pass <= passes; pass ++)
     for (inptr = in, y = 0; y < img->ysize; y ++)
     {
       png_read_row(pp, (png_bytep)inptr, NULL);
@@ -281,7 +281,8 @@ _cupsImageReadPNG(
 	if (lut)
 	  cupsImageLut(out, img->xsize * bpp, lut);
 
-	_cupsImagePutRow(img, 0, y, img->xsize, out);
+	if (_cupsImagePutRow(img, 0, y, img->xsize, out))
+	  break;
       }
 
       if (passes > 1)
@@ -293,7 +294,14 @@ _cupsImageReadPNG(
       }
     }
 
-  png_read_end(pp, info);
+ /*
+  * Stop early if the image could not take more rows (a streaming reader
+  * has been closed); only the last pass puts rows...
+  */
+
+  if (y >= img->ysize)
+    png_read_end(pp, info);
+
   png_destroy_read_struct(&pp, &info, NULL);
 
   fclose(fp);
@@ -46,7 +46,8 @@ _cupsImageReadPNM(
 		*lineptr;		/* Pointer in line */
   int		format,			/* Format of PNM file */
 		val,			/* Pixel value */
-		maxval;			/* Maximum pixel value */
+		maxval,			/* Maximum pixel value */
+		status;			/* Status of last row */
 
 
  /*
@@ -165,10 +166,11 @@ _cupsImageReadPNM(
   }
 
  /*
-  * Read the image file...
+  * Read the image file, stopping early if the image cannot take more rows
+  * (a streaming reader has been closed)...
   */
 
-  for (y = 0; y < img->ysize; y ++)
+  for (y = 0, status = 0; y < img->ysize && !status; y ++)
   {
     switch (format)
     {
@@ -240,7 +242,7 @@ _cupsImageReadPNM(
 	    if (lut)
 	      cupsImageLut(in, img->xsize, lut);
 
-            _cupsImagePutRow(img, 0, y, img->xsize, in);
+            status = _cupsImagePutRow(img, 0, y, img->xsize, in);
 	  }
 	  else
 	  {
@@ -266,7 +268,7 @@ _cupsImageReadPNM(
 	    if (lut)
 	      cupsImageLut(out, img->xsize * bpp, lut);
 
-            _cupsImagePutRow(img, 0, y, img->xsize, out);
+            status = _cupsImagePutRow(img, 0, y, img->xsize, out);
 	  }
 	  break;
 
@@ -299,7 +301,7 @@ _cupsImageReadPNM(
 	  if (lut)
 	    cupsImageLut(out, img->xsize * bpp, lut);
 
-          _cupsImagePutRow(img, 0, y, img->xsize, out);
+          status = _cupsImagePutRow(img, 0, y, img->xsize, out);
   	  break;
     }
   }
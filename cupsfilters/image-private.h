@@ -32,6 +32,12 @@
 #  endif /* WIN32 */
 #  include <errno.h>
 #  include <math.h>
+#  ifdef HAVE_PTHREAD_H
+#    include <pthread.h>
+#  endif /* HAVE_PTHREAD_H */
+#  if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#    include <sys/mman.h>
+#  endif /* HAVE_SYS_MMAN_H && HAVE_MMAP */
 
 
 /*
@@ -46,6 +52,13 @@
 #  define CUPS_TILE_SIZE	256	/* 256x256 pixel tiles */
 #  define CUPS_TILE_MINIMUM	10	/* Minimum number of tiles */
 
+#  define CUPS_ISIMD_NONE	0	/* Scalar colorspace conversions */
+#  define CUPS_ISIMD_AVX2	1	/* x86 AVX2 colorspace conversions */
+#  define CUPS_ISIMD_NEON	2	/* ARM NEON colorspace conversions */
+
+#  define CUPS_STREAM_AHEAD	8	/* Rows decoded ahead of a streaming reader */
+#  define CUPS_STREAM_BACK	2	/* Default rows kept behind a streaming reader */
+
 
 /*
  * min/max/abs macros...
@@ -74,10 +87,12 @@ typedef enum cups_iztype_e		/**** Image zoom type ****/
 } cups_iztype_t;
 
 struct cups_ic_s;
+struct cups_istream_s;
 
 typedef struct cups_itile_s		/**** Image tile ****/
 {
   int			dirty;		/* True if tile is dirty */
+  int			resident;	/* True if mapped tile is in the resident list */
   off_t			pos;		/* Position of tile on disk (-1 if not written) */
   struct cups_ic_s	*ic;		/* Pixel data */
 } cups_itile_t;
@@ -87,6 +102,7 @@ typedef struct cups_ic_s		/**** Image tile cache ****/
   struct cups_ic_s	*prev,		/* Previous tile in cache */
 			*next;		/* Next tile in cache */
   cups_itile_t		*tile;		/* Tile this is attached to */
+  int			refs;		/* Number of readers using the tile */
   cups_ib_t		*pixels;	/* Pixel data */
 } cups_ic_t;
 
@@ -104,8 +120,67 @@ struct cups_image_s			/**** Image file data ****/
 			*last;		/* Last cached tile in image */
   int			cachefile;	/* Tile cache file */
   char			cachename[256];	/* Tile cache filename */
+  cups_icache_t		cachemode;	/* Tile cache mode */
+  off_t			cachesize;	/* Bytes used in tile cache file */
+  cups_ib_t		*cachemap;	/* Mapped tile cache file or NULL */
+  size_t		cachemapsize;	/* Size of mapped tile cache file */
+  cups_itile_t		**mapped;	/* Resident mapped tiles (FIFO) */
+  unsigned		num_mapped,	/* Number of resident mapped tiles */
+			first_mapped;	/* Oldest resident mapped tile */
+#  ifdef HAVE_PTHREAD_H
+  pthread_mutex_t	cachelock;	/* Lock for tiles and tile cache */
+#  endif /* HAVE_PTHREAD_H */
+  struct cups_istream_s	*stream;	/* Streaming decoder or NULL */
+  unsigned		min_xsize,	/* Smallest width to decode, 0 = full */
+			min_ysize;	/* Smallest height to decode, 0 = full */
 };
 
+typedef int (*cups_iread_t)(cups_image_t *img, FILE *fp,
+                            cups_icspace_t primary, cups_icspace_t secondary,
+                            int saturation, int hue, const cups_ib_t *lut);
+					/**** Image file reader ****/
+
+#  ifdef HAVE_PTHREAD_H
+typedef enum cups_isstate_e		/**** Streaming decoder state ****/
+{
+  CUPS_ISTREAM_START,			/* Nothing decoded yet */
+  CUPS_ISTREAM_ROWS,			/* Rows go to the row ring */
+  CUPS_ISTREAM_TILES,			/* Reader is not sequential, use tiles */
+  CUPS_ISTREAM_STOP			/* Reader has been told to stop */
+} cups_isstate_t;
+
+typedef struct cups_istream_s		/**** Streaming decoder ****/
+{
+  pthread_t		thread;		/* Decoder thread */
+  pthread_mutex_t	lock;		/* Lock for the state and row ring */
+  pthread_cond_t	cond;		/* Signals state and ring changes */
+  cups_isstate_t	state;		/* Current state */
+  int			done,		/* Non-zero when the reader returned */
+			status;		/* Status returned by the reader */
+  int			fd;		/* Duplicate of the file descriptor */
+  FILE			*fp;		/* File being decoded */
+  cups_iread_t		reader;		/* Reader for the file format */
+  int			flags;		/* Reader flags */
+  cups_icspace_t	primary,	/* Primary colorspace needed */
+			secondary;	/* Secondary colorspace */
+  int			saturation,	/* Color saturation level */
+			hue;		/* Color hue adjustment */
+  const cups_ib_t	*lut;		/* RGB gamma/brightness LUT or NULL */
+  cups_ib_t		lutdata[256];	/* Copy of the LUT */
+  cups_ib_t		*rows;		/* Row ring, row Y is at Y % num_rows */
+  int			bpr,		/* Bytes per row */
+			num_rows,	/* Number of rows in the ring */
+			back,		/* Rows to keep behind the newest request */
+			first,		/* First row in the ring */
+			count;		/* Number of rows in the ring */
+  int			fill,		/* Non-zero to decode into the tile cache */
+			avail,		/* Rows before this one are in the cache */
+			unordered;	/* Non-zero if rows came out of order */
+  int			hold,		/* Non-zero until the minimum size is set */
+			sized;		/* Non-zero when the reader is held */
+} cups_istream_t;
+#  endif /* HAVE_PTHREAD_H */
+
 struct cups_izoom_s			/**** Image zoom data ****/
 {
   cups_image_t		*img;		/* Image to zoom */
@@ -131,6 +206,14 @@ struct cups_izoom_s			/**** Image zoom data ****/
 			row;		/* Current row */
   cups_ib_t		*rows[2],	/* Horizontally scaled pixel data */
 			*in;		/* Unscaled input pixel data */
+  int			xtaps,		/* Input pixels per output pixel */
+			*xoffsets;	/* Input offsets for each output pixel */
+  short			*xweights;	/* Weights for each output pixel */
+  int			ytaps,		/* Input rows per output line */
+			*yoffsets;	/* Input rows for each output line */
+  short			*yweights;	/* Weights for each output line */
+  cups_ib_t		**taps;		/* Horizontally scaled input rows */
+  int			*tap_rows;	/* Input row in each of taps[] */
 };
 
 
@@ -138,6 +221,9 @@ struct cups_izoom_s			/**** Image zoom data ****/
  * Prototypes...
  */
 
+extern int		_cupsImageGetSIMD(void);
+extern int		_cupsImageGetError(cups_image_t *img);
+extern int		_cupsImageIsSequential(cups_image_t *img);
 extern int		_cupsImagePutCol(cups_image_t *img, int x, int y,
 			                 int height, const cups_ib_t *pixels);
 extern int		_cupsImagePutRow(cups_image_t *img, int x, int y,
@@ -197,8 +283,31 @@ extern int		_cupsImageReadTIFF(cups_image_t *img, FILE *fp,
 					   cups_icspace_t secondary,
 			                   int saturation, int hue,
 					   const cups_ib_t *lut);
+extern int		_cupsImageSIMDCMYKToRGB(const cups_ib_t *in,
+			                        cups_ib_t *out, int count,
+						const int *matrix,
+						const int *density);
+extern int		_cupsImageSIMDLut(cups_ib_t *pixels, int count,
+			                  const cups_ib_t *lut);
+extern int		_cupsImageSIMDRGBAdjust(cups_ib_t *pixels, int count,
+			                        const int *lut);
+extern int		_cupsImageSIMDRGBToCMYK(const cups_ib_t *in,
+			                        cups_ib_t *out, int count,
+						const int *matrix,
+						const int *density);
+extern int		_cupsImageSIMDRGBToRGB(const cups_ib_t *in,
+			                       cups_ib_t *out, int count,
+					       const int *matrix,
+					       const int *density);
+extern int		_cupsImageSIMDRGBToWhite(const cups_ib_t *in,
+			                         cups_ib_t *out, int count,
+						 const int *density);
+extern void		_cupsImageSetSIMD(int enable);
+extern void		_cupsImageSetStreamBack(cups_image_t *img, int back);
+extern int		_cupsImageWaitMinSize(cups_image_t *img);
 extern void		_cupsImageZoomDelete(cups_izoom_t *z);
 extern void		_cupsImageZoomFill(cups_izoom_t *z, int iy);
+extern void		_cupsImageZoomLine(cups_izoom_t *z, int y);
 extern cups_izoom_t	*_cupsImageZoomNew(cups_image_t *img, int xc0, int yc0,
 			                   int xc1, int yc1, int xsize,
 					   int ysize, int rotated,
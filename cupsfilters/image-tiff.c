@@ -463,7 +463,8 @@ _cupsImageReadTIFF(
 	      if (lut)
 	        cupsImageLut(in, img->xsize, lut);
 
-              _cupsImagePutRow(img, 0, y, img->xsize, in);
+              if (_cupsImagePutRow(img, 0, y, img->xsize, in))
+                goto stop;
 	    }
             else
             {
@@ -489,7 +490,8 @@ _cupsImageReadTIFF(
 	      if (lut)
 	        cupsImageLut(out, img->xsize * bpp, lut);
 
-              _cupsImagePutRow(img, 0, y, img->xsize, out);
+              if (_cupsImagePutRow(img, 0, y, img->xsize, out))
+                goto stop;
 	    }
           }
         }
@@ -615,7 +617,8 @@ _cupsImageReadTIFF(
 	      if (lut)
 	        cupsImageLut(in, img->ysize, lut);
 
-              _cupsImagePutCol(img, x, 0, img->ysize, in);
+              if (_cupsImagePutCol(img, x, 0, img->ysize, in))
+                goto stop;
 	    }
             else
             {
@@ -641,7 +644,8 @@ _cupsImageReadTIFF(
 	      if (lut)
 	        cupsImageLut(out, img->ysize * bpp, lut);
 
-              _cupsImagePutCol(img, x, 0, img->ysize, out);
+              if (_cupsImagePutCol(img, x, 0, img->ysize, out))
+                goto stop;
 	    }
           }
         }
@@ -799,7 +803,8 @@ _cupsImageReadTIFF(
 	    if (lut)
 	      cupsImageLut(out, img->xsize * bpp, lut);
 
-            _cupsImagePutRow(img, 0, y, img->xsize, out);
+            if (_cupsImagePutRow(img, 0, y, img->xsize, out))
+              goto stop;
           }
         }
         else
@@ -932,7 +937,8 @@ _cupsImageReadTIFF(
 	    if (lut)
 	      cupsImageLut(out, img->ysize * bpp, lut);
 
-            _cupsImagePutCol(img, x, 0, img->ysize, out);
+            if (_cupsImagePutCol(img, x, 0, img->ysize, out))
+              goto stop;
 	  }
         }
         break;
@@ -1076,7 +1082,8 @@ _cupsImageReadTIFF(
 	    if (lut)
 	      cupsImageLut(out, img->xsize * bpp, lut);
 
-            _cupsImagePutRow(img, 0, y, img->xsize, out);
+            if (_cupsImagePutRow(img, 0, y, img->xsize, out))
+              goto stop;
           }
         }
         else
@@ -1217,7 +1224,8 @@ _cupsImageReadTIFF(
 	    if (lut)
 	      cupsImageLut(out, img->ysize * bpp, lut);
 
-            _cupsImagePutCol(img, x, 0, img->ysize, out);
+            if (_cupsImagePutCol(img, x, 0, img->ysize, out))
+              goto stop;
           }
         }
         break;
@@ -1383,7 +1391,8 @@ _cupsImageReadTIFF(
               else if (img->colorspace == CUPS_IMAGE_CMYK)
 	      {
 	        TIFFReadScanline(tif, scanline, row, 0);
-		_cupsImagePutRow(img, 0, y, img->xsize, scanline);
+		if (_cupsImagePutRow(img, 0, y, img->xsize, scanline))
+		  goto stop;
 	      }
 	      else
               {
@@ -1457,7 +1466,8 @@ _cupsImageReadTIFF(
 	      if (lut)
 	        cupsImageLut(out, img->xsize * 3, lut);
 
-              _cupsImagePutRow(img, 0, y, img->xsize, out);
+              if (_cupsImagePutRow(img, 0, y, img->xsize, out))
+                goto stop;
             }
           }
           else
@@ -1605,7 +1615,8 @@ _cupsImageReadTIFF(
               else if (img->colorspace == CUPS_IMAGE_CMYK)
 	      {
 	        TIFFReadScanline(tif, scanline, row, 0);
-		_cupsImagePutCol(img, x, 0, img->ysize, scanline);
+		if (_cupsImagePutCol(img, x, 0, img->ysize, scanline))
+		  goto stop;
 	      }
               else
               {
@@ -1679,7 +1690,8 @@ _cupsImageReadTIFF(
 	      if (lut)
 	        cupsImageLut(out, img->ysize * bpp, lut);
 
-              _cupsImagePutCol(img, x, 0, img->ysize, out);
+              if (_cupsImagePutCol(img, x, 0, img->ysize, out))
+                goto stop;
             }
           }
 
@@ -1697,9 +1709,13 @@ _cupsImageReadTIFF(
   }
 
  /*
-  * Free temporary buffers, close the TIFF file, and return.
+  * Free temporary buffers, close the TIFF file, and return; we also get here
+  * early if the image could not take more pixels (a streaming reader has
+  * been closed).
   */
 
+  stop:
+
   _TIFFfree(scanline);
   free(in);
   free(out);
@@ -9,15 +9,27 @@
  *   law.  Distribution and use rights are outlined in the file "COPYING"
  *   which should have been included with this file.
  *
+ *   Zooming is separable: each input row is first scaled horizontally
+ *   and the scaled rows are then combined vertically.  The input pixels
+ *   and fixed-point weights for every output column (and, for bicubic
+ *   zooming, every output line) are computed once when the zoom record
+ *   is created and reused for every row.
+ *
  * Contents:
  *
  *   _cupsImageZoomDelete() - Free a zoom record...
- *   _cupsImageZoomFill()   - Fill a zoom record...
+ *   _cupsImageZoomFill()   - Fill a zoom record with a horizontally scaled
+ *                            image row.
+ *   _cupsImageZoomLine()   - Fill a zoom record with a scaled output line.
  *   _cupsImageZoomNew()    - Allocate a pixel zoom record...
- *   zoom_bilinear()        - Fill a zoom record with image data utilizing
- *                            bilinear interpolation.
- *   zoom_nearest()         - Fill a zoom record quickly using nearest-neighbor
- *                            sampling.
+ *   cubic()                - Compute the Catmull-Rom bicubic weight.
+ *   get_row()              - Get an unscaled row of the zoom area.
+ *   make_taps()            - Compute the input pixels and weights for an
+ *                            axis.
+ *   zoom_taps()            - Scale a row horizontally using the weights.
+ *   zoom_nearest()         - Scale a row horizontally using nearest-
+ *                            neighbor sampling.
+ *   zoom_vertical()        - Combine scaled rows using the weights.
  */
 
 /*
@@ -26,13 +38,37 @@
 
 #include "image-private.h"
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(HAVE_ARM_NEON_H)
+#  include <arm_neon.h>
+#endif /* __SSE2__ */
+
+
+/*
+ * Constants...
+ */
+
+#define ZOOM_BITS	14		/* Fraction bits in weights */
+#define ZOOM_ONE	(1 << ZOOM_BITS)/* Weight of 1.0 */
+#define ZOOM_HALF	(1 << (ZOOM_BITS - 1))
+					/* Rounding value */
+#define ZOOM_MAX_TAPS	64		/* Maximum input pixels per output pixel */
+
 
 /*
  * Local functions...
  */
 
-static void	zoom_bilinear(cups_izoom_t *z, int iy);
-static void	zoom_nearest(cups_izoom_t *z, int iy);
+static double	cubic(double x);
+static void	get_row(cups_izoom_t *z, int iy);
+static int	make_taps(cups_iztype_t type, int insize, int outsize,
+		          int flip, int scale, int *taps, int **offsets,
+			  short **weights);
+static void	zoom_nearest(cups_izoom_t *z, cups_ib_t *r);
+static void	zoom_taps(cups_izoom_t *z, cups_ib_t *r);
+static void	zoom_vertical(cups_ib_t **rows, const short *weights, int taps,
+		              cups_ib_t *r, int count);
 
 
 /*
@@ -42,6 +78,22 @@ static void	zoom_nearest(cups_izoom_t *z, int iy);
 void
 _cupsImageZoomDelete(cups_izoom_t *z)	/* I - Zoom record to free */
 {
+  int	i;				/* Looping var */
+
+
+  if (z->taps)
+  {
+    for (i = 0; i < z->ytaps; i ++)
+      free(z->taps[i]);
+
+    free(z->taps);
+  }
+
+  free(z->tap_rows);
+  free(z->xoffsets);
+  free(z->xweights);
+  free(z->yoffsets);
+  free(z->yweights);
   free(z->rows[0]);
   free(z->rows[1]);
   free(z->in);
@@ -50,24 +102,82 @@ _cupsImageZoomDelete(cups_izoom_t *z)	/* I - Zoom record to free */
 
 
 /*
- * '_cupsImageZoomFill()' - Fill a zoom record with image data utilizing bilinear
- *                         interpolation.
+ * '_cupsImageZoomFill()' - Fill a zoom record with a horizontally scaled
+ *                          image row.
+ *
+ * The scaled row is stored in z->rows[z->row] after the call; the previous
+ * row is still available in the other buffer for interpolation.
  */
 
 void
 _cupsImageZoomFill(cups_izoom_t *z,	/* I - Zoom record to fill */
                    int     iy)		/* I - Zoom image row */
 {
-  switch (z->type)
+  if (iy > z->ymax)
+    iy = z->ymax;
+
+  z->row ^= 1;
+
+  get_row(z, iy);
+
+  if (z->type == CUPS_IZOOM_FAST)
+    zoom_nearest(z, z->rows[z->row]);
+  else
+    zoom_taps(z, z->rows[z->row]);
+}
+
+
+/*
+ * '_cupsImageZoomLine()' - Fill a zoom record with a scaled output line.
+ *
+ * This does both the horizontal and the vertical scaling; the finished
+ * line is stored in z->rows[z->row].  The zoom record must have been
+ * created with CUPS_IZOOM_BEST.  Input rows are scaled horizontally only
+ * once while they are in use, so lines should be requested in order.
+ */
+
+void
+_cupsImageZoomLine(cups_izoom_t *z,	/* I - Zoom record to fill */
+                   int          y)	/* I - Output line, 0 = top */
+{
+  int		i,			/* Looping var */
+		iy,			/* Input row */
+		slot;			/* Slot in taps[] */
+  const int	*offsets;		/* Input rows for this line */
+  cups_ib_t	*rows[ZOOM_MAX_TAPS];	/* Scaled input rows for this line */
+
+
+  if (y < 0)
+    y = 0;
+  else if (y >= (int)z->ysize)
+    y = z->ysize - 1;
+
+  z->row ^= 1;
+
+  offsets = z->yoffsets + y * z->ytaps;
+
+  for (i = 0; i < z->ytaps; i ++)
   {
-    case CUPS_IZOOM_FAST :
-        zoom_nearest(z, iy);
-	break;
+   /*
+    * The rows for a line are consecutive (apart from clamping at the
+    * edges), so they never compete for the same slot...
+    */
 
-    default :
-        zoom_bilinear(z, iy);
-	break;
+    iy   = offsets[i];
+    slot = iy % z->ytaps;
+
+    if (z->tap_rows[slot] != iy)
+    {
+      get_row(z, iy);
+      zoom_taps(z, z->taps[slot]);
+      z->tap_rows[slot] = iy;
+    }
+
+    rows[i] = z->taps[slot];
   }
+
+  zoom_vertical(rows, z->yweights + y * z->ytaps, z->ytaps,
+                z->rows[z->row], z->xsize * z->depth);
 }
 
 
@@ -87,6 +197,7 @@ _cupsImageZoomNew(
     int           rotated,		/* I - Non-zero if image is rotated 90 degs */
     cups_iztype_t type)			/* I - Zoom type */
 {
+  int		i;			/* Looping var */
   cups_izoom_t	*z;			/* New zoom record */
   int		flip;			/* Flip on X axis? */
 
@@ -177,176 +288,438 @@ _cupsImageZoomNew(
     z->inincr = -z->inincr;
   }
 
-  if ((z->rows[0] = (cups_ib_t *)malloc(z->xsize * z->depth)) == NULL)
+  if ((z->rows[0] = (cups_ib_t *)malloc(z->xsize * z->depth)) == NULL ||
+      (z->rows[1] = (cups_ib_t *)malloc(z->xsize * z->depth)) == NULL ||
+      (z->in = (cups_ib_t *)malloc(z->width * z->depth)) == NULL)
   {
-    free(z);
+    _cupsImageZoomDelete(z);
     return (NULL);
   }
 
-  if ((z->rows[1] = (cups_ib_t *)malloc(z->xsize * z->depth)) == NULL)
+ /*
+  * Compute the input pixels and weights for each output column...
+  */
+
+  if (make_taps(type, z->width, z->xsize, flip, z->depth, &(z->xtaps),
+                &(z->xoffsets), &(z->xweights)))
   {
-    free(z->rows[0]);
-    free(z);
+    _cupsImageZoomDelete(z);
     return (NULL);
   }
 
-  if ((z->in = (cups_ib_t *)malloc(z->width * z->depth)) == NULL)
+ /*
+  * ... and for bicubic zooming each output line, along with a scaled row
+  * buffer for each input row used by a line...
+  */
+
+  if (type == CUPS_IZOOM_BEST)
   {
-    free(z->rows[0]);
-    free(z->rows[1]);
-    free(z);
-    return (NULL);
+    if (make_taps(type, z->height, z->ysize, 0, 1, &(z->ytaps),
+                  &(z->yoffsets), &(z->yweights)) ||
+        (z->taps = calloc(z->ytaps, sizeof(cups_ib_t *))) == NULL ||
+        (z->tap_rows = malloc(z->ytaps * sizeof(int))) == NULL)
+    {
+      _cupsImageZoomDelete(z);
+      return (NULL);
+    }
+
+    for (i = 0; i < z->ytaps; i ++)
+    {
+      z->tap_rows[i] = -1;
+
+      if ((z->taps[i] = malloc(z->xsize * z->depth)) == NULL)
+      {
+	_cupsImageZoomDelete(z);
+	return (NULL);
+      }
+    }
   }
 
+ /*
+  * Keep the rows used for interpolation around when streaming...
+  */
+
+  if (!rotated)
+    _cupsImageSetStreamBack(img, type == CUPS_IZOOM_BEST ? z->ytaps : 2);
+
   return (z);
 }
 
 
 /*
- * 'zoom_bilinear()' - Fill a zoom record with image data utilizing bilinear
- *                     interpolation.
+ * 'cubic()' - Compute the Catmull-Rom bicubic weight.
  */
 
-static void
-zoom_bilinear(cups_izoom_t *z,		/* I - Zoom record to fill */
-              int          iy)		/* I - Zoom image row */
+static double				/* O - Weight */
+cubic(double x)				/* I - Distance from sample */
 {
-  cups_ib_t	*r,			/* Row pointer */
-		*inptr;			/* Pixel pointer */
-  int		xerr0,			/* X error counter */
-		xerr1;			/* ... */
-  int		ix,
-		x,
-		count,
-		z_depth,
-		z_xstep,
-		z_xincr,
-		z_instep,
-		z_inincr,
-		z_xmax,
-		z_xmod,
-		z_xsize;
+  if (x < 0.0)
+    x = -x;
 
+  if (x < 1.0)
+    return ((1.5 * x - 2.5) * x * x + 1.0);
+  else if (x < 2.0)
+    return (((-0.5 * x + 2.5) * x - 4.0) * x + 2.0);
+  else
+    return (0.0);
+}
 
-  if (iy > z->ymax)
-    iy = z->ymax;
-
-  z->row ^= 1;
 
-  z_depth  = z->depth;
-  z_xsize  = z->xsize;
-  z_xmax   = z->xmax;
-  z_xmod   = z->xmod;
-  z_xstep  = z->xstep;
-  z_xincr  = z->xincr;
-  z_instep = z->instep;
-  z_inincr = z->inincr;
+/*
+ * 'get_row()' - Get an unscaled row of the zoom area.
+ */
 
+static void
+get_row(cups_izoom_t *z,		/* I - Zoom record */
+        int          iy)		/* I - Zoom image row */
+{
   if (z->rotated)
     cupsImageGetCol(z->img, z->xorig - iy, z->yorig, z->width, z->in);
   else
     cupsImageGetRow(z->img, z->xorig, z->yorig + iy, z->width, z->in);
+}
 
-  if (z_inincr < 0)
-    inptr = z->in + (z->width - 1) * z_depth;
-  else
-    inptr = z->in;
 
-  for (x = z_xsize, xerr0 = z_xsize, xerr1 = 0, ix = 0, r = z->rows[z->row];
-       x > 0;
-       x --)
+/*
+ * 'make_taps()' - Compute the input pixels and weights for an axis.
+ *
+ * Output pixel N is centered on input position N * insize / outsize, like
+ * the Bresenham stepping used by the callers.  Bicubic zooming widens the
+ * filter when reducing so that every input pixel contributes.  Offsets are
+ * multiplied by "scale" so they can be used directly as byte offsets.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+make_taps(cups_iztype_t type,		/* I - Zoom type */
+          int           insize,		/* I - Number of input pixels */
+          int           outsize,	/* I - Number of output pixels */
+	  int           flip,		/* I - Reverse the input? */
+	  int           scale,		/* I - Offset multiplier */
+	  int           *taps,		/* O - Input pixels per output pixel */
+	  int           **offsets,	/* O - Input offsets */
+	  short         **weights)	/* O - Input weights */
+{
+  int		x, i,			/* Looping vars */
+		first,			/* First input pixel */
+		pos,			/* Input pixel */
+		total,			/* Total of fixed-point weights */
+		biggest;		/* Tap with the biggest weight */
+  long long	fpos;			/* Position times output size */
+  double	center,			/* Input position */
+		support,		/* Input pixels on each side */
+		stretch,		/* Filter stretch for reductions */
+		w[ZOOM_MAX_TAPS],	/* Weights */
+		wtotal;			/* Total of weights */
+  int		*o;			/* Current offset */
+  short		*ws;			/* Current weight */
+
+
+  switch (type)
+  {
+    case CUPS_IZOOM_FAST :
+        *taps   = 1;
+	stretch = 1.0;
+	support = 0.0;
+        break;
+
+    case CUPS_IZOOM_NORMAL :
+        *taps   = 2;
+	stretch = 1.0;
+	support = 1.0;
+        break;
+
+    default :
+        if (insize > outsize)
+	  stretch = (double)insize / outsize;
+	else
+	  stretch = 1.0;
+
+        if (stretch > ZOOM_MAX_TAPS / 4)
+	  stretch = ZOOM_MAX_TAPS / 4;	/* Limit the cost of big reductions */
+
+        support = 2.0 * stretch;
+	*taps   = 2 * (int)ceil(support);
+        break;
+  }
+
+  if ((*offsets = malloc(outsize * *taps * sizeof(int))) == NULL)
+    return (-1);
+
+  if ((*weights = malloc(outsize * *taps * sizeof(short))) == NULL)
+  {
+    free(*offsets);
+    *offsets = NULL;
+    return (-1);
+  }
+
+  for (x = 0, o = *offsets, ws = *weights; x < outsize; x ++)
   {
-    if (ix < z_xmax)
+    fpos   = (long long)x * insize;
+    center = (double)fpos / outsize;
+    first  = (int)(fpos / outsize) - *taps / 2 + 1;
+
+    if (type == CUPS_IZOOM_FAST)
+      first = (int)(fpos / outsize);
+
+   /*
+    * Compute the weights...
+    */
+
+    if (type == CUPS_IZOOM_FAST)
+      w[0] = 1.0;
+    else if (type == CUPS_IZOOM_NORMAL)
     {
-      for (count = 0; count < z_depth; count ++)
-        *r++ = (inptr[count] * xerr0 + inptr[z_depth + count] * xerr1) / z_xsize;
+      w[1] = (double)(fpos % outsize) / outsize;
+      w[0] = 1.0 - w[1];
     }
     else
     {
-      for (count = 0; count < z_depth; count ++)
-        *r++ = inptr[count];
+      for (i = 0, wtotal = 0.0; i < *taps; i ++)
+        wtotal += (w[i] = cubic((first + i - center) / stretch));
+
+      for (i = 0; i < *taps; i ++)
+        w[i] /= wtotal;
+    }
+
+   /*
+    * Then convert them to fixed point, putting any rounding error on the
+    * biggest weight so the total is exactly 1.0...
+    */
+
+    for (i = 0, total = 0, biggest = 0; i < *taps; i ++)
+    {
+      ws[i] = (short)floor(w[i] * ZOOM_ONE + 0.5);
+      total += ws[i];
+
+      if (ws[i] > ws[biggest])
+        biggest = i;
     }
 
-    ix    += z_xstep;
-    inptr += z_instep;
-    xerr0 -= z_xmod;
-    xerr1 += z_xmod;
+    ws[biggest] += ZOOM_ONE - total;
+
+   /*
+    * Clamp the input pixels to the edges...
+    */
 
-    if (xerr0 <= 0)
+    for (i = 0; i < *taps; i ++)
     {
-      xerr0 += z_xsize;
-      xerr1 -= z_xsize;
-      ix    += z_xincr;
-      inptr += z_inincr;
+      pos = first + i;
+
+      if (pos < 0)
+        pos = 0;
+      else if (pos >= insize)
+        pos = insize - 1;
+
+      if (flip)
+        pos = insize - 1 - pos;
+
+      o[i] = pos * scale;
     }
+
+    o  += *taps;
+    ws += *taps;
   }
+
+  return (0);
 }
 
 
 /*
- * 'zoom_nearest()' - Fill a zoom record quickly using nearest-neighbor
+ * 'zoom_nearest()' - Scale a row horizontally using nearest-neighbor
  *                    sampling.
  */
 
 static void
-zoom_nearest(cups_izoom_t *z,		/* I - Zoom record to fill */
-             int          iy)		/* I - Zoom image row */
+zoom_nearest(cups_izoom_t *z,		/* I - Zoom record */
+             cups_ib_t    *r)		/* O - Scaled row */
 {
-  cups_ib_t	*r,			/* Row pointer */
-		*inptr;			/* Pixel pointer */
-  int		xerr0;			/* X error counter */
-  int		ix,
-		x,
-		count,
-		z_depth,
-		z_xstep,
-		z_xincr,
-		z_instep,
-		z_inincr,
-		z_xmod,
-		z_xsize;
+  int		x,			/* Looping var */
+		z_depth;		/* Bytes per pixel */
+  const int	*offsets;		/* Input offsets */
+  const cups_ib_t *inptr;		/* Input pixel */
 
 
-  if (iy > z->ymax)
-    iy = z->ymax;
+  z_depth = z->depth;
+  offsets = z->xoffsets;
 
-  z->row ^= 1;
+  switch (z_depth)
+  {
+    case 1 :
+        for (x = z->xsize; x > 0; x --)
+	  *r++ = z->in[*offsets++];
+        break;
+
+    case 3 :
+        for (x = z->xsize; x > 0; x --)
+	{
+	  inptr = z->in + *offsets++;
+	  *r++  = inptr[0];
+	  *r++  = inptr[1];
+	  *r++  = inptr[2];
+	}
+        break;
 
-  z_depth  = z->depth;
-  z_xsize  = z->xsize;
-  z_xmod   = z->xmod;
-  z_xstep  = z->xstep;
-  z_xincr  = z->xincr;
-  z_instep = z->instep;
-  z_inincr = z->inincr;
+    default :
+        for (x = z->xsize; x > 0; x --, r += z_depth)
+	  memcpy(r, z->in + *offsets++, z_depth);
+        break;
+  }
+}
 
-  if (z->rotated)
-    cupsImageGetCol(z->img, z->xorig - iy, z->yorig, z->width, z->in);
-  else
-    cupsImageGetRow(z->img, z->xorig, z->yorig + iy, z->width, z->in);
 
-  if (z_inincr < 0)
-    inptr = z->in + (z->width - 1) * z_depth;
+/*
+ * 'zoom_taps()' - Scale a row horizontally using the weights.
+ */
+
+static void
+zoom_taps(cups_izoom_t *z,		/* I - Zoom record */
+          cups_ib_t    *r)		/* O - Scaled row */
+{
+  int		x, i, count,		/* Looping vars */
+		z_depth,		/* Bytes per pixel */
+		z_taps,			/* Input pixels per output pixel */
+		sum;			/* Weighted sum */
+  const int	*offsets;		/* Input offsets */
+  const short	*weights;		/* Input weights */
+  const cups_ib_t *in;			/* Input pixels */
+
+
+  z_depth = z->depth;
+  z_taps  = z->xtaps;
+  offsets = z->xoffsets;
+  weights = z->xweights;
+  in      = z->in;
+
+  if (z_taps == 2)
+  {
+   /*
+    * Bilinear weights are never negative, so no clamping is needed...
+    */
+
+    for (x = z->xsize; x > 0; x --, offsets += 2, weights += 2)
+      for (count = 0; count < z_depth; count ++)
+        *r++ = (in[offsets[0] + count] * weights[0] +
+	        in[offsets[1] + count] * weights[1] + ZOOM_HALF) >> ZOOM_BITS;
+  }
   else
-    inptr = z->in;
+  {
+    for (x = z->xsize; x > 0; x --, offsets += z_taps, weights += z_taps)
+      for (count = 0; count < z_depth; count ++)
+      {
+        for (i = 0, sum = ZOOM_HALF; i < z_taps; i ++)
+	  sum += in[offsets[i] + count] * weights[i];
+
+        if (sum < 0)
+	  *r++ = 0;
+	else if (sum >= (256 << ZOOM_BITS))
+	  *r++ = 255;
+	else
+	  *r++ = sum >> ZOOM_BITS;
+      }
+  }
+}
+
+
+/*
+ * 'zoom_vertical()' - Combine scaled rows using the weights.
+ */
+
+static void
+zoom_vertical(cups_ib_t   **rows,	/* I - Scaled input rows */
+              const short *weights,	/* I - Weight of each row */
+	      int         taps,		/* I - Number of rows */
+              cups_ib_t   *r,		/* O - Output line */
+	      int         count)	/* I - Number of bytes */
+{
+  int		i,			/* Looping var */
+		x,			/* Current byte */
+		sum;			/* Weighted sum */
+
+
+  x = 0;
+
+#if defined(__SSE2__)
+ /*
+  * Do 8 bytes at a time, multiplying pairs of rows with PMADDWD...
+  */
 
-  for (x = z_xsize, xerr0 = z_xsize, ix = 0, r = z->rows[z->row];
-       x > 0;
-       x --)
   {
-    for (count = 0; count < z_depth; count ++)
-      *r++ = inptr[count];
+    const __m128i zero = _mm_setzero_si128();
+    __m128i	a, b,			/* Pixels from a pair of rows */
+		w,			/* Weights for the pair */
+		lo, hi;			/* Sums */
 
-    ix    += z_xstep;
-    inptr += z_instep;
-    xerr0 -= z_xmod;
 
-    if (xerr0 <= 0)
+    for (; x + 8 <= count; x += 8)
     {
-      xerr0 += z_xsize;
-      ix    += z_xincr;
-      inptr += z_inincr;
+      lo = hi = _mm_set1_epi32(ZOOM_HALF);
+
+      for (i = 0; i < taps; i += 2)
+      {
+        a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[i] + x)),
+	                      zero);
+	if (i + 1 < taps)
+	{
+	  b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[i + 1] +
+	                                                          x)), zero);
+          w = _mm_set1_epi32((int)((weights[i] & 0xffff) |
+	                           ((unsigned)weights[i + 1] << 16)));
+	}
+	else
+	{
+	  b = zero;
+	  w = _mm_set1_epi32(weights[i] & 0xffff);
+	}
+
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+      }
+
+      lo = _mm_packs_epi32(_mm_srai_epi32(lo, ZOOM_BITS),
+                           _mm_srai_epi32(hi, ZOOM_BITS));
+      _mm_storel_epi64((__m128i *)(r + x), _mm_packus_epi16(lo, lo));
     }
   }
-}
 
+#elif defined(__ARM_NEON) && defined(HAVE_ARM_NEON_H)
+ /*
+  * Do 8 bytes at a time with widening multiply-accumulates...
+  */
+
+  {
+    int16x8_t	a;			/* Pixels from one row */
+    int32x4_t	lo, hi;			/* Sums */
+
+
+    for (; x + 8 <= count; x += 8)
+    {
+      lo = hi = vdupq_n_s32(ZOOM_HALF);
+
+      for (i = 0; i < taps; i ++)
+      {
+        a  = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[i] + x)));
+	lo = vmlal_n_s16(lo, vget_low_s16(a), weights[i]);
+	hi = vmlal_n_s16(hi, vget_high_s16(a), weights[i]);
+      }
+
+      vst1_u8(r + x,
+              vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, ZOOM_BITS)),
+	                               vqmovn_s32(vshrq_n_s32(hi,
+				                              ZOOM_BITS)))));
+    }
+  }
+#endif /* __SSE2__ */
+
+  for (; x < count; x ++)
+  {
+    for (i = 0, sum = ZOOM_HALF; i < taps; i ++)
+      sum += rows[i][x] * weights[i];
+
+    if (sum < 0)
+      r[x] = 0;
+    else if (sum >= (256 << ZOOM_BITS))
+      r[x] = 255;
+    else
+      r[x] = sum >> ZOOM_BITS;
+  }
+}
@@ -15,17 +15,49 @@
  *   cupsImageGetCol()        - Get a column of pixels from an image.
  *   cupsImageGetColorSpace() - Get the image colorspace.
  *   cupsImageGetDepth()      - Get the number of bytes per pixel.
+ *   _cupsImageGetError()     - Tell whether decoding an image failed.
  *   cupsImageGetHeight()     - Get the height of an image.
  *   cupsImageGetRow()        - Get a row of pixels from an image.
+ *   cupsImageGetRows()       - Read a range of rows using several threads.
  *   cupsImageGetWidth()      - Get the width of an image.
  *   cupsImageGetXPPI()       - Get the horizontal resolution of an image.
  *   cupsImageGetYPPI()       - Get the vertical resolution of an image.
  *   cupsImageOpen()          - Open an image file and read it into memory.
+ *   cupsImageOpenStream()    - Open an image file for reading from top to
+ *                              bottom.
+ *   _cupsImageIsSequential() - Tell whether the rows of an image must be read
+ *                              in order.
  *   _cupsImagePutCol()       - Put a column of pixels to an image.
  *   _cupsImagePutRow()       - Put a row of pixels to an image.
+ *   cupsImageSetCacheMode()  - Set the tile cache mode for new images.
  *   cupsImageSetMaxTiles()   - Set the maximum number of tiles to cache.
+ *   cupsImageSetMinSize()    - Set the smallest size an image is needed at.
+ *   _cupsImageSetStreamBack() - Set the number of rows a streaming image keeps
+ *                              behind the last row read.
+ *   _cupsImageWaitMinSize()  - Wait until the minimum size of a streaming
+ *                              image is known.
  *   flush_tile()             - Flush the least-recently-used tile in the cache.
- *   get_tile()               - Get a cached tile.
+ *   free_tiles()             - Free the tiles and the tile cache of an image.
+ *   get_reader()             - Get the reader for an image file.
+ *   get_rows()               - Read bands of rows for cupsImageGetRows().
+ *   get_tile()               - Get and lock a cached tile.
+ *   map_cache()              - Map a sparse swap file for all tiles.
+ *   map_tile()               - Mark a mapped tile resident, evicting old ones.
+ *   open_image()             - Open an image file for cupsImageOpen() and
+ *                              cupsImageOpenStream().
+ *   release_tile()           - Release a tile locked by get_tile().
+ *   stream_close()           - Stop the decoder thread and free the streaming
+ *                              state.
+ *   stream_get_row()         - Get a row of pixels from the row ring.
+ *   stream_open()            - Start decoding an image file in a separate
+ *                              thread.
+ *   stream_put_col()         - Put a column of pixels to a streaming image.
+ *   stream_put_row()         - Put a row of pixels to a streaming image.
+ *   stream_release()         - Let a held decoder decode the pixels.
+ *   stream_reopen()          - Decode a streaming image again from the start.
+ *   stream_thread()          - Run the image reader for a streaming image.
+ *   stream_wait()            - Wait until the decoder has put a row into the
+ *                              tile cache.
  */
 
 /*
@@ -36,64 +68,110 @@
 
 
 /*
- * Local functions...
+ * Reader flags...
  */
 
-static void		flush_tile(cups_image_t *img);
-static cups_ib_t	*get_tile(cups_image_t *img, int x, int y);
+#define CUPS_IREAD_STREAM	1	/* Reader can write rows in order */
+#define CUPS_IREAD_SCALE	2	/* Reader can decode at a reduced size */
 
 
 /*
- * 'cupsImageClose()' - Close an image file.
+ * Ways to open an image...
  */
 
-void
-cupsImageClose(cups_image_t *img)	/* I - Image to close */
+#define CUPS_IOPEN_LOAD		0	/* Load the whole image into tiles */
+#define CUPS_IOPEN_STREAM	1	/* Decode rows into a ring on demand */
+#define CUPS_IOPEN_FILL		2	/* Decode into tiles in the background */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct cups_irows_s		/**** Row range reader state ****/
 {
-  cups_ic_t	*current,		/* Current cached tile */
-		*next;			/* Next cached tile */
+  cups_image_t		*img;		/* Image to read */
+  int			y,		/* Next band to read */
+			y1;		/* Last row to read */
+  cups_irows_cb_t	cb;		/* Callback for each band */
+  void			*context;	/* Callback context */
+  int			status;		/* -1 if reading failed or stopped */
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t	lock;		/* Lock for "y" and "status" */
+#endif /* HAVE_PTHREAD_H */
+} cups_irows_t;
 
 
- /*
-  * Wipe the tile cache file (if any)...
-  */
+/*
+ * Local functions...
+ */
 
-  if (img->cachefile >= 0)
-  {
-    DEBUG_printf(("Closing/removing swap file \"%s\"...\n", img->cachename));
+static cups_ic_t	*flush_tile(cups_image_t *img);
+static void		free_tiles(cups_image_t *img);
+static cups_iread_t	get_reader(const unsigned char *header,
+			           const unsigned char *header2, int *flags);
+static void		*get_rows(void *data);
+static cups_ib_t	*get_tile(cups_image_t *img, int x, int y,
+			          cups_ic_t **ic);
+static int		map_cache(cups_image_t *img, int ntiles);
+static void		map_tile(cups_image_t *img, cups_itile_t *tile);
+static cups_image_t	*open_image(const char *filename,
+			            cups_icspace_t primary,
+				    cups_icspace_t secondary, int saturation,
+				    int hue, const cups_ib_t *lut, int mode);
+static void		release_tile(cups_image_t *img, cups_ic_t *ic);
+#ifdef HAVE_PTHREAD_H
+static void		stream_close(cups_image_t *img, int *fd);
+static int		stream_get_row(cups_image_t *img, int x, int y,
+			               int width, cups_ib_t *pixels);
+static int		stream_open(cups_image_t *img, FILE *fp,
+			            cups_iread_t reader, int flags, int mode,
+				    cups_icspace_t primary,
+				    cups_icspace_t secondary, int saturation,
+				    int hue, const cups_ib_t *lut);
+static int		stream_put_col(cups_image_t *img);
+static int		stream_put_row(cups_image_t *img, int x, int y,
+			               int width, const cups_ib_t *pixels);
+static int		stream_release(cups_image_t *img);
+static int		stream_reopen(cups_image_t *img, int mode);
+static void		*stream_thread(void *data);
+static int		stream_wait(cups_image_t *img, int y);
+#endif /* HAVE_PTHREAD_H */
 
-    close(img->cachefile);
-    unlink(img->cachename);
-  }
 
- /*
-  * Free the image cache...
-  */
+/*
+ * Local globals...
+ */
 
-  DEBUG_puts("Freeing memory...");
+static cups_icache_t	cache_mode = CUPS_IMAGE_CACHE_AUTO;
+					/* Tile cache mode for new images */
 
-  for (current = img->first, next = NULL; current != NULL; current = next)
-  {
-    DEBUG_printf(("Freeing cache (%p, next = %p)...\n", current, next));
 
-    next = current->next;
-    free(current);
-  }
+/*
+ * 'cupsImageClose()' - Close an image file.
+ */
 
+void
+cupsImageClose(cups_image_t *img)	/* I - Image to close */
+{
+#ifdef HAVE_PTHREAD_H
  /*
-  * Free the rest of memory...
+  * Stop the streaming decoder (if any)...
   */
 
-  if (img->tiles != NULL)
-  {
-    DEBUG_printf(("Freeing tiles (%p)...\n", img->tiles[0]));
+  if (img->stream)
+    stream_close(img, NULL);
+#endif /* HAVE_PTHREAD_H */
 
-    free(img->tiles[0]);
+ /*
+  * Free the tile cache and the rest of memory...
+  */
 
-    DEBUG_printf(("Freeing tile pointers (%p)...\n", img->tiles));
+  free_tiles(img);
 
-    free(img->tiles);
-  }
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
 
   free(img);
 }
@@ -114,6 +192,7 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
 			twidth,		/* Tile width */
 			count;		/* Number of pixels to get */
   const cups_ib_t	*ib;		/* Pointer into tile */
+  cups_ic_t		*ic;		/* Locked tile */
 
 
   if (img == NULL || x < 0 || x >= img->xsize || y >= img->ysize)
@@ -131,12 +210,25 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
   if (height < 1)
     return (-1);
 
+#ifdef HAVE_PTHREAD_H
+  if (img->stream && stream_release(img))
+    return (-1);
+
+  if (img->stream && img->stream->fill)
+  {
+    if (stream_wait(img, y + height - 1))
+      return (-1);
+  }
+  else if (img->stream && stream_reopen(img, CUPS_IOPEN_LOAD))
+    return (-1);
+#endif /* HAVE_PTHREAD_H */
+
   bpp    = cupsImageGetDepth(img);
   twidth = bpp * (CUPS_TILE_SIZE - 1);
 
   while (height > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &ic);
 
     if (ib == NULL)
       return (-1);
@@ -160,6 +252,8 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
             *pixels++ = *ib++;
             break;
       }
+
+    release_tile(img, ic);
   }
 
   return (0);
@@ -189,6 +283,37 @@ cupsImageGetDepth(cups_image_t *img)	/* I - Image */
 }
 
 
+/*
+ * '_cupsImageGetError()' - Tell whether decoding an image failed.
+ *
+ * Images from cupsImageOpenStream() are decoded while they are read, so a
+ * damaged file only shows up as failed reads.  Callers which do not check
+ * every read can ask here once they are done.
+ */
+
+int					/* O - -1 if decoding failed, 0 otherwise */
+_cupsImageGetError(cups_image_t *img)	/* I - Image */
+{
+  int	status = 0;			/* Return status */
+
+
+  if (img->xsize == 0 || img->ysize == 0)
+    return (-1);
+
+#ifdef HAVE_PTHREAD_H
+  if (img->stream)
+  {
+    pthread_mutex_lock(&img->stream->lock);
+    if (img->stream->done && img->stream->status)
+      status = -1;
+    pthread_mutex_unlock(&img->stream->lock);
+  }
+#endif /* HAVE_PTHREAD_H */
+
+  return (status);
+}
+
+
 /*
  * 'cupsImageGetHeight()' - Get the height of an image.
  */
@@ -214,6 +339,7 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
   int			bpp,		/* Bytes per pixel */
 			count;		/* Number of pixels to get */
   const cups_ib_t	*ib;		/* Pointer to pixels */
+  cups_ic_t		*ic;		/* Locked tile */
 
 
   if (img == NULL || y < 0 || y >= img->ysize || x >= img->xsize)
@@ -231,11 +357,39 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
   if (width < 1)
     return (-1);
 
+#ifdef HAVE_PTHREAD_H
+  if (img->stream && stream_release(img))
+    return (-1);
+
+  if (img->stream && img->stream->fill)
+  {
+   /*
+    * Wait for the decoder to put the row into the tile cache...
+    */
+
+    if (stream_wait(img, y))
+      return (-1);
+  }
+  else if (img->stream)
+  {
+   /*
+    * Get the row from the decoder, loading the whole image if the row is
+    * no longer available...
+    */
+
+    if (!stream_get_row(img, x, y, width, pixels))
+      return (0);
+
+    if (stream_reopen(img, CUPS_IOPEN_LOAD))
+      return (-1);
+  }
+#endif /* HAVE_PTHREAD_H */
+
   bpp = img->colorspace < 0 ? -img->colorspace : img->colorspace;
 
   while (width > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &ic);
 
     if (ib == NULL)
       return (-1);
@@ -244,6 +398,7 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
     if (count > width)
       count = width;
     memcpy(pixels, ib, count * bpp);
+    release_tile(img, ic);
     pixels += count * bpp;
     x      += count;
     width  -= count;
@@ -253,6 +408,94 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
 }
 
 
+/*
+ * 'cupsImageGetRows()' - Read a range of rows using several threads.
+ *
+ * Rows "y0" to "y1" are read in bands of up to CUPS_TILE_SIZE rows which
+ * start on tile boundaries, and each band is passed to the callback.  With
+ * more than one thread the callback runs concurrently and bands arrive in no
+ * particular order; a non-zero return value stops reading.  Only one band
+ * per thread is held in memory.
+ */
+
+int					/* O - -1 on error, 0 on success */
+cupsImageGetRows(
+    cups_image_t    *img,		/* I - Image */
+    int             y0,			/* I - First row */
+    int             y1,			/* I - Last row */
+    int             num_threads,	/* I - Number of threads to use */
+    cups_irows_cb_t cb,			/* I - Callback for each band of rows */
+    void            *context)		/* I - Callback context */
+{
+  cups_irows_t	rows;			/* Reader state */
+#ifdef HAVE_PTHREAD_H
+  pthread_t	*threads;		/* Reader threads */
+  int		i;			/* Looping var */
+#endif /* HAVE_PTHREAD_H */
+
+
+  if (img == NULL || cb == NULL)
+    return (-1);
+
+#ifdef HAVE_PTHREAD_H
+  if (img->stream && stream_release(img))
+    return (-1);
+
+  if (img->stream && !img->stream->fill && stream_reopen(img, CUPS_IOPEN_LOAD))
+    return (-1);
+#endif /* HAVE_PTHREAD_H */
+
+  if (y0 < 0)
+    y0 = 0;
+  if (y1 >= (int)img->ysize)
+    y1 = img->ysize - 1;
+
+  if (y1 < y0)
+    return (-1);
+
+  rows.img     = img;
+  rows.y       = y0;
+  rows.y1      = y1;
+  rows.cb      = cb;
+  rows.context = context;
+  rows.status  = 0;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&rows.lock, NULL);
+
+  if (num_threads > (y1 / CUPS_TILE_SIZE - y0 / CUPS_TILE_SIZE + 1))
+    num_threads = y1 / CUPS_TILE_SIZE - y0 / CUPS_TILE_SIZE + 1;
+
+  if (num_threads > 1 &&
+      (threads = calloc(num_threads, sizeof(pthread_t))) != NULL)
+  {
+    for (i = 0; i < num_threads; i ++)
+      if (pthread_create(threads + i, NULL, get_rows, &rows))
+        break;
+
+    if (i == 0)
+      get_rows(&rows);
+
+    while (i > 0)
+      pthread_join(threads[-- i], NULL);
+
+    free(threads);
+  }
+  else
+    get_rows(&rows);
+
+  pthread_mutex_destroy(&rows.lock);
+
+#else
+  (void)num_threads;
+
+  get_rows(&rows);
+#endif /* HAVE_PTHREAD_H */
+
+  return (rows.status);
+}
+
+
 /*
  * 'cupsImageGetWidth()' - Get the width of an image.
  */
@@ -299,110 +542,71 @@ cupsImageOpen(
     int             hue,		/* I - Color hue adjustment */
     const cups_ib_t *lut)		/* I - RGB gamma/brightness LUT */
 {
-  FILE		*fp;			/* File pointer */
-  unsigned char	header[16],		/* First 16 bytes of file */
-		header2[16];		/* Bytes 2048-2064 (PhotoCD) */
-  cups_image_t	*img;			/* New image buffer */
-  int		status;			/* Status of load... */
-
-
-  DEBUG_printf(("cupsImageOpen(\"%s\", %d, %d, %d, %d, %p)\n",
-        	filename ? filename : "(null)", primary, secondary,
-		saturation, hue, lut));
-
- /*
-  * Figure out the file type...
-  */
-
-  if ((fp = fopen(filename, "r")) == NULL)
-    return (NULL);
-
-  if (fread(header, 1, sizeof(header), fp) == 0)
-  {
-    fclose(fp);
-    return (NULL);
-  }
-
-  fseek(fp, 2048, SEEK_SET);
-  memset(header2, 0, sizeof(header2));
-  if (fread(header2, 1, sizeof(header2), fp) == 0 && ferror(fp))
-    DEBUG_printf(("Error reading file!"));
-  fseek(fp, 0, SEEK_SET);
+  return (open_image(filename, primary, secondary, saturation, hue, lut,
+                     CUPS_IOPEN_LOAD));
+}
 
- /*
-  * Allocate memory...
-  */
 
-  img = calloc(sizeof(cups_image_t), 1);
+/*
+ * 'cupsImageOpenStream()' - Open an image file for reading from top to bottom.
+ *
+ * JPEG, PNG, PNM and TIFF files are decoded by a separate thread while the
+ * image is read, and the function returns as soon as the image size is
+ * known.  JPEG files, which can be decoded at a reduced size, are only
+ * decoded from the first read on, or once cupsImageSetMinSize() has been
+ * called.  Other file formats are always loaded completely.
+ *
+ * In CUPS_IMAGE_STREAM_ROWS mode only a few rows are kept in memory instead
+ * of the whole image.  Rows must be requested in order by a single thread;
+ * going back more than the rows kept, or calling cupsImageGetCol() or
+ * cupsImageGetRows(), reloads the whole image as cupsImageOpen() would.
+ * Such images are not thread safe: they must not be read from several
+ * threads, not even one at a time while another thread may close or reload
+ * them.
+ *
+ * In CUPS_IMAGE_STREAM_FILL mode the decoder puts the rows into the tile
+ * cache and reading a row waits until it is there, so the image can be read
+ * in any order and by several threads while it is being decoded.
+ *
+ * Unlike with cupsImageOpen(), a damaged file is not noticed when opening
+ * it; reads of rows which could not be decoded fail instead.
+ */
 
-  if (img == NULL)
-  {
-    fclose(fp);
-    return (NULL);
-  }
+cups_image_t *				/* O - New image */
+cupsImageOpenStream(
+    const char          *filename,	/* I - Filename of image */
+    cups_icspace_t      primary,	/* I - Primary colorspace needed */
+    cups_icspace_t      secondary,	/* I - Secondary colorspace if primary no good */
+    int                 saturation,	/* I - Color saturation level */
+    int                 hue,		/* I - Color hue adjustment */
+    const cups_ib_t     *lut,		/* I - RGB gamma/brightness LUT */
+    cups_istream_mode_t mode)		/* I - CUPS_IMAGE_STREAM_ROWS or _FILL */
+{
+  return (open_image(filename, primary, secondary, saturation, hue, lut,
+                     mode == CUPS_IMAGE_STREAM_FILL ? CUPS_IOPEN_FILL :
+		                                      CUPS_IOPEN_STREAM));
+}
 
- /*
-  * Load the image as appropriate...
-  */
 
-  img->cachefile = -1;
-  img->max_ics   = CUPS_TILE_MINIMUM;
-  img->xppi      = 128;
-  img->yppi      = 128;
+/*
+ * '_cupsImageIsSequential()' - Tell whether the rows of an image must be read
+ *                              in order.
+ *
+ * This is the case for images from cupsImageOpenStream() while their rows
+ * are decoded on demand; such images must only be read by one thread.
+ */
 
-  if (!memcmp(header, "GIF87a", 6) || !memcmp(header, "GIF89a", 6))
-    status = _cupsImageReadGIF(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (!memcmp(header, "BM", 2))
-    status = _cupsImageReadBMP(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (header[0] == 0x01 && header[1] == 0xda)
-    status = _cupsImageReadSGI(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (header[0] == 0x59 && header[1] == 0xa6 &&
-           header[2] == 0x6a && header[3] == 0x95)
-    status = _cupsImageReadSunRaster(img, fp, primary, secondary, saturation,
-                                     hue, lut);
-  else if (header[0] == 'P' && header[1] >= '1' && header[1] <= '6')
-    status = _cupsImageReadPNM(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (!memcmp(header2, "PCD_IPI", 7))
-    status = _cupsImageReadPhotoCD(img, fp, primary, secondary, saturation,
-                                   hue, lut);
-  else if (!memcmp(header + 8, "\000\010", 2) ||
-           !memcmp(header + 8, "\000\030", 2))
-    status = _cupsImageReadPIX(img, fp, primary, secondary, saturation, hue,
-                               lut);
-#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
-  else if (!memcmp(header, "\211PNG", 4))
-    status = _cupsImageReadPNG(img, fp, primary, secondary, saturation, hue,
-                               lut);
-#endif /* HAVE_LIBPNG && HAVE_LIBZ */
-#ifdef HAVE_LIBJPEG
-  else if (!memcmp(header, "\377\330\377", 3) &&	/* Start-of-Image */
-	   header[3] >= 0xe0 && header[3] <= 0xef)	/* APPn */
-    status = _cupsImageReadJPEG(img, fp, primary, secondary, saturation, hue,
-                                lut);
-#endif /* HAVE_LIBJPEG */
-#ifdef HAVE_LIBTIFF
-  else if (!memcmp(header, "MM\000\052", 4) ||
-           !memcmp(header, "II\052\000", 4))
-    status = _cupsImageReadTIFF(img, fp, primary, secondary, saturation, hue,
-                                lut);
-#endif /* HAVE_LIBTIFF */
-  else
-  {
-    fclose(fp);
-    status = -1;
-  }
+int					/* O - 1 if sequential, 0 otherwise */
+_cupsImageIsSequential(
+    cups_image_t *img)			/* I - Image */
+{
+#ifdef HAVE_PTHREAD_H
+  return (img->stream != NULL && !img->stream->fill);
+#else
+  (void)img;
 
-  if (status)
-  {
-    free(img);
-    return (NULL);
-  }
-  else
-    return (img);
+  return (0);
+#endif /* HAVE_PTHREAD_H */
 }
 
 
@@ -424,6 +628,7 @@ _cupsImagePutCol(
   int		tilex,			/* Column within tile */
 		tiley;			/* Row within tile */
   cups_ib_t	*ib;			/* Pointer to pixels in tile */
+  cups_ic_t	*ic;			/* Locked tile */
 
 
   if (img == NULL || x < 0 || x >= img->xsize || y >= img->ysize)
@@ -441,6 +646,11 @@ _cupsImagePutCol(
   if (height < 1)
     return (-1);
 
+#ifdef HAVE_PTHREAD_H
+  if (img->stream && stream_put_col(img) < 0)
+    return (-1);
+#endif /* HAVE_PTHREAD_H */
+
   bpp    = cupsImageGetDepth(img);
   twidth = bpp * (CUPS_TILE_SIZE - 1);
   tilex  = x / CUPS_TILE_SIZE;
@@ -448,7 +658,7 @@ _cupsImagePutCol(
 
   while (height > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &ic);
 
     if (ib == NULL)
       return (-1);
@@ -475,6 +685,8 @@ _cupsImagePutCol(
             *ib++ = *pixels++;
             break;
       }
+
+    release_tile(img, ic);
   }
 
   return (0);
@@ -498,6 +710,10 @@ _cupsImagePutRow(
   int		tilex,			/* Column within tile */
 		tiley;			/* Row within tile */
   cups_ib_t	*ib;			/* Pointer to pixels in tile */
+  cups_ic_t	*ic;			/* Locked tile */
+#ifdef HAVE_PTHREAD_H
+  int		status;			/* Status of streaming put */
+#endif /* HAVE_PTHREAD_H */
 
 
   if (img == NULL || y < 0 || y >= img->ysize || x >= img->xsize)
@@ -515,13 +731,19 @@ _cupsImagePutRow(
   if (width < 1)
     return (-1);
 
+#ifdef HAVE_PTHREAD_H
+  if (img->stream &&
+      (status = stream_put_row(img, x, y, width, pixels)) <= 0)
+    return (status);
+#endif /* HAVE_PTHREAD_H */
+
   bpp   = img->colorspace < 0 ? -img->colorspace : img->colorspace;
   tilex = x / CUPS_TILE_SIZE;
   tiley = y / CUPS_TILE_SIZE;
 
   while (width > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &ic);
 
     if (ib == NULL)
       return (-1);
@@ -532,6 +754,7 @@ _cupsImagePutRow(
     if (count > width)
       count = width;
     memcpy(ib, pixels, count * bpp);
+    release_tile(img, ic);
     pixels += count * bpp;
     x      += count;
     width  -= count;
@@ -542,6 +765,23 @@ _cupsImagePutRow(
 }
 
 
+/*
+ * 'cupsImageSetCacheMode()' - Set the tile cache mode for new images.
+ *
+ * The mode applies to images opened after the call.  With
+ * CUPS_IMAGE_CACHE_AUTO the RIP_CACHE_MODE environment variable ("file" or
+ * "mmap") is used if set, otherwise the swap file is memory-mapped only when
+ * the image does not fit into the tile cache.
+ */
+
+void
+cupsImageSetCacheMode(
+    cups_icache_t mode)			/* I - Tile cache mode */
+{
+  cache_mode = mode;
+}
+
+
 /*
  * 'cupsImageSetMaxTiles()' - Set the maximum number of tiles to cache.
  *
@@ -611,84 +851,493 @@ cupsImageSetMaxTiles(
 
 
 /*
- * 'flush_tile()' - Flush the least-recently-used tile in the cache.
+ * 'cupsImageSetMinSize()' - Set the smallest size an image is needed at.
+ *
+ * Images whose file format can be decoded at a reduced size (JPEG, at 1/2,
+ * 1/4 or 1/8 size) are decoded at the smallest size that is at least
+ * "min_width" by "min_height" pixels.  This works for images from
+ * cupsImageOpenStream(), which only start decoding the pixels after this
+ * call when it comes right after opening, before reading any rows; later
+ * calls decode the image again.  The image resolution is reduced along with
+ * the size, so the image keeps its size in inches.
  */
 
-static void
-flush_tile(cups_image_t *img)		/* I - Image */
+int					/* O - 1 if reduced, 0 if not, -1 on error */
+cupsImageSetMinSize(
+    cups_image_t *img,			/* I - Image */
+    unsigned     min_width,		/* I - Minimum width in pixels */
+    unsigned     min_height)		/* I - Minimum height in pixels */
 {
-  int		bpp;			/* Bytes per pixel */
-  cups_itile_t	*tile;			/* Pointer to tile */
+#ifdef HAVE_PTHREAD_H
+  unsigned	xsize;			/* Width before reducing */
+#endif /* HAVE_PTHREAD_H */
 
 
-  bpp  = cupsImageGetDepth(img);
-  tile = img->first->tile;
+  if (img == NULL)
+    return (-1);
 
-  if (!tile->dirty)
-  {
-    tile->ic = NULL;
-    return;
-  }
+  if (min_width < 1)
+    min_width = 1;
+  if (min_height < 1)
+    min_height = 1;
 
-  if (img->cachefile < 0)
-  {
-    if ((img->cachefile = cupsTempFd(img->cachename,
-                                     sizeof(img->cachename))) < 0)
-    {
-      tile->ic    = NULL;
-      tile->dirty = 0;
-      return;
-    }
+#ifdef HAVE_PTHREAD_H
+  if (img->stream == NULL || !(img->stream->flags & CUPS_IREAD_SCALE) ||
+      min_width > img->xsize / 2 || min_height > img->ysize / 2)
+    return (0);
 
-    DEBUG_printf(("Created swap file \"%s\"...\n", img->cachename));
-  }
+  DEBUG_printf(("Reducing %ux%u image to at least %ux%u...\n", img->xsize,
+                img->ysize, min_width, min_height));
 
-  if (tile->pos >= 0)
-  {
-    if (lseek(img->cachefile, tile->pos, SEEK_SET) != tile->pos)
-    {
-      tile->ic    = NULL;
-      tile->dirty = 0;
-      return;
-    }
+  img->min_xsize = min_width;
+  img->min_ysize = min_height;
+  xsize          = img->xsize;
+
+ /*
+  * A held decoder has not decoded anything yet, otherwise start over...
+  */
+
+  if (!img->stream->hold &&
+      stream_reopen(img, img->stream->fill ? CUPS_IOPEN_FILL :
+                                             CUPS_IOPEN_STREAM))
+    return (-1);
+
+  if (img->stream && stream_release(img))
+    return (-1);
+
+  return (img->xsize < xsize ? 1 : 0);
+
+#else
+  return (0);
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * '_cupsImageSetStreamBack()' - Set the number of rows a streaming image keeps
+ *                               behind the last row read.
+ *
+ * Readers that go back to earlier rows, like the zoom code, call this before
+ * reading so that those rows are still in memory.
+ */
+
+void
+_cupsImageSetStreamBack(
+    cups_image_t *img,			/* I - Image */
+    int          back)			/* I - Number of rows to keep */
+{
+#ifdef HAVE_PTHREAD_H
+  cups_istream_t	*s;		/* Streaming state */
+  cups_ib_t		*rows;		/* New row ring */
+  int			num_rows,	/* Rows in new ring */
+			y;		/* Looping var */
+
+
+  if (img == NULL || (s = img->stream) == NULL || s->fill)
+    return;
+
+  pthread_mutex_lock(&s->lock);
+
+  if (back > s->back && !s->rows)
+    s->back = back;
+  else if (back > s->back)
+  {
+   /*
+    * Move the rows to a larger ring; the ring must hold more than "back"
+    * rows, so keep the old one if we are out of memory...
+    */
+
+    num_rows = back + CUPS_STREAM_AHEAD;
+
+    if ((rows = malloc((size_t)s->bpr * num_rows)) != NULL)
+    {
+      for (y = s->first; y < (s->first + s->count); y ++)
+	memcpy(rows + (y % num_rows) * s->bpr,
+	       s->rows + (y % s->num_rows) * s->bpr, s->bpr);
+
+      free(s->rows);
+      s->rows     = rows;
+      s->num_rows = num_rows;
+      s->back     = back;
+
+      pthread_cond_broadcast(&s->cond);
+    }
   }
-  else
+
+  pthread_mutex_unlock(&s->lock);
+
+#else
+  (void)img;
+  (void)back;
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * '_cupsImageWaitMinSize()' - Wait until the minimum size of a streaming
+ *                             image is known.
+ *
+ * Readers which can decode at a reduced size call this once the image size
+ * is set, before decoding any pixels, and then use "min_xsize" and
+ * "min_ysize".  A streaming image holds the decoder here until the image is
+ * read or cupsImageSetMinSize() is called.
+ */
+
+int					/* O - -1 to stop, 0 to go on */
+_cupsImageWaitMinSize(
+    cups_image_t *img)			/* I - Image */
+{
+#ifdef HAVE_PTHREAD_H
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  int			status;		/* Return status */
+
+
+  if (s == NULL)
+    return (0);
+
+  pthread_mutex_lock(&s->lock);
+
+  s->sized = 1;
+  pthread_cond_broadcast(&s->cond);
+
+  while (s->hold && s->state != CUPS_ISTREAM_STOP)
+    pthread_cond_wait(&s->cond, &s->lock);
+
+  status = s->state == CUPS_ISTREAM_STOP ? -1 : 0;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return (status);
+
+#else
+  (void)img;
+
+  return (0);
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * 'flush_tile()' - Flush the least-recently-used tile in the cache.
+ *
+ * Tiles that are locked by a reader are skipped.  The cache lock must be
+ * held by the caller.
+ */
+
+static cups_ic_t *			/* O - Flushed cache entry or NULL */
+flush_tile(cups_image_t *img)		/* I - Image */
+{
+  int		bpp;			/* Bytes per pixel */
+  cups_ic_t	*ic;			/* Cache entry to flush */
+  cups_itile_t	*tile;			/* Pointer to tile */
+
+
+  for (ic = img->first; ic != NULL; ic = ic->next)
+    if (ic->refs == 0)
+      break;
+
+  if (ic == NULL)
+    return (NULL);
+
+  bpp  = cupsImageGetDepth(img);
+  tile = ic->tile;
+
+  if (!tile->dirty)
+  {
+    tile->ic = NULL;
+    return (ic);
+  }
+
+  if (img->cachefile < 0)
   {
-    if ((tile->pos = lseek(img->cachefile, 0, SEEK_END)) < 0)
+    if ((img->cachefile = cupsTempFd(img->cachename,
+                                     sizeof(img->cachename))) < 0)
     {
       tile->ic    = NULL;
       tile->dirty = 0;
-      return;
+      return (ic);
     }
+
+    DEBUG_printf(("Created swap file \"%s\"...\n", img->cachename));
+  }
+
+  if (tile->pos < 0)
+  {
+    tile->pos      = img->cachesize;
+    img->cachesize += bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE;
   }
 
-  if (write(img->cachefile, tile->ic->pixels,
-	    bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE) == -1)
+  if (pwrite(img->cachefile, ic->pixels,
+	     bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE, tile->pos) == -1)
     DEBUG_printf(("Error writing cache tile!"));
 
   tile->ic    = NULL;
   tile->dirty = 0;
+
+  return (ic);
+}
+
+
+/*
+ * 'free_tiles()' - Free the tiles and the tile cache of an image.
+ *
+ * The swap file (if any) is removed as well; new tiles are created for the
+ * current image size by the next get_tile().
+ */
+
+static void
+free_tiles(cups_image_t *img)		/* I - Image */
+{
+  cups_ic_t	*current,		/* Current cached tile */
+		*next;			/* Next cached tile */
+
+
+ /*
+  * Wipe the tile cache file (if any)...
+  */
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  if (img->cachemap != NULL)
+  {
+    DEBUG_printf(("Unmapping swap file (%p)...\n", img->cachemap));
+
+    munmap(img->cachemap, img->cachemapsize);
+  }
+#endif /* HAVE_SYS_MMAN_H && HAVE_MMAP */
+
+  free(img->mapped);
+
+  if (img->cachefile >= 0)
+  {
+    DEBUG_printf(("Closing/removing swap file \"%s\"...\n", img->cachename));
+
+    close(img->cachefile);
+    unlink(img->cachename);
+  }
+
+ /*
+  * Free the image cache...
+  */
+
+  DEBUG_puts("Freeing memory...");
+
+  for (current = img->first, next = NULL; current != NULL; current = next)
+  {
+    DEBUG_printf(("Freeing cache (%p, next = %p)...\n", current, next));
+
+    next = current->next;
+    free(current);
+  }
+
+ /*
+  * Free the tiles...
+  */
+
+  if (img->tiles != NULL)
+  {
+    DEBUG_printf(("Freeing tiles (%p)...\n", img->tiles[0]));
+
+    free(img->tiles[0]);
+
+    DEBUG_printf(("Freeing tile pointers (%p)...\n", img->tiles));
+
+    free(img->tiles);
+  }
+
+  img->tiles        = NULL;
+  img->first        = NULL;
+  img->last         = NULL;
+  img->num_ics      = 0;
+  img->cachefile    = -1;
+  img->cachesize    = 0;
+  img->cachemap     = NULL;
+  img->cachemapsize = 0;
+  img->mapped       = NULL;
+  img->num_mapped   = 0;
+  img->first_mapped = 0;
+}
+
+
+/*
+ * 'get_reader()' - Get the reader for an image file.
+ */
+
+static cups_iread_t			/* O - Reader or NULL if unknown */
+get_reader(const unsigned char *header,	/* I - First 16 bytes of file */
+           const unsigned char *header2,/* I - Bytes 2048-2064 (PhotoCD) */
+	   int                 *flags)	/* O - CUPS_IREAD_ flags */
+{
+  *flags = 0;
+
+  if (!memcmp(header, "GIF87a", 6) || !memcmp(header, "GIF89a", 6))
+    return (_cupsImageReadGIF);
+  else if (!memcmp(header, "BM", 2))
+    return (_cupsImageReadBMP);
+  else if (header[0] == 0x01 && header[1] == 0xda)
+    return (_cupsImageReadSGI);
+  else if (header[0] == 0x59 && header[1] == 0xa6 &&
+           header[2] == 0x6a && header[3] == 0x95)
+    return (_cupsImageReadSunRaster);
+  else if (header[0] == 'P' && header[1] >= '1' && header[1] <= '6')
+  {
+    *flags = CUPS_IREAD_STREAM;
+    return (_cupsImageReadPNM);
+  }
+  else if (!memcmp(header2, "PCD_IPI", 7))
+    return (_cupsImageReadPhotoCD);
+  else if (!memcmp(header + 8, "\000\010", 2) ||
+           !memcmp(header + 8, "\000\030", 2))
+    return (_cupsImageReadPIX);
+#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
+  else if (!memcmp(header, "\211PNG", 4))
+  {
+    *flags = CUPS_IREAD_STREAM;
+    return (_cupsImageReadPNG);
+  }
+#endif /* HAVE_LIBPNG && HAVE_LIBZ */
+#ifdef HAVE_LIBJPEG
+  else if (!memcmp(header, "\377\330\377", 3) &&	/* Start-of-Image */
+	   header[3] >= 0xe0 && header[3] <= 0xef)	/* APPn */
+  {
+    *flags = CUPS_IREAD_STREAM | CUPS_IREAD_SCALE;
+    return (_cupsImageReadJPEG);
+  }
+#endif /* HAVE_LIBJPEG */
+#ifdef HAVE_LIBTIFF
+  else if (!memcmp(header, "MM\000\052", 4) ||
+           !memcmp(header, "II\052\000", 4))
+  {
+    *flags = CUPS_IREAD_STREAM;
+    return (_cupsImageReadTIFF);
+  }
+#endif /* HAVE_LIBTIFF */
+  else
+    return (NULL);
+}
+
+
+/*
+ * 'get_rows()' - Read bands of rows for cupsImageGetRows().
+ */
+
+static void *				/* O - Thread exit status (unused) */
+get_rows(void *data)			/* I - Reader state */
+{
+  cups_irows_t	*rows = (cups_irows_t *)data;
+					/* Reader state */
+  cups_image_t	*img = rows->img;	/* Image */
+  int		bpp,			/* Bytes per pixel */
+		y,			/* First row in band */
+		height,			/* Rows in band */
+		row;			/* Current row */
+  cups_ib_t	*pixels;		/* Pixels for band */
+
+
+  bpp = cupsImageGetDepth(img);
+
+  if ((pixels = malloc((size_t)img->xsize * bpp * CUPS_TILE_SIZE)) == NULL)
+  {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&rows->lock);
+#endif /* HAVE_PTHREAD_H */
+
+    rows->status = -1;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&rows->lock);
+#endif /* HAVE_PTHREAD_H */
+
+    return (NULL);
+  }
+
+  for (;;)
+  {
+   /*
+    * Grab the next band...
+    */
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&rows->lock);
+#endif /* HAVE_PTHREAD_H */
+
+    y = rows->y;
+
+    if (y <= rows->y1 && !rows->status)
+    {
+      height = CUPS_TILE_SIZE - (y & (CUPS_TILE_SIZE - 1));
+      if (y + height > rows->y1 + 1)
+        height = rows->y1 + 1 - y;
+
+      rows->y += height;
+    }
+    else
+      height = 0;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&rows->lock);
+#endif /* HAVE_PTHREAD_H */
+
+    if (height == 0)
+      break;
+
+   /*
+    * Read and hand it off...
+    */
+
+    for (row = 0; row < height; row ++)
+      if (cupsImageGetRow(img, 0, y + row, img->xsize,
+                          pixels + (size_t)row * img->xsize * bpp))
+        break;
+
+    if (row < height || (rows->cb)(rows->context, y, height, pixels))
+    {
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_lock(&rows->lock);
+#endif /* HAVE_PTHREAD_H */
+
+      rows->status = -1;
+
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_unlock(&rows->lock);
+#endif /* HAVE_PTHREAD_H */
+    }
+  }
+
+  free(pixels);
+
+  return (NULL);
 }
 
 
 /*
- * 'get_tile()' - Get a cached tile.
+ * 'get_tile()' - Get and lock a cached tile.
+ *
+ * The tile stays in the cache until release_tile() is called with the
+ * returned cache entry.
  */
 
 static cups_ib_t *			/* O - Pointer to tile or NULL */
 get_tile(cups_image_t *img,		/* I - Image */
          int          x,		/* I - Column in image */
-         int          y)		/* I - Row in image */
+         int          y,		/* I - Row in image */
+	 cups_ic_t    **ic)		/* O - Cache entry to release */
 {
   int		bpp,			/* Bytes per pixel */
 		tilex,			/* Column within tile */
 		tiley,			/* Row within tile */
 		xtiles,			/* Number of tiles horizontally */
 		ytiles;			/* Number of tiles vertically */
-  cups_ic_t	*ic;			/* Cache pointer */
   cups_itile_t	*tile;			/* Tile pointer */
+  cups_ib_t	*ib;			/* Pointer to pixels */
 
 
+  *ic = NULL;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+
   if (img->tiles == NULL)
   {
     xtiles = (img->xsize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE;
@@ -697,10 +1346,14 @@ get_tile(cups_image_t *img,		/* I - Image */
     DEBUG_printf(("Creating tile array (%dx%d)\n", xtiles, ytiles));
 
     if ((img->tiles = calloc(sizeof(cups_itile_t *), ytiles)) == NULL)
-      return (NULL);
+      goto error;
 
     if ((tile = calloc(xtiles * sizeof(cups_itile_t), ytiles)) == NULL)
-      return (NULL);
+    {
+      free(img->tiles);
+      img->tiles = NULL;
+      goto error;
+    }
 
     for (tiley = 0; tiley < ytiles; tiley ++)
     {
@@ -708,6 +1361,27 @@ get_tile(cups_image_t *img,		/* I - Image */
       for (tilex = xtiles; tilex > 0; tilex --, tile ++)
         tile->pos = -1;
     }
+
+   /*
+    * Map a swap file for all tiles if asked to, or automatically when the
+    * image does not fit into the tile cache anyways...
+    */
+
+    if (img->cachemode == CUPS_IMAGE_CACHE_MMAP ||
+        (img->cachemode == CUPS_IMAGE_CACHE_AUTO &&
+	 xtiles * ytiles > img->max_ics))
+    {
+      if (map_cache(img, xtiles * ytiles))
+        DEBUG_puts("Unable to map swap file, using pread/pwrite...");
+      else
+      {
+        bpp  = cupsImageGetDepth(img);
+	tile = img->tiles[0];
+
+        for (tilex = 0; tilex < xtiles * ytiles; tilex ++, tile ++)
+	  tile->pos = (off_t)tilex * bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE;
+      }
+    }
   }
 
   bpp   = cupsImageGetDepth(img);
@@ -717,93 +1391,885 @@ get_tile(cups_image_t *img,		/* I - Image */
   x     &= (CUPS_TILE_SIZE - 1);
   y     &= (CUPS_TILE_SIZE - 1);
 
-  if ((ic = tile->ic) == NULL)
+  if (img->cachemap != NULL)
+  {
+   /*
+    * Mapped tiles are addressed directly, the kernel does the caching and
+    * evicted pages are simply faulted in again...
+    */
+
+    if (!tile->resident)
+      map_tile(img, tile);
+
+    ib = img->cachemap + tile->pos + bpp * (y * CUPS_TILE_SIZE + x);
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+
+    return (ib);
+  }
+
+  if ((*ic = tile->ic) == NULL)
   {
-    if (img->num_ics < img->max_ics)
+    if (img->num_ics < img->max_ics ||
+        (*ic = flush_tile(img)) == NULL)
     {
-      if ((ic = calloc(sizeof(cups_ic_t) +
-                       bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE, 1)) == NULL)
-      {
-        if (img->num_ics == 0)
-	  return (NULL);
+     /*
+      * Allocate a new cache entry, either because the cache is not full yet
+      * or because all cached tiles are locked by other readers...
+      */
 
-        flush_tile(img);
-	ic = img->first;
+      if ((*ic = calloc(sizeof(cups_ic_t) +
+                        bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE, 1)) == NULL)
+      {
+        if ((*ic = flush_tile(img)) == NULL)
+	  goto error;
       }
       else
       {
-	ic->pixels = ((cups_ib_t *)ic) + sizeof(cups_ic_t);
+	(*ic)->pixels = ((cups_ib_t *)*ic) + sizeof(cups_ic_t);
 
 	img->num_ics ++;
 
-	DEBUG_printf(("Allocated cache tile %d (%p)...\n", img->num_ics, ic));
+	DEBUG_printf(("Allocated cache tile %d (%p)...\n", img->num_ics, *ic));
       }
     }
-    else
-    {
-      DEBUG_printf(("Flushing old cache tile (%p)...\n", img->first));
 
-      flush_tile(img);
-      ic = img->first;
-    }
-
-    ic->tile = tile;
-    tile->ic = ic;
+    (*ic)->tile = tile;
+    tile->ic    = *ic;
 
     if (tile->pos >= 0)
     {
       DEBUG_printf(("Loading cache tile from file position " CUPS_LLFMT "...\n",
                     CUPS_LLCAST tile->pos));
 
-      lseek(img->cachefile, tile->pos, SEEK_SET);
-      if (read(img->cachefile, ic->pixels,
-	       bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE) == -1)
+      if (pread(img->cachefile, (*ic)->pixels,
+	        bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE, tile->pos) == -1)
 	DEBUG_printf(("Error reading cache tile!"));
     }
     else
     {
       DEBUG_puts("Clearing cache tile...");
 
-      memset(ic->pixels, 0, bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE);
+      memset((*ic)->pixels, 0, bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE);
     }
   }
 
-  if (ic == img->first)
+ /*
+  * Move the cache entry to the end of the list...
+  */
+
+  if (*ic != img->last)
   {
-    if (ic->next != NULL)
-      ic->next->prev = NULL;
+    if ((*ic)->prev != NULL)
+      (*ic)->prev->next = (*ic)->next;
+    else if (img->first == *ic)
+      img->first = (*ic)->next;
+
+    if ((*ic)->next != NULL)
+      (*ic)->next->prev = (*ic)->prev;
+
+    if (img->last != NULL)
+      img->last->next = *ic;
+    else
+      img->first = *ic;
 
-    img->first = ic->next;
-    ic->next   = NULL;
-    ic->prev   = NULL;
+    (*ic)->prev = img->last;
+    (*ic)->next = NULL;
+    img->last   = *ic;
   }
-  else if (img->first == NULL)
-    img->first = ic;
 
-  if (ic != img->last)
+  (*ic)->refs ++;
+
+  ib = (*ic)->pixels + bpp * (y * CUPS_TILE_SIZE + x);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+
+  return (ib);
+
+ /*
+  * If we get here, something went wrong...
+  */
+
+  error:
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+
+  *ic = NULL;
+
+  return (NULL);
+}
+
+
+/*
+ * 'map_cache()' - Map a sparse swap file for all tiles.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+map_cache(cups_image_t *img,		/* I - Image */
+          int          ntiles)		/* I - Number of tiles in image */
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  off_t		size;			/* Size of swap file */
+  void		*map;			/* Mapped swap file */
+
+
+  size = (off_t)ntiles * cupsImageGetDepth(img) *
+         CUPS_TILE_SIZE * CUPS_TILE_SIZE;
+
+  if ((off_t)(size_t)size != size)
+    return (-1);
+
+  if (img->cachefile < 0)
   {
-   /*
-    * Remove the cache entry from the list...
-    */
+    if ((img->cachefile = cupsTempFd(img->cachename,
+                                     sizeof(img->cachename))) < 0)
+      return (-1);
 
-    if (ic->prev != NULL)
-      ic->prev->next = ic->next;
-    if (ic->next != NULL)
-      ic->next->prev = ic->prev;
+    DEBUG_printf(("Created swap file \"%s\"...\n", img->cachename));
+  }
 
-   /*
-    * And add it to the end...
-    */
+ /*
+  * Extend the file without writing anything so that untouched tiles stay
+  * sparse and read back as zeros...
+  */
 
-    if (img->last != NULL)
-      img->last->next = ic;
+  if (ftruncate(img->cachefile, size))
+    return (-1);
 
-    ic->prev  = img->last;
-    img->last = ic;
+  if ((img->mapped = calloc(ntiles, sizeof(cups_itile_t *))) == NULL)
+    return (-1);
+
+  if ((map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  img->cachefile, 0)) == MAP_FAILED)
+  {
+    free(img->mapped);
+    img->mapped = NULL;
+    return (-1);
   }
 
-  ic->next = NULL;
+  img->cachemap     = map;
+  img->cachemapsize = (size_t)size;
+  img->cachesize    = size;
+
+  DEBUG_printf(("Mapped " CUPS_LLFMT " bytes of swap file at %p...\n",
+                CUPS_LLCAST size, map));
+
+  return (0);
+
+#else
+  (void)img;
+  (void)ntiles;
+
+  return (-1);
+#endif /* HAVE_SYS_MMAN_H && HAVE_MMAP */
+}
+
+
+/*
+ * 'map_tile()' - Mark a mapped tile resident, evicting old ones.
+ *
+ * Resident tiles are kept in a FIFO limited to the "max_ics" tile count; the
+ * oldest tile's pages are released with madvise() so the kernel can write
+ * them back to the swap file instead of growing the process.
+ */
+
+static void
+map_tile(cups_image_t *img,		/* I - Image */
+         cups_itile_t *tile)		/* I - Tile to make resident */
+{
+  unsigned	ntiles;			/* Number of tiles in image */
+  size_t	tilebytes;		/* Bytes per tile */
+  cups_itile_t	*oldest;		/* Tile to evict */
+
+
+  tilebytes = cupsImageGetDepth(img) * CUPS_TILE_SIZE * CUPS_TILE_SIZE;
+  ntiles    = img->cachemapsize / tilebytes;
+
+  while (img->num_mapped > 0 && img->num_mapped >= img->max_ics)
+  {
+    oldest = img->mapped[img->first_mapped];
+
+    DEBUG_printf(("Releasing mapped tile (%p)...\n", oldest));
+
+#ifdef HAVE_MADVISE
+    madvise(img->cachemap + oldest->pos, tilebytes, MADV_DONTNEED);
+#endif /* HAVE_MADVISE */
 
-  return (ic->pixels + bpp * (y * CUPS_TILE_SIZE + x));
+    oldest->resident  = 0;
+    img->first_mapped = (img->first_mapped + 1) % ntiles;
+    img->num_mapped --;
+  }
+
+  img->mapped[(img->first_mapped + img->num_mapped) % ntiles] = tile;
+  img->num_mapped ++;
+  tile->resident = 1;
 }
 
+
+/*
+ * 'open_image()' - Open an image file for cupsImageOpen() and
+ *                  cupsImageOpenStream().
+ */
+
+static cups_image_t *			/* O - New image */
+open_image(
+    const char      *filename,		/* I - Filename of image */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    int             mode)		/* I - CUPS_IOPEN_ mode */
+{
+  FILE		*fp;			/* File pointer */
+  unsigned char	header[16],		/* First 16 bytes of file */
+		header2[16];		/* Bytes 2048-2064 (PhotoCD) */
+  cups_image_t	*img;			/* New image buffer */
+  cups_iread_t	reader;			/* Reader for file */
+  int		flags;			/* Reader flags */
+  int		status;			/* Status of load... */
+  const char	*mode_env;		/* RIP_CACHE_MODE environment variable */
+
+
+  DEBUG_printf(("open_image(\"%s\", %d, %d, %d, %d, %p, %d)\n",
+        	filename ? filename : "(null)", primary, secondary,
+		saturation, hue, lut, mode));
+
+ /*
+  * Figure out the file type...
+  */
+
+  if ((fp = fopen(filename, "r")) == NULL)
+    return (NULL);
+
+  if (fread(header, 1, sizeof(header), fp) == 0)
+  {
+    fclose(fp);
+    return (NULL);
+  }
+
+  fseek(fp, 2048, SEEK_SET);
+  memset(header2, 0, sizeof(header2));
+  if (fread(header2, 1, sizeof(header2), fp) == 0 && ferror(fp))
+    DEBUG_printf(("Error reading file!"));
+  fseek(fp, 0, SEEK_SET);
+
+  if ((reader = get_reader(header, header2, &flags)) == NULL)
+  {
+    fclose(fp);
+    return (NULL);
+  }
+
+ /*
+  * Allocate memory...
+  */
+
+  img = calloc(sizeof(cups_image_t), 1);
+
+  if (img == NULL)
+  {
+    fclose(fp);
+    return (NULL);
+  }
+
+ /*
+  * Load the image as appropriate...
+  */
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&img->cachelock, NULL);
+#endif /* HAVE_PTHREAD_H */
+
+  img->cachefile = -1;
+  img->cachemode = cache_mode;
+  img->max_ics   = CUPS_TILE_MINIMUM;
+  img->xppi      = 128;
+  img->yppi      = 128;
+
+  if (img->cachemode == CUPS_IMAGE_CACHE_AUTO &&
+      (mode_env = getenv("RIP_CACHE_MODE")) != NULL)
+  {
+    if (!strcasecmp(mode_env, "file"))
+      img->cachemode = CUPS_IMAGE_CACHE_FILE;
+    else if (!strcasecmp(mode_env, "mmap"))
+      img->cachemode = CUPS_IMAGE_CACHE_MMAP;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  if (mode != CUPS_IOPEN_LOAD && (flags & CUPS_IREAD_STREAM))
+    status = stream_open(img, fp, reader, flags, mode, primary, secondary,
+                         saturation, hue, lut);
+  else
+#else
+  (void)mode;
+  (void)flags;
+#endif /* HAVE_PTHREAD_H */
+  status = (*reader)(img, fp, primary, secondary, saturation, hue, lut);
+
+  if (status)
+  {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+
+    free(img);
+    return (NULL);
+  }
+  else
+    return (img);
+}
+
+
+/*
+ * 'release_tile()' - Release a tile locked by get_tile().
+ */
+
+static void
+release_tile(cups_image_t *img,		/* I - Image */
+             cups_ic_t    *ic)		/* I - Cache entry or NULL */
+{
+  if (ic == NULL)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+
+  ic->refs --;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&img->cachelock);
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * 'stream_close()' - Stop the decoder thread and free the streaming state.
+ *
+ * The duplicated file descriptor is returned rather than closed when "fd" is
+ * not NULL.
+ */
+
+static void
+stream_close(cups_image_t *img,		/* I - Image */
+             int          *fd)		/* O - File descriptor or NULL */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+
+
+  pthread_mutex_lock(&s->lock);
+  s->state = CUPS_ISTREAM_STOP;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+
+  pthread_join(s->thread, NULL);
+
+  if (fd)
+    *fd = s->fd;
+  else if (s->fd >= 0)
+    close(s->fd);
+
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->lock);
+
+  free(s->rows);
+  free(s);
+
+  img->stream = NULL;
+}
+
+
+/*
+ * 'stream_get_row()' - Get a row of pixels from the row ring.
+ *
+ * Rows that are more than "back" rows behind the requested row are dropped
+ * so that the decoder can continue.
+ */
+
+static int				/* O - -1 if not available, 0 on success */
+stream_get_row(cups_image_t *img,	/* I - Image */
+               int          x,		/* I - Start column */
+               int          y,		/* I - Row */
+               int          width,	/* I - Width of row */
+               cups_ib_t    *pixels)	/* O - Pixel data */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  int			bpp,		/* Bytes per pixel */
+			dropped,	/* Number of rows dropped */
+			status;		/* Return status */
+
+
+  bpp = img->colorspace < 0 ? -img->colorspace : img->colorspace;
+
+  pthread_mutex_lock(&s->lock);
+
+  while (s->state == CUPS_ISTREAM_ROWS && y >= s->first)
+  {
+    for (dropped = 0; s->count > 0 && s->first < (y - s->back); dropped ++)
+    {
+      s->first ++;
+      s->count --;
+    }
+
+    if (dropped)
+      pthread_cond_broadcast(&s->cond);
+
+    if (y < (s->first + s->count) || s->done)
+      break;
+
+    pthread_cond_wait(&s->cond, &s->lock);
+  }
+
+  if (s->state == CUPS_ISTREAM_ROWS && y >= s->first &&
+      y < (s->first + s->count))
+  {
+    memcpy(pixels, s->rows + (y % s->num_rows) * s->bpr + x * bpp,
+           width * bpp);
+    status = 0;
+  }
+  else
+    status = -1;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return (status);
+}
+
+
+/*
+ * 'stream_open()' - Start decoding an image file in a separate thread.
+ *
+ * Returns once the image size is known, either with the decoder putting rows
+ * into the row ring or with the whole image loaded when the reader does not
+ * write the rows in order.  In CUPS_IOPEN_FILL mode the decoder always puts
+ * the rows into the tile cache and keeps running after the function returns.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+stream_open(cups_image_t    *img,	/* I - Image */
+            FILE            *fp,	/* I - File to decode */
+	    cups_iread_t    reader,	/* I - Reader for file */
+	    int             flags,	/* I - CUPS_IREAD_ flags for reader */
+	    int             mode,	/* I - CUPS_IOPEN_STREAM or _FILL */
+	    cups_icspace_t  primary,	/* I - Primary colorspace needed */
+	    cups_icspace_t  secondary,	/* I - Secondary colorspace */
+	    int             saturation,	/* I - Color saturation level */
+	    int             hue,	/* I - Color hue adjustment */
+	    const cups_ib_t *lut)	/* I - RGB gamma/brightness LUT */
+{
+  cups_istream_t	*s;		/* Streaming state */
+  cups_isstate_t	state;		/* State after the first row */
+  int			done,		/* Non-zero if the reader returned */
+			status;		/* Status of reader */
+
+
+  if ((s = calloc(1, sizeof(cups_istream_t))) == NULL ||
+      (s->fd = dup(fileno(fp))) < 0)
+  {
+    free(s);
+    return ((*reader)(img, fp, primary, secondary, saturation, hue, lut));
+  }
+
+  s->state      = CUPS_ISTREAM_START;
+  s->fp         = fp;
+  s->reader     = reader;
+  s->flags      = flags;
+  s->primary    = primary;
+  s->secondary  = secondary;
+  s->saturation = saturation;
+  s->hue        = hue;
+  s->back       = CUPS_STREAM_BACK;
+  s->fill       = mode == CUPS_IOPEN_FILL;
+  s->hold       = 1;
+
+  if (lut)
+  {
+    memcpy(s->lutdata, lut, sizeof(s->lutdata));
+    s->lut = s->lutdata;
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+
+  img->stream = s;
+
+  if (pthread_create(&s->thread, NULL, stream_thread, img))
+  {
+    close(s->fd);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+
+    img->stream = NULL;
+
+    return ((*reader)(img, fp, primary, secondary, saturation, hue, lut));
+  }
+
+ /*
+  * Wait for the first row, or for a reader that can decode at a reduced size
+  * to hold before decoding; if the first row is not the top row then the
+  * reader puts the whole image into tiles and we wait for it to finish.
+  * When filling the tile cache, any first row or column will do...
+  */
+
+  pthread_mutex_lock(&s->lock);
+
+  while (!s->done && ((s->state == CUPS_ISTREAM_START && !s->sized) ||
+                      (s->state == CUPS_ISTREAM_TILES && !s->fill)))
+    pthread_cond_wait(&s->cond, &s->lock);
+
+  state  = s->state;
+  done   = s->done;
+  status = s->status;
+
+  pthread_mutex_unlock(&s->lock);
+
+  if (state == CUPS_ISTREAM_ROWS || (state == CUPS_ISTREAM_TILES && !done) ||
+      (state == CUPS_ISTREAM_START && !done))
+    return (0);
+  else if (state == CUPS_ISTREAM_STOP)
+    return (stream_reopen(img, CUPS_IOPEN_LOAD));
+
+  stream_close(img, NULL);
+
+  return (status);
+}
+
+
+/*
+ * 'stream_put_col()' - Put a column of pixels to a streaming image.
+ *
+ * Columns can only go to the tile cache.
+ */
+
+static int				/* O - -1 to stop, 1 to use tiles */
+stream_put_col(cups_image_t *img)	/* I - Image */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  int			status;		/* Return status */
+
+
+  pthread_mutex_lock(&s->lock);
+
+  s->unordered = 1;			/* Readers wait for the whole image */
+
+  if (s->state == CUPS_ISTREAM_START)
+  {
+    s->state = CUPS_ISTREAM_TILES;
+    pthread_cond_broadcast(&s->cond);
+  }
+  else if (s->state == CUPS_ISTREAM_ROWS)
+  {
+    s->state = CUPS_ISTREAM_STOP;
+    pthread_cond_broadcast(&s->cond);
+  }
+
+  status = s->state == CUPS_ISTREAM_TILES ? 1 : -1;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return (status);
+}
+
+
+/*
+ * 'stream_put_row()' - Put a row of pixels to a streaming image.
+ *
+ * The first row decides whether rows go to the row ring (full rows starting
+ * at the top) or to the tile cache.  Rows for the ring must come in order;
+ * the decoder waits while the ring is full.  When filling the tile cache,
+ * a row that comes in order tells the readers that the rows before it are
+ * complete.
+ */
+
+static int				/* O - -1 to stop, 0 if put, 1 to use tiles */
+stream_put_row(cups_image_t    *img,	/* I - Image */
+               int             x,	/* I - Start column */
+	       int             y,	/* I - Row */
+	       int             width,	/* I - Row width */
+	       const cups_ib_t *pixels)	/* I - Pixel data */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  int			status;		/* Return status */
+
+
+  pthread_mutex_lock(&s->lock);
+
+  if (s->fill)
+  {
+    if (s->state == CUPS_ISTREAM_START)
+    {
+      s->state     = CUPS_ISTREAM_TILES;
+      s->unordered = y != 0;
+
+      pthread_cond_broadcast(&s->cond);
+    }
+    else if (y == s->avail + 1)
+    {
+      s->avail = y;
+
+      pthread_cond_broadcast(&s->cond);
+    }
+    else if (y != s->avail)
+      s->unordered = 1;
+
+    status = s->state == CUPS_ISTREAM_TILES ? 1 : -1;
+
+    pthread_mutex_unlock(&s->lock);
+
+    return (status);
+  }
+
+  if (s->state == CUPS_ISTREAM_START)
+  {
+    s->bpr      = img->xsize * cupsImageGetDepth(img);
+    s->num_rows = s->back + CUPS_STREAM_AHEAD;
+
+    if (x != 0 || y != 0 || width != (int)img->xsize ||
+        (s->rows = malloc((size_t)s->bpr * s->num_rows)) == NULL)
+      s->state = CUPS_ISTREAM_TILES;
+    else
+      s->state = CUPS_ISTREAM_ROWS;
+
+    pthread_cond_broadcast(&s->cond);
+  }
+
+  if (s->state == CUPS_ISTREAM_ROWS &&
+      (x != 0 || y != (s->first + s->count) || width != (int)img->xsize))
+  {
+    DEBUG_printf(("Row %d out of sequence, stopping stream...\n", y));
+
+    s->state = CUPS_ISTREAM_STOP;
+    pthread_cond_broadcast(&s->cond);
+  }
+
+  while (s->state == CUPS_ISTREAM_ROWS && s->count >= s->num_rows)
+    pthread_cond_wait(&s->cond, &s->lock);
+
+  if (s->state == CUPS_ISTREAM_ROWS)
+  {
+    memcpy(s->rows + (y % s->num_rows) * s->bpr, pixels, s->bpr);
+    s->count ++;
+    pthread_cond_broadcast(&s->cond);
+
+    status = 0;
+  }
+  else if (s->state == CUPS_ISTREAM_TILES)
+    status = 1;
+  else
+    status = -1;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return (status);
+}
+
+
+/*
+ * 'stream_release()' - Let a held decoder decode the pixels.
+ *
+ * Waits for the first row like stream_open(); a decoder that already runs
+ * is left alone.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+stream_release(cups_image_t *img)	/* I - Image */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  cups_isstate_t	state;		/* State after the first row */
+  int			done,		/* Non-zero if the reader returned */
+			status;		/* Status of reader */
+
+
+  pthread_mutex_lock(&s->lock);
+
+  if (!s->hold)
+  {
+    pthread_mutex_unlock(&s->lock);
+    return (0);
+  }
+
+  s->hold = 0;
+  pthread_cond_broadcast(&s->cond);
+
+  while (!s->done && (s->state == CUPS_ISTREAM_START ||
+                      (s->state == CUPS_ISTREAM_TILES && !s->fill)))
+    pthread_cond_wait(&s->cond, &s->lock);
+
+  state  = s->state;
+  done   = s->done;
+  status = s->status;
+
+  pthread_mutex_unlock(&s->lock);
+
+  if (state == CUPS_ISTREAM_STOP)
+    return (stream_reopen(img, CUPS_IOPEN_LOAD));
+  else if (done && status)
+  {
+    img->xsize = img->ysize = 0;
+    return (-1);
+  }
+  else if (done && !s->fill)
+    stream_close(img, NULL);		/* The whole image is in tiles */
+
+  return (0);
+}
+
+
+/*
+ * 'stream_reopen()' - Decode a streaming image again from the start.
+ *
+ * The decoder is stopped and the file is read again from a duplicate of its
+ * descriptor at the size currently asked for, either streaming (mode
+ * CUPS_IOPEN_STREAM or _FILL) or loading the whole image into tiles (mode
+ * CUPS_IOPEN_LOAD).  On error the image size is set to 0 so that all further
+ * reads fail.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+stream_reopen(cups_image_t *img,	/* I - Image */
+              int          mode)	/* I - CUPS_IOPEN_ mode */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  cups_iread_t		reader;		/* Reader for file */
+  int			flags;		/* Reader flags */
+  cups_icspace_t	primary,	/* Primary colorspace needed */
+			secondary;	/* Secondary colorspace */
+  int			saturation,	/* Color saturation level */
+			hue;		/* Color hue adjustment */
+  cups_ib_t		lutdata[256];	/* Copy of the LUT */
+  const cups_ib_t	*lut;		/* LUT or NULL */
+  int			fd,		/* File descriptor */
+			status;		/* Status of reader */
+  FILE			*fp;		/* File pointer */
+
+
+  DEBUG_printf(("Reopening stream, %s...\n",
+                mode == CUPS_IOPEN_STREAM ? "streaming" :
+		mode == CUPS_IOPEN_FILL ? "filling tiles" :
+		"loading whole image"));
+
+  reader     = s->reader;
+  flags      = s->flags;
+  primary    = s->primary;
+  secondary  = s->secondary;
+  saturation = s->saturation;
+  hue        = s->hue;
+  lut        = s->lut ? lutdata : NULL;
+
+  memcpy(lutdata, s->lutdata, sizeof(lutdata));
+
+  stream_close(img, &fd);
+
+  if (fd < 0 || lseek(fd, 0, SEEK_SET) < 0 || (fp = fdopen(fd, "r")) == NULL)
+  {
+    if (fd >= 0)
+      close(fd);
+
+    img->xsize = img->ysize = 0;
+    return (-1);
+  }
+
+ /*
+  * The readers expect a new image, so reset what they set and drop the
+  * tiles of a partly filled tile cache...
+  */
+
+  free_tiles(img);
+
+  img->xsize   = 0;
+  img->ysize   = 0;
+  img->xppi    = 128;
+  img->yppi    = 128;
+  img->max_ics = CUPS_TILE_MINIMUM;
+
+  if (mode != CUPS_IOPEN_LOAD)
+    status = stream_open(img, fp, reader, flags, mode, primary, secondary,
+                         saturation, hue, lut);
+  else
+    status = (*reader)(img, fp, primary, secondary, saturation, hue, lut);
+
+  if (status)
+  {
+    img->xsize = img->ysize = 0;
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'stream_thread()' - Run the image reader for a streaming image.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+stream_thread(void *data)		/* I - Image */
+{
+  cups_image_t		*img = (cups_image_t *)data;
+					/* Image */
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  int			status;		/* Status of reader */
+
+
+  status = (*s->reader)(img, s->fp, s->primary, s->secondary, s->saturation,
+                        s->hue, s->lut);
+
+  pthread_mutex_lock(&s->lock);
+  s->done   = 1;
+  s->status = status;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+
+  return (NULL);
+}
+
+
+/*
+ * 'stream_wait()' - Wait until the decoder has put a row into the tile cache.
+ *
+ * Rows that do not come in order are only known to be complete once the
+ * decoder is done.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+stream_wait(cups_image_t *img,		/* I - Image */
+            int          y)		/* I - Row */
+{
+  cups_istream_t	*s = img->stream;
+					/* Streaming state */
+  int			status;		/* Return status */
+
+
+  pthread_mutex_lock(&s->lock);
+
+  while (!s->done && s->state != CUPS_ISTREAM_STOP &&
+         (s->unordered || y >= s->avail))
+    pthread_cond_wait(&s->cond, &s->lock);
+
+  if (!s->unordered && y < s->avail)
+    status = 0;
+  else if (s->done && !s->status)
+    status = 0;
+  else
+    status = -1;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return (status);
+}
+#endif /* HAVE_PTHREAD_H */
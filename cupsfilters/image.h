@@ -38,6 +38,19 @@ typedef enum cups_icspace_e		/**** Image colorspaces ****/
   CUPS_IMAGE_RGB_CMYK = 4		/* Use RGB or CMYK */
 } cups_icspace_t;
 
+typedef enum cups_icache_e		/**** Image tile cache modes ****/
+{
+  CUPS_IMAGE_CACHE_AUTO,		/* Pick from RIP_CACHE_MODE or image size */
+  CUPS_IMAGE_CACHE_FILE,		/* Swap tiles with pread/pwrite */
+  CUPS_IMAGE_CACHE_MMAP			/* Map tiles from a sparse swap file */
+} cups_icache_t;
+
+typedef enum cups_istream_mode_e	/**** Image streaming modes ****/
+{
+  CUPS_IMAGE_STREAM_ROWS,		/* Keep a few rows, read in order */
+  CUPS_IMAGE_STREAM_FILL		/* Fill the tile cache, read in any order */
+} cups_istream_mode_t;
+
 
 /*
  * Types and structures...
@@ -53,6 +66,10 @@ struct cups_izoom_s;
 typedef struct cups_izoom_s cups_izoom_t;
 					/**** Image zoom data ****/
 
+typedef int (*cups_irows_cb_t)(void *context, int y, int height,
+                               const cups_ib_t *pixels);
+					/**** Row range callback ****/
+
 
 /*
  * Prototypes...
@@ -77,6 +94,9 @@ extern unsigned		cupsImageGetHeight(cups_image_t *img) _CUPS_API_1_2;
 extern int		cupsImageGetRow(cups_image_t *img, int x, int y,
 			                int width, cups_ib_t *pixels) _CUPS_API_1_2;
 extern unsigned		cupsImageGetWidth(cups_image_t *img) _CUPS_API_1_2;
+extern int		cupsImageGetRows(cups_image_t *img, int y0, int y1,
+			                 int num_threads, cups_irows_cb_t cb,
+					 void *context) _CUPS_API_1_2;
 extern unsigned		cupsImageGetXPPI(cups_image_t *img) _CUPS_API_1_2;
 extern unsigned		cupsImageGetYPPI(cups_image_t *img) _CUPS_API_1_2;
 extern void		cupsImageLut(cups_ib_t *pixels, int count,
@@ -86,6 +106,13 @@ extern cups_image_t	*cupsImageOpen(const char *filename,
 				       cups_icspace_t secondary,
 			               int saturation, int hue,
 				       const cups_ib_t *lut) _CUPS_API_1_2;
+extern cups_image_t	*cupsImageOpenStream(const char *filename,
+			                     cups_icspace_t primary,
+				             cups_icspace_t secondary,
+			                     int saturation, int hue,
+				             const cups_ib_t *lut,
+					     cups_istream_mode_t mode) _CUPS_API_1_2;
+					/* ROWS images are not thread safe */
 extern void		cupsImageRGBAdjust(cups_ib_t *pixels, int count,
 			                   int saturation, int hue) _CUPS_API_1_2;
 extern void		cupsImageRGBToBlack(const cups_ib_t *in,
@@ -98,7 +125,11 @@ extern void		cupsImageRGBToRGB(const cups_ib_t *in,
 			                  cups_ib_t *out, int count) _CUPS_API_1_2;
 extern void		cupsImageRGBToWhite(const cups_ib_t *in,
 			                    cups_ib_t *out, int count) _CUPS_API_1_2;
+extern void		cupsImageSetCacheMode(cups_icache_t mode) _CUPS_API_1_2;
 extern void		cupsImageSetMaxTiles(cups_image_t *img, int max_tiles) _CUPS_API_1_2;
+extern int		cupsImageSetMinSize(cups_image_t *img,
+			                    unsigned min_width,
+					    unsigned min_height) _CUPS_API_1_2;
 extern void		cupsImageSetProfile(float d, float g,
 			                    float matrix[3][3]) _CUPS_API_1_2;
 extern void		cupsImageSetRasterColorSpace(cups_cspace_t cs) _CUPS_API_1_2;
@@ -0,0 +1,642 @@
+/*
+ *   Threshold matrix screening routines for CUPS.
+ *
+ *   Screening compares each pixel with a threshold from a small matrix
+ *   that is tiled over the page.  Unlike error diffusion no state is
+ *   carried from one pixel or line to the next, so any row can be
+ *   screened on its own and the inner loop has no dependencies.
+ *
+ *   Copyright 2007 by Apple Inc.
+ *   Copyright 1993-2005 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   cupsScreenDelete()   - Free a screen.
+ *   cupsScreenLine()     - Screen a line of pixels.
+ *   cupsScreenLoad()     - Load the screen for a channel from a PPD file.
+ *   cupsScreenNew()      - Create a screen for a lookup table.
+ *   cupsScreenRow()      - Screen a given row of pixels.
+ *   compare_spots()      - Compare two spot function values.
+ *   get_matrix()         - Get the shared matrix for a screen type.
+ *   make_bluenoise()     - Make a blue-noise matrix.
+ *   make_clustered()     - Make a clustered-dot matrix.
+ *   update_energy()      - Add or remove a pixel from the energy array.
+ */
+
+/*
+ * Include necessary headers.
+ */
+
+#include <config.h>
+#include "driver.h"
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Constants...
+ */
+
+#define CUPS_CLUSTERED_SIZE	8	/* Size of clustered-dot cell */
+#define CUPS_BLUENOISE_SIZE	64	/* Size of blue-noise matrix */
+#define CUPS_BLUENOISE_SIGMA	1.5	/* Width of void-and-cluster filter */
+#define CUPS_BLUENOISE_RADIUS	7	/* Filter radius in pixels */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct cups_spot_s		/**** Spot function value ****/
+{
+  float		value;			/* Spot function value */
+  int		index;			/* Index in matrix */
+} cups_spot_t;
+
+
+/*
+ * Local globals...
+ */
+
+static unsigned short	*cups_matrices[2] = { NULL, NULL };
+					/* Matrix of each screen type */
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t	cups_matrices_lock = PTHREAD_MUTEX_INITIALIZER;
+					/* Lock for making the matrices */
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_spots(const cups_spot_t *a, const cups_spot_t *b);
+static const unsigned short *get_matrix(cups_screen_type_t type, int size);
+static void	make_bluenoise(unsigned short *matrix, int size);
+static void	make_clustered(unsigned short *matrix, int size);
+static void	update_energy(float *energy, const float *filter, int size,
+		              int index, float sign);
+
+
+/*
+ * 'cupsScreenDelete()' - Free a screen.
+ */
+
+void
+cupsScreenDelete(cups_screen_t *s)	/* I - Screen */
+{
+  if (s != NULL)
+    free(s);
+}
+
+
+/*
+ * 'cupsScreenLine()' - Screen a line of pixels.
+ *
+ * This is a drop-in replacement for cupsDitherLine() that screens the
+ * lines in order.
+ */
+
+void
+cupsScreenLine(cups_screen_t *s,	/* I - Screen */
+	       const short   *data,	/* I - Separation data */
+	       int           num_channels,
+					/* I - Number of components */
+	       unsigned char *p)	/* O - Pixels */
+{
+  cupsScreenRow(s, s->row, data, num_channels, p);
+
+  s->row ++;
+}
+
+
+/*
+ * 'cupsScreenLoad()' - Load the screen for a channel from a PPD file.
+ *
+ * The screen type comes from the cupsScreen attribute, which can be
+ * "ErrorDiffusion", "Clustered" or "BlueNoise".  NULL is returned when
+ * error diffusion should be used.
+ */
+
+cups_screen_t *				/* O - New screen or NULL */
+cupsScreenLoad(ppd_file_t       *ppd,	/* I - PPD file */
+               const char       *colormodel,
+					/* I - Color model */
+               const char       *media,	/* I - Media type */
+               const char       *resolution,
+					/* I - Resolution */
+	       const cups_lut_t *lut,	/* I - Lookup table */
+	       int              width,	/* I - Width of output in pixels */
+	       int              channel)/* I - Channel number */
+{
+  char			spec[PPD_MAX_NAME];
+					/* Attribute spec */
+  ppd_attr_t		*attr;		/* Attribute */
+  cups_screen_type_t	type;		/* Screen type */
+
+
+  if (!ppd || !colormodel || !media || !resolution || !lut)
+    return (NULL);
+
+  if ((attr = cupsFindAttr(ppd, "cupsScreen", colormodel, media, resolution,
+                           spec, sizeof(spec))) == NULL || !attr->value)
+    return (NULL);
+
+  if (!strcasecmp(attr->value, "Clustered"))
+    type = CUPS_SCREEN_CLUSTERED;
+  else if (!strcasecmp(attr->value, "BlueNoise"))
+    type = CUPS_SCREEN_BLUENOISE;
+  else
+  {
+    if (strcasecmp(attr->value, "ErrorDiffusion"))
+      fprintf(stderr, "DEBUG: Unknown cupsScreen value \"%s\".\n",
+              attr->value);
+
+    return (NULL);
+  }
+
+  if (channel == 0)
+    fprintf(stderr, "DEBUG: Using %s screen from PPD\n", attr->value);
+
+  return (cupsScreenNew(type, lut, width, channel));
+}
+
+
+/*
+ * 'cupsScreenNew()' - Create a screen for a lookup table.
+ *
+ * The channel number selects a different phase of the matrix so that the
+ * dots of the colors do not all land on top of each other.  The matrix
+ * itself is made only once per screen type and shared by all screens, so
+ * creating the screens for every page is cheap.
+ */
+
+cups_screen_t *				/* O - New screen or NULL */
+cupsScreenNew(cups_screen_type_t type,	/* I - Type of screen */
+              const cups_lut_t   *lut,	/* I - Lookup table */
+              int                width,	/* I - Width of output in pixels */
+	      int                channel)
+					/* I - Channel number */
+{
+  cups_screen_t	*s;			/* New screen */
+  int		i,			/* Looping var */
+		intensity,		/* Adjusted intensity */
+		pixel,			/* Nearest pixel value */
+		maxpixel;		/* Largest pixel value */
+  int		levels[256],		/* Intensity of each pixel value */
+		low, high;		/* Levels around intensity */
+  static const float offsets[8][2] =	/* Phase of each channel */
+		{
+		  { 0.0, 0.0 },
+		  { 0.5, 0.0 },
+		  { 0.0, 0.5 },
+		  { 0.5, 0.5 },
+		  { 0.25, 0.75 },
+		  { 0.75, 0.25 },
+		  { 0.25, 0.25 },
+		  { 0.75, 0.75 }
+		};
+
+
+ /*
+  * Range check input...
+  */
+
+  if (!lut || width < 1 ||
+      (type != CUPS_SCREEN_CLUSTERED && type != CUPS_SCREEN_BLUENOISE))
+    return (NULL);
+
+  if ((s = (cups_screen_t *)calloc(1, sizeof(cups_screen_t))) == NULL)
+    return (NULL);
+
+  s->width = width;
+  s->size  = type == CUPS_SCREEN_CLUSTERED ? CUPS_CLUSTERED_SIZE :
+                                             CUPS_BLUENOISE_SIZE;
+
+  if ((s->matrix = get_matrix(type, s->size)) == NULL)
+  {
+    free(s);
+    return (NULL);
+  }
+
+  channel    &= 7;
+  s->xoffset = (int)(offsets[channel][0] * s->size);
+  s->yoffset = (int)(offsets[channel][1] * s->size);
+
+ /*
+  * Find the intensity of each output pixel value in the lookup table; the
+  * error is the difference between the table index and that intensity...
+  */
+
+  for (i = 0; i < 256; i ++)
+    levels[i] = -1;
+
+  for (i = CUPS_MAX_LUT, maxpixel = 0; i > 0; i --)
+  {
+    pixel = lut[i].pixel & 255;
+
+    if (levels[pixel] < 0)
+      levels[pixel] = i - lut[i].error;
+
+    if (pixel > maxpixel)
+      maxpixel = pixel;
+  }
+
+  if (levels[lut[0].pixel & 255] < 0)
+    levels[lut[0].pixel & 255] = 0;
+
+ /*
+  * Then store the levels on either side of each input value and how far
+  * it is between them...
+  */
+
+  for (i = 0; i <= CUPS_MAX_LUT; i ++)
+  {
+    intensity = lut[i].intensity;
+
+    if (intensity > CUPS_MAX_LUT)
+      intensity = CUPS_MAX_LUT;
+    else if (intensity < 0)
+      intensity = 0;
+
+    pixel = lut[intensity].pixel & 255;
+
+    if (intensity >= levels[pixel])
+    {
+      for (low = pixel, high = pixel + 1;
+           high <= maxpixel && levels[high] < 0;
+	   high ++);
+    }
+    else
+    {
+      for (high = pixel, low = pixel - 1;
+           low >= 0 && levels[low] < 0;
+	   low --);
+    }
+
+    if (low < 0)
+    {
+      s->lower[i] = s->upper[i] = high;
+      s->fraction[i] = 0;
+    }
+    else if (high > maxpixel || levels[high] <= levels[low])
+    {
+      s->lower[i] = s->upper[i] = low;
+      s->fraction[i] = 0;
+    }
+    else
+    {
+      s->lower[i]    = low;
+      s->upper[i]    = high;
+      s->fraction[i] = (intensity - levels[low]) * (CUPS_MAX_LUT + 1) /
+                       (levels[high] - levels[low]);
+    }
+  }
+
+  return (s);
+}
+
+
+/*
+ * 'cupsScreenRow()' - Screen a given row of pixels.
+ *
+ * Rows do not depend on each other and can be screened in any order or
+ * on several threads.
+ */
+
+void
+cupsScreenRow(const cups_screen_t *s,	/* I - Screen */
+              int                 y,	/* I - Row number */
+	      const short         *data,/* I - Separation data */
+	      int                 num_channels,
+					/* I - Number of components */
+	      unsigned char       *p)	/* O - Pixels */
+{
+  int			x,		/* Horizontal position in line */
+			value,		/* Input value */
+			mask;		/* Mask for matrix position */
+  const unsigned short	*thresholds;	/* Row of matrix */
+
+
+  mask       = s->size - 1;
+  thresholds = s->matrix + ((y + s->yoffset) & mask) * s->size;
+
+  for (x = 0; x < s->width; x ++, data += num_channels)
+  {
+    value = *data;
+
+    if (value < 0)
+      value = 0;
+    else if (value > CUPS_MAX_LUT)
+      value = CUPS_MAX_LUT;
+
+    p[x] = s->fraction[value] > thresholds[(x + s->xoffset) & mask] ?
+               s->upper[value] : s->lower[value];
+  }
+}
+
+
+/*
+ * 'compare_spots()' - Compare two spot function values.
+ */
+
+static int				/* O - Result of comparison */
+compare_spots(const cups_spot_t *a,	/* I - First spot */
+              const cups_spot_t *b)	/* I - Second spot */
+{
+  if (a->value > b->value)
+    return (-1);
+  else if (a->value < b->value)
+    return (1);
+  else
+    return (a->index - b->index);
+}
+
+
+/*
+ * 'get_matrix()' - Get the shared matrix for a screen type.
+ *
+ * The matrix is made on first use and kept until the program exits.
+ */
+
+static const unsigned short *		/* O - Thresholds or NULL */
+get_matrix(cups_screen_type_t type,	/* I - Type of screen */
+           int                size)	/* I - Width and height of matrix */
+{
+  unsigned short	*matrix;	/* Thresholds */
+
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&cups_matrices_lock);
+#endif /* HAVE_PTHREAD_H */
+
+  if ((matrix = cups_matrices[type]) == NULL &&
+      (matrix = calloc(size * size, sizeof(unsigned short))) != NULL)
+  {
+    if (type == CUPS_SCREEN_CLUSTERED)
+      make_clustered(matrix, size);
+    else
+      make_bluenoise(matrix, size);
+
+    cups_matrices[type] = matrix;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&cups_matrices_lock);
+#endif /* HAVE_PTHREAD_H */
+
+  return (matrix);
+}
+
+
+/*
+ * 'make_bluenoise()' - Make a blue-noise matrix.
+ *
+ * This is Ulichney's void-and-cluster method: pixels are ranked by
+ * repeatedly removing the tightest cluster or filling the largest void of
+ * a binary pattern, using a Gaussian-filtered "energy" of the pattern.
+ * A fixed seed is used so that the matrix is the same every time.
+ */
+
+static void
+make_bluenoise(unsigned short *matrix,	/* O - Threshold matrix */
+               int            size)	/* I - Size of matrix */
+{
+  int		i,			/* Looping var */
+		x, y,			/* Filter position */
+		count,			/* Number of pixels */
+		ones,			/* Number of set pixels */
+		rank,			/* Current rank */
+		best,			/* Best pixel */
+		last;			/* Last pixel filled */
+  unsigned	seed;			/* Random number seed */
+  unsigned char	*pattern,		/* Binary pattern */
+		*proto;			/* Initial binary pattern */
+  int		*ranks;			/* Rank of each pixel */
+  float		*energy,		/* Energy of set pixels */
+		*saved,			/* Energy of initial pattern */
+		*filter;		/* Gaussian filter */
+
+
+  count   = size * size;
+  pattern = calloc(count, 1);
+  proto   = calloc(count, 1);
+  ranks   = calloc(count, sizeof(int));
+  energy  = calloc(count, sizeof(float));
+  saved   = calloc(count, sizeof(float));
+  filter  = calloc(count, sizeof(float));
+
+  if (!pattern || !proto || !ranks || !energy || !saved || !filter)
+  {
+   /*
+    * Fall back to a plain ramp...
+    */
+
+    for (i = 0; i < count; i ++)
+      matrix[i] = (i * (CUPS_MAX_LUT + 1) + (CUPS_MAX_LUT + 1) / 2) / count;
+
+    free(pattern);
+    free(proto);
+    free(ranks);
+    free(energy);
+    free(saved);
+    free(filter);
+    return;
+  }
+
+ /*
+  * The filter wraps around the matrix so that it tiles seamlessly...
+  */
+
+  for (y = -CUPS_BLUENOISE_RADIUS; y <= CUPS_BLUENOISE_RADIUS; y ++)
+    for (x = -CUPS_BLUENOISE_RADIUS; x <= CUPS_BLUENOISE_RADIUS; x ++)
+      filter[((y + size) % size) * size + (x + size) % size] =
+          exp(-(x * x + y * y) /
+	      (2.0 * CUPS_BLUENOISE_SIGMA * CUPS_BLUENOISE_SIGMA));
+
+ /*
+  * Start with 10% of the pixels set at random...
+  */
+
+  for (seed = 1, ones = 0; ones < count / 10;)
+  {
+    seed = seed * 1103515245 + 12345;
+    i    = (seed >> 8) % count;
+
+    if (!proto[i])
+    {
+      proto[i] = 1;
+      update_energy(energy, filter, size, i, 1.0f);
+      ones ++;
+    }
+  }
+
+ /*
+  * Move pixels from the tightest cluster to the largest void until that
+  * no longer changes anything...
+  */
+
+  for (;;)
+  {
+    for (i = 0, best = -1; i < count; i ++)
+      if (proto[i] && (best < 0 || energy[i] > energy[best]))
+        best = i;
+
+    proto[best] = 0;
+    update_energy(energy, filter, size, best, -1.0f);
+
+    for (i = 0, last = -1; i < count; i ++)
+      if (!proto[i] && (last < 0 || energy[i] < energy[last]))
+        last = i;
+
+    proto[last] = 1;
+    update_energy(energy, filter, size, last, 1.0f);
+
+    if (last == best)
+      break;
+  }
+
+ /*
+  * Phase 1: rank the initial pixels by removing the tightest clusters...
+  */
+
+  memcpy(pattern, proto, count);
+  memcpy(saved, energy, count * sizeof(float));
+
+  for (rank = ones - 1; rank >= 0; rank --)
+  {
+    for (i = 0, best = -1; i < count; i ++)
+      if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+        best = i;
+
+    pattern[best] = 0;
+    update_energy(energy, filter, size, best, -1.0f);
+    ranks[best] = rank;
+  }
+
+ /*
+  * Phase 2: fill the largest voids up to half of the pixels...
+  */
+
+  memcpy(pattern, proto, count);
+  memcpy(energy, saved, count * sizeof(float));
+
+  for (rank = ones; rank < count / 2; rank ++)
+  {
+    for (i = 0, best = -1; i < count; i ++)
+      if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+        best = i;
+
+    pattern[best] = 1;
+    update_energy(energy, filter, size, best, 1.0f);
+    ranks[best] = rank;
+  }
+
+ /*
+  * Phase 3: the unset pixels are now the minority, so fill the tightest
+  * clusters of unset pixels...
+  */
+
+  memset(energy, 0, count * sizeof(float));
+
+  for (i = 0; i < count; i ++)
+    if (!pattern[i])
+      update_energy(energy, filter, size, i, 1.0f);
+
+  for (; rank < count; rank ++)
+  {
+    for (i = 0, best = -1; i < count; i ++)
+      if (!pattern[i] && (best < 0 || energy[i] > energy[best]))
+        best = i;
+
+    pattern[best] = 1;
+    update_energy(energy, filter, size, best, -1.0f);
+    ranks[best] = rank;
+  }
+
+ /*
+  * Convert the ranks to thresholds...
+  */
+
+  for (i = 0; i < count; i ++)
+    matrix[i] = (ranks[i] * (CUPS_MAX_LUT + 1) + (CUPS_MAX_LUT + 1) / 2) /
+                count;
+
+  free(pattern);
+  free(proto);
+  free(ranks);
+  free(energy);
+  free(saved);
+  free(filter);
+}
+
+
+/*
+ * 'make_clustered()' - Make a clustered-dot matrix.
+ *
+ * The spot function has a dot in the corners of the cell and a hole in
+ * the middle, which gives a 45 degree screen with round dots that join
+ * in a checkerboard at 50%.
+ */
+
+static void
+make_clustered(unsigned short *matrix,	/* O - Threshold matrix */
+               int            size)	/* I - Size of matrix */
+{
+  int		x, y,			/* Position in cell */
+		count;			/* Number of pixels */
+  cups_spot_t	spots[CUPS_CLUSTERED_SIZE * CUPS_CLUSTERED_SIZE];
+					/* Spot function values */
+
+
+  count = size * size;
+
+  for (y = 0; y < size; y ++)
+    for (x = 0; x < size; x ++)
+    {
+      spots[y * size + x].value = cos(2.0 * M_PI * (x + 0.5) / size) +
+                                  cos(2.0 * M_PI * (y + 0.5) / size);
+      spots[y * size + x].index = y * size + x;
+    }
+
+  qsort(spots, count, sizeof(cups_spot_t),
+        (int (*)(const void *, const void *))compare_spots);
+
+  for (x = 0; x < count; x ++)
+    matrix[spots[x].index] = (x * (CUPS_MAX_LUT + 1) +
+                              (CUPS_MAX_LUT + 1) / 2) / count;
+}
+
+
+/*
+ * 'update_energy()' - Add or remove a pixel from the energy array.
+ */
+
+static void
+update_energy(float       *energy,	/* I - Energy array */
+              const float *filter,	/* I - Gaussian filter */
+	      int         size,		/* I - Size of matrix */
+	      int         index,	/* I - Pixel to add or remove */
+	      float       sign)		/* I - 1 to add, -1 to remove */
+{
+  int	x, y,				/* Filter position */
+	px, py,				/* Pixel position */
+	mask;				/* Mask for wrapping around */
+
+
+  mask = size - 1;
+  px   = index % size;
+  py   = index / size;
+
+  for (y = -CUPS_BLUENOISE_RADIUS; y <= CUPS_BLUENOISE_RADIUS; y ++)
+    for (x = -CUPS_BLUENOISE_RADIUS; x <= CUPS_BLUENOISE_RADIUS; x ++)
+      energy[((py + y) & mask) * size + ((px + x) & mask)] +=
+          sign * filter[(y & mask) * size + (x & mask)];
+}
@@ -0,0 +1,312 @@
+/*
+ *   Image tile cache benchmark for CUPS.
+ *
+ *   Try the following:
+ *
+ *       testcache -m file 20000 15000
+ *       testcache -m mmap 20000 15000
+ *       testcache -m file -t 4 20000 15000
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2006 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Write, load and read back a large image.
+ *   check_rows() - Check a band of rows against the test pattern.
+ *   get_io()     - Get the number of read and write system calls.
+ *   get_time()   - Get the current time in seconds.
+ *   pixel()      - Compute the test pattern value of a pixel.
+ *   usage()      - Show program usage...
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image.h"
+#include <cups/cups.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+/*
+ * Local functions...
+ */
+
+static int		check_rows(void *context, int y, int height,
+			           const cups_ib_t *pixels);
+static void		get_io(long long *syscr, long long *syscw);
+static double		get_time(void);
+static cups_ib_t	pixel(int x, int y, int c);
+static void		usage(void);
+
+
+/*
+ * 'main()' - Write, load and read back a large image.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i,			/* Looping var */
+		x, y, c;		/* Current coordinate and channel */
+  int		width,			/* Width of image */
+		height,			/* Height of image */
+		num_threads;		/* Number of reader threads */
+  char		filename[1024];		/* Temporary PPM file */
+  int		fd;			/* File descriptor of PPM file */
+  FILE		*fp;			/* PPM file */
+  cups_image_t	*img;			/* Image */
+  cups_ib_t	*line;			/* Row of pixels */
+  int		errors,			/* Number of mismatching pixels */
+		*band_errors;		/* Mismatching pixels per band */
+  double	start,			/* Start time */
+		loaded,			/* Time after loading */
+		done;			/* Time after reading back */
+  long long	syscr[3],		/* Read system calls */
+		syscw[3];		/* Write system calls */
+
+
+  width       = 8000;
+  height      = 6000;
+  num_threads = 0;
+
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-m") && i + 1 < argc)
+    {
+      i ++;
+
+      if (!strcmp(argv[i], "file"))
+        cupsImageSetCacheMode(CUPS_IMAGE_CACHE_FILE);
+      else if (!strcmp(argv[i], "mmap"))
+        cupsImageSetCacheMode(CUPS_IMAGE_CACHE_MMAP);
+      else if (strcmp(argv[i], "auto"))
+        usage();
+    }
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      num_threads = atoi(argv[++ i]);
+    else if (i + 1 < argc)
+    {
+      width  = atoi(argv[i]);
+      height = atoi(argv[++ i]);
+    }
+    else
+      usage();
+
+  if (width < 1 || height < 1)
+    usage();
+
+ /*
+  * Write a test pattern to a temporary PPM file...
+  */
+
+  if ((fd = cupsTempFd(filename, sizeof(filename))) < 0 ||
+      (fp = fdopen(fd, "wb")) == NULL)
+  {
+    perror("testcache");
+    return (1);
+  }
+
+  line = malloc(width * 3);
+
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+  for (y = 0; y < height; y ++)
+  {
+    for (x = 0; x < width; x ++)
+      for (c = 0; c < 3; c ++)
+        line[x * 3 + c] = pixel(x, y, c);
+
+    fwrite(line, width, 3, fp);
+  }
+
+  fclose(fp);
+
+ /*
+  * Load the image and read it back row by row...
+  */
+
+  get_io(syscr + 0, syscw + 0);
+  start = get_time();
+
+  if ((img = cupsImageOpen(filename, CUPS_IMAGE_RGB, CUPS_IMAGE_RGB, 100, 0,
+                           NULL)) == NULL)
+  {
+    perror(filename);
+    unlink(filename);
+    return (1);
+  }
+
+  get_io(syscr + 1, syscw + 1);
+  loaded = get_time();
+
+  if (num_threads > 0)
+  {
+   /*
+    * Use the row range reader, counting errors per band so that the
+    * callbacks do not need to share anything...
+    */
+
+    band_errors    = calloc(height / 256 + 2, sizeof(int));
+    band_errors[0] = width;
+
+    if (cupsImageGetRows(img, 0, height - 1, num_threads, check_rows,
+                         band_errors))
+      errors = 1;
+    else
+      errors = 0;
+
+    for (y = 0; y < height; y += 256)
+      errors += band_errors[y / 256 + 1];
+
+    free(band_errors);
+  }
+  else
+  {
+    for (y = 0, errors = 0; y < height; y ++)
+    {
+      cupsImageGetRow(img, 0, y, width, line);
+
+      for (x = 0; x < width; x ++)
+	for (c = 0; c < 3; c ++)
+	  if (line[x * 3 + c] != pixel(x, y, c))
+	    errors ++;
+    }
+  }
+
+  get_io(syscr + 2, syscw + 2);
+  done = get_time();
+
+  cupsImageClose(img);
+  unlink(filename);
+  free(line);
+
+  if (num_threads > 0)
+    printf("%dx%d RGB image, %d threads:\n", width, height, num_threads);
+  else
+    printf("%dx%d RGB image:\n", width, height);
+  printf("    load: %.3f seconds, %lld reads, %lld writes\n", loaded - start,
+         syscr[1] - syscr[0], syscw[1] - syscw[0]);
+  printf("    read: %.3f seconds, %lld reads, %lld writes\n", done - loaded,
+         syscr[2] - syscr[1], syscw[2] - syscw[1]);
+
+  if (errors)
+  {
+    printf("FAIL: %d pixels differ\n", errors);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
+
+
+/*
+ * 'check_rows()' - Check a band of rows against the test pattern.
+ *
+ * The context is an array holding the image width followed by one error
+ * count per band of 256 rows.
+ */
+
+static int				/* O - 0 to continue */
+check_rows(void            *context,	/* I - Width and error counts */
+           int             y,		/* I - First row */
+	   int             height,	/* I - Number of rows */
+	   const cups_ib_t *pixels)	/* I - Pixels */
+{
+  int	*band_errors = (int *)context;	/* Width and error counts */
+  int	width = band_errors[0];		/* Width of image */
+  int	x, row, c;			/* Looping vars */
+
+
+  for (row = 0; row < height; row ++)
+    for (x = 0; x < width; x ++)
+      for (c = 0; c < 3; c ++, pixels ++)
+        if (*pixels != pixel(x, y + row, c))
+	  band_errors[(y + row) / 256 + 1] ++;
+
+  return (0);
+}
+
+
+/*
+ * 'get_io()' - Get the number of read and write system calls.
+ *
+ * The counts come from /proc/self/io and include reading the PPM file; they
+ * are reported as -1 where that file is not available.
+ */
+
+static void
+get_io(long long *syscr,		/* O - Read system calls */
+       long long *syscw)		/* O - Write system calls */
+{
+  FILE	*fp;				/* /proc/self/io */
+  char	line[256];			/* Line from file */
+
+
+  *syscr = *syscw = -1;
+
+  if ((fp = fopen("/proc/self/io", "r")) == NULL)
+    return;
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    if (!strncmp(line, "syscr:", 6))
+      *syscr = atoll(line + 6);
+    else if (!strncmp(line, "syscw:", 6))
+      *syscw = atoll(line + 6);
+  }
+
+  fclose(fp);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'pixel()' - Compute the test pattern value of a pixel.
+ */
+
+static cups_ib_t			/* O - Pixel value */
+pixel(int x,				/* I - Column */
+      int y,				/* I - Row */
+      int c)				/* I - Channel */
+{
+  return ((cups_ib_t)(x * (c + 1) + y * (3 - c)));
+}
+
+
+/*
+ * 'usage()' - Show program usage...
+ */
+
+static void
+usage(void)
+{
+  puts("Usage: testcache [-m auto|file|mmap] [-t threads] [width height]");
+  exit(1);
+}
@@ -0,0 +1,334 @@
+/*
+ *   Colorspace conversion test program for CUPS.
+ *
+ *   Runs each of the vectorized colorspace conversions and the scalar code
+ *   on the same random pixels and checks that the results are identical.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2006 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()        - Test the colorspace conversions.
+ *   get_time()    - Get the current time in seconds.
+ *   test_adjust() - Compare cupsImageRGBAdjust() with and without SIMD code.
+ *   test_conv()   - Compare a conversion with and without SIMD code.
+ *   test_lut()    - Compare cupsImageLut() with and without SIMD code.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+#include <sys/time.h>
+
+
+/*
+ * Constants...
+ */
+
+#define NUM_PIXELS	100003		/* Pixels per test, not a multiple
+					 * of any vector size */
+#define NUM_REPEAT	20		/* Times to repeat for timing */
+
+
+/*
+ * Local types...
+ */
+
+typedef void (*conv_cb_t)(const cups_ib_t *in, cups_ib_t *out, int count);
+
+
+/*
+ * Local functions...
+ */
+
+static double	get_time(void);
+static int	test_adjust(const cups_ib_t *in, int saturation, int hue);
+static int	test_conv(const char *name, conv_cb_t conv, const cups_ib_t *in,
+		          int inbpp, int outbpp);
+static int	test_lut(const cups_ib_t *in);
+
+
+/*
+ * 'main()' - Test the colorspace conversions.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int		i;			/* Looping var */
+  int		errors = 0;		/* Number of failed tests */
+  cups_ib_t	*in;			/* Random input pixels */
+  static float	matrices[3][3][3] =	/* Test profile matrices */
+		{
+		  { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } },
+		  { { 0.9, 0.1, 0.05 }, { 0.08, 0.85, 0.12 },
+		    { 0.02, 0.1, 0.95 } },
+		  { { 1.4, -0.3, -0.2 }, { -0.25, 1.3, -0.1 },
+		    { -0.1, -0.35, 1.5 } }
+		};
+  static float	densities[3][2] =	/* Test density and gamma values */
+		{
+		  { 1.0, 1.0 },
+		  { 0.9, 1.8 },
+		  { 1.2, 0.7 }
+		};
+
+
+  switch (_cupsImageGetSIMD())
+  {
+    case CUPS_ISIMD_AVX2 :
+        puts("SIMD level: AVX2");
+        break;
+    case CUPS_ISIMD_NEON :
+        puts("SIMD level: NEON");
+        break;
+    default :
+        puts("SIMD level: none, only testing the scalar code");
+        break;
+  }
+
+ /*
+  * Fill the input buffer with random pixels, making sure that all of the
+  * pure grays and primaries are in there as well...
+  */
+
+  in = malloc(NUM_PIXELS * 4);
+
+  srand(1234);
+  for (i = 0; i < NUM_PIXELS * 4; i ++)
+    in[i] = rand();
+
+  for (i = 0; i < 256; i ++)
+  {
+    memset(in + i * 12, i, 12);
+    in[i * 12 + 4] = 0;
+    in[i * 12 + 8] = 0;
+    in[i * 12 + 9] = 0;
+  }
+
+ /*
+  * Test without a color profile...
+  */
+
+  errors += test_conv("cupsImageRGBToCMYK", cupsImageRGBToCMYK, in, 3, 4);
+  errors += test_conv("cupsImageRGBToRGB", cupsImageRGBToRGB, in, 3, 3);
+  errors += test_conv("cupsImageRGBToWhite", cupsImageRGBToWhite, in, 3, 1);
+  errors += test_conv("cupsImageCMYKToRGB", cupsImageCMYKToRGB, in, 4, 3);
+  errors += test_lut(in);
+  errors += test_adjust(in, 150, 30);
+  errors += test_adjust(in, 60, -120);
+
+ /*
+  * Then with a few profiles, including ones with negative terms and
+  * densities over 100%...
+  */
+
+  for (i = 0; i < 3; i ++)
+  {
+    printf("Profile %d:\n", i + 1);
+
+    cupsImageSetRasterColorSpace(CUPS_CSPACE_RGB);
+    cupsImageSetProfile(densities[i][0], densities[i][1], matrices[i]);
+
+    errors += test_conv("cupsImageRGBToCMYK", cupsImageRGBToCMYK, in, 3, 4);
+    errors += test_conv("cupsImageRGBToRGB", cupsImageRGBToRGB, in, 3, 3);
+    errors += test_conv("cupsImageRGBToWhite", cupsImageRGBToWhite, in, 3, 1);
+    errors += test_conv("cupsImageCMYKToRGB", cupsImageCMYKToRGB, in, 4, 3);
+  }
+
+  free(in);
+
+  if (errors)
+  {
+    printf("FAIL: %d tests failed\n", errors);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'test_adjust()' - Compare cupsImageRGBAdjust() with and without SIMD code.
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_adjust(const cups_ib_t *in,	/* I - Input pixels */
+            int             saturation,	/* I - Color saturation (%) */
+            int             hue)	/* I - Color hue (degrees) */
+{
+  int		i;			/* Looping var */
+  cups_ib_t	*scalar,		/* Scalar results */
+		*simd;			/* SIMD results */
+  double	start,			/* Start time */
+		scalar_time,		/* Time for scalar code */
+		simd_time;		/* Time for SIMD code */
+
+
+  scalar = malloc(NUM_PIXELS * 3);
+  simd   = malloc(NUM_PIXELS * 3);
+
+  _cupsImageSetSIMD(0);
+  start = get_time();
+  for (i = 0; i < NUM_REPEAT; i ++)
+  {
+    memcpy(scalar, in, NUM_PIXELS * 3);
+    cupsImageRGBAdjust(scalar, NUM_PIXELS, saturation, hue);
+  }
+  scalar_time = get_time() - start;
+
+  _cupsImageSetSIMD(1);
+  start = get_time();
+  for (i = 0; i < NUM_REPEAT; i ++)
+  {
+    memcpy(simd, in, NUM_PIXELS * 3);
+    cupsImageRGBAdjust(simd, NUM_PIXELS, saturation, hue);
+  }
+  simd_time = get_time() - start;
+
+  i = memcmp(scalar, simd, NUM_PIXELS * 3) != 0;
+
+  printf("    %-22s %s (scalar %.3fs, SIMD %.3fs)\n", "cupsImageRGBAdjust",
+         i ? "FAIL" : "PASS", scalar_time, simd_time);
+
+  free(scalar);
+  free(simd);
+
+  return (i);
+}
+
+
+/*
+ * 'test_conv()' - Compare a conversion with and without SIMD code.
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_conv(const char      *name,	/* I - Name of conversion */
+          conv_cb_t       conv,		/* I - Conversion function */
+          const cups_ib_t *in,		/* I - Input pixels */
+          int             inbpp,	/* I - Input bytes per pixel */
+          int             outbpp)	/* I - Output bytes per pixel */
+{
+  int		i;			/* Looping var */
+  cups_ib_t	*scalar,		/* Scalar results */
+		*simd;			/* SIMD results */
+  double	start,			/* Start time */
+		scalar_time,		/* Time for scalar code */
+		simd_time;		/* Time for SIMD code */
+
+
+  scalar = malloc(NUM_PIXELS * outbpp);
+  simd   = malloc(NUM_PIXELS * outbpp);
+
+  _cupsImageSetSIMD(0);
+  start = get_time();
+  for (i = 0; i < NUM_REPEAT; i ++)
+    (*conv)(in, scalar, NUM_PIXELS);
+  scalar_time = get_time() - start;
+
+  _cupsImageSetSIMD(1);
+  start = get_time();
+  for (i = 0; i < NUM_REPEAT; i ++)
+    (*conv)(in, simd, NUM_PIXELS);
+  simd_time = get_time() - start;
+
+  i = memcmp(scalar, simd, NUM_PIXELS * outbpp) != 0;
+
+ /*
+  * The in-place form used for RGB to RGB must give the same result, too...
+  */
+
+  if (!i && inbpp == outbpp)
+  {
+    memcpy(simd, in, NUM_PIXELS * inbpp);
+    (*conv)(simd, simd, NUM_PIXELS);
+
+    i = memcmp(scalar, simd, NUM_PIXELS * outbpp) != 0;
+  }
+
+  printf("    %-22s %s (scalar %.3fs, SIMD %.3fs)\n", name,
+         i ? "FAIL" : "PASS", scalar_time, simd_time);
+
+  free(scalar);
+  free(simd);
+
+  return (i);
+}
+
+
+/*
+ * 'test_lut()' - Compare cupsImageLut() with and without SIMD code.
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_lut(const cups_ib_t *in)		/* I - Input pixels */
+{
+  int		i;			/* Looping var */
+  cups_ib_t	lut[256],		/* Lookup table */
+		*scalar,		/* Scalar results */
+		*simd;			/* SIMD results */
+  double	start,			/* Start time */
+		scalar_time,		/* Time for scalar code */
+		simd_time;		/* Time for SIMD code */
+
+
+  for (i = 0; i < 256; i ++)
+    lut[i] = rand();
+
+  scalar = malloc(NUM_PIXELS * 3);
+  simd   = malloc(NUM_PIXELS * 3);
+
+  _cupsImageSetSIMD(0);
+  start = get_time();
+  for (i = 0; i < NUM_REPEAT; i ++)
+  {
+    memcpy(scalar, in, NUM_PIXELS * 3);
+    cupsImageLut(scalar, NUM_PIXELS * 3, lut);
+  }
+  scalar_time = get_time() - start;
+
+  _cupsImageSetSIMD(1);
+  start = get_time();
+  for (i = 0; i < NUM_REPEAT; i ++)
+  {
+    memcpy(simd, in, NUM_PIXELS * 3);
+    cupsImageLut(simd, NUM_PIXELS * 3, lut);
+  }
+  simd_time = get_time() - start;
+
+  i = memcmp(scalar, simd, NUM_PIXELS * 3) != 0;
+
+  printf("    %-22s %s (scalar %.3fs, SIMD %.3fs)\n", "cupsImageLut",
+         i ? "FAIL" : "PASS", scalar_time, simd_time);
+
+  free(scalar);
+  free(simd);
+
+  return (i);
+}
@@ -0,0 +1,286 @@
+/*
+ *   Screening test program for CUPS.
+ *
+ *   Checks that the clustered-dot and blue-noise screens reproduce each
+ *   gray level, that rows can be screened in any order, and compares their
+ *   speed with error diffusion.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2005 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()        - Test the screens.
+ *   get_time()    - Get the current time in seconds.
+ *   test_levels() - Check the average level of screened gray ramps.
+ *   test_order()  - Check that rows screened out of order or with a new
+ *                   screen are the same.
+ *   test_speed()  - Time a screen against error diffusion.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "driver.h"
+#include <config.h>
+#include <string.h>
+#include <sys/time.h>
+
+
+/*
+ * Constants...
+ */
+
+#define TEST_SIZE	64		/* Size of the level test area */
+#define SPEED_WIDTH	4800		/* Width of speed test lines */
+#define SPEED_LINES	1000		/* Number of speed test lines */
+
+
+/*
+ * Local functions...
+ */
+
+static double	get_time(void);
+static int	test_levels(const char *name, cups_screen_type_t type,
+		            int num_vals, const float *vals);
+static int	test_order(const char *name, cups_screen_type_t type);
+static void	test_speed(const char *name, cups_screen_type_t type);
+
+
+/*
+ * 'main()' - Test the screens.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int		errors = 0;		/* Number of failed tests */
+  static const float bilevel[2] =	/* Two-level LUT */
+		{ 0.0, 1.0 };
+  static const float multilevel[4] =	/* Four-level LUT, as used for
+					 * variable dot sizes */
+		{ 0.0, 0.25, 0.6, 1.0 };
+
+
+  errors += test_levels("clustered", CUPS_SCREEN_CLUSTERED, 2, bilevel);
+  errors += test_levels("clustered", CUPS_SCREEN_CLUSTERED, 4, multilevel);
+  errors += test_levels("blue-noise", CUPS_SCREEN_BLUENOISE, 2, bilevel);
+  errors += test_levels("blue-noise", CUPS_SCREEN_BLUENOISE, 4, multilevel);
+
+  errors += test_order("clustered", CUPS_SCREEN_CLUSTERED);
+  errors += test_order("blue-noise", CUPS_SCREEN_BLUENOISE);
+
+  test_speed("clustered", CUPS_SCREEN_CLUSTERED);
+  test_speed("blue-noise", CUPS_SCREEN_BLUENOISE);
+
+  if (errors)
+  {
+    printf("FAIL: %d tests failed\n", errors);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'test_levels()' - Check the average level of screened gray ramps.
+ *
+ * Each gray level is screened over a whole number of matrix tiles, so the
+ * average output must match the input to within one threshold step.
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_levels(const char         *name,	/* I - Name of screen */
+            cups_screen_type_t type,	/* I - Type of screen */
+	    int                num_vals,/* I - Number of LUT values */
+	    const float        *vals)	/* I - LUT values */
+{
+  int		x, y,			/* Position in test area */
+		gray,			/* Input gray level */
+		worst;			/* Gray level with the largest error */
+  cups_lut_t	*lut;			/* Lookup table */
+  cups_screen_t	*screen;		/* Screen */
+  short		line[TEST_SIZE];	/* Input line */
+  unsigned char	pixels[TEST_SIZE];	/* Output pixels */
+  double	total,			/* Sum of output levels */
+		error,			/* Error of average */
+		maxerror;		/* Largest error */
+
+
+  lut    = cupsLutNew(num_vals, vals);
+  screen = cupsScreenNew(type, lut, TEST_SIZE, 1);
+
+  for (gray = 0, maxerror = 0.0, worst = 0; gray <= CUPS_MAX_LUT; gray += 13)
+  {
+    for (x = 0; x < TEST_SIZE; x ++)
+      line[x] = gray;
+
+    for (y = 0, total = 0.0; y < TEST_SIZE; y ++)
+    {
+      cupsScreenRow(screen, y, line, 1, pixels);
+
+      for (x = 0; x < TEST_SIZE; x ++)
+        total += vals[pixels[x]];
+    }
+
+    error = fabs(total / (TEST_SIZE * TEST_SIZE) -
+                 (double)gray / CUPS_MAX_LUT * vals[num_vals - 1]);
+
+    if (error > maxerror)
+    {
+      maxerror = error;
+      worst    = gray;
+    }
+  }
+
+ /*
+  * The clustered-dot cell is 8x8, giving 64 steps between levels...
+  */
+
+  x = maxerror > 1.0 / 64.0 + 0.001;
+
+  printf("    %-10s %d levels: %s (largest error %.4f at %d)\n", name,
+         num_vals, x ? "FAIL" : "PASS", maxerror, worst);
+
+  cupsScreenDelete(screen);
+  cupsLutDelete(lut);
+
+  return (x);
+}
+
+
+/*
+ * 'test_order()' - Check that rows screened out of order or with a new
+ *                  screen are the same.
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_order(const char         *name,	/* I - Name of screen */
+           cups_screen_type_t type)	/* I - Type of screen */
+{
+  int		x, y,			/* Position in test area */
+		status;			/* Test status */
+  cups_lut_t	*lut;			/* Lookup table */
+  cups_screen_t	*screen;		/* Screen */
+  short		line[3 * 500];		/* Input line */
+  unsigned char	inorder[100][500],	/* Rows screened in order */
+		pixels[500];		/* Row screened out of order */
+  static const float vals[2] = { 0.0, 1.0 };
+					/* LUT values */
+
+
+  lut    = cupsLutNew(2, vals);
+  screen = cupsScreenNew(type, lut, 500, 2);
+
+  for (x = 0; x < 3 * 500; x ++)
+    line[x] = x * CUPS_MAX_LUT / (3 * 500);
+
+  for (y = 0; y < 100; y ++)
+    cupsScreenLine(screen, line + 1, 3, inorder[y]);
+
+  for (y = 99, status = 0; y >= 0 && !status; y --)
+  {
+    cupsScreenRow(screen, y, line + 1, 3, pixels);
+    status = memcmp(pixels, inorder[y], sizeof(pixels)) != 0;
+  }
+
+  printf("    %-10s row order: %s\n", name, status ? "FAIL" : "PASS");
+
+  cupsScreenDelete(screen);
+
+ /*
+  * The matrix is shared, so a new screen must still work after the first
+  * one was deleted and give the same rows...
+  */
+
+  screen = cupsScreenNew(type, lut, 500, 2);
+
+  for (y = 0; y < 100 && !status; y ++)
+  {
+    cupsScreenLine(screen, line + 1, 3, pixels);
+    status = memcmp(pixels, inorder[y], sizeof(pixels)) != 0;
+  }
+
+  printf("    %-10s new screen: %s\n", name, status ? "FAIL" : "PASS");
+
+  cupsScreenDelete(screen);
+  cupsLutDelete(lut);
+
+  return (status);
+}
+
+
+/*
+ * 'test_speed()' - Time a screen against error diffusion.
+ */
+
+static void
+test_speed(const char         *name,	/* I - Name of screen */
+           cups_screen_type_t type)	/* I - Type of screen */
+{
+  int		x, y;			/* Position in image */
+  cups_lut_t	*lut;			/* Lookup table */
+  cups_dither_t	*dither;		/* Error diffusion state */
+  cups_screen_t	*screen;		/* Screen */
+  short		*line;			/* Input line */
+  unsigned char	*pixels;		/* Output pixels */
+  double	start,			/* Start time */
+		dither_time,		/* Time for error diffusion */
+		screen_time;		/* Time for screen */
+  static const float vals[2] = { 0.0, 1.0 };
+					/* LUT values */
+
+
+  lut    = cupsLutNew(2, vals);
+  line   = malloc(SPEED_WIDTH * 4 * sizeof(short));
+  pixels = malloc(SPEED_WIDTH);
+
+  for (x = 0; x < SPEED_WIDTH * 4; x ++)
+    line[x] = x * CUPS_MAX_LUT / (SPEED_WIDTH * 4);
+
+  dither = cupsDitherNew(SPEED_WIDTH);
+  start  = get_time();
+  for (y = 0; y < SPEED_LINES; y ++)
+    cupsDitherLine(dither, lut, line, 4, pixels);
+  dither_time = get_time() - start;
+  cupsDitherDelete(dither);
+
+  start  = get_time();
+  screen = cupsScreenNew(type, lut, SPEED_WIDTH, 0);
+  for (y = 0; y < SPEED_LINES; y ++)
+    cupsScreenLine(screen, line, 4, pixels);
+  screen_time = get_time() - start;
+  cupsScreenDelete(screen);
+
+  printf("    %-10s %dx%d: error diffusion %.3fs, screen %.3fs\n", name,
+         SPEED_WIDTH, SPEED_LINES, dither_time, screen_time);
+
+  free(line);
+  free(pixels);
+  cupsLutDelete(lut);
+}
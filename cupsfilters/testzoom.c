@@ -0,0 +1,431 @@
+/*
+ *   Image zoom test program for CUPS.
+ *
+ *   Compares the table-driven zoom code with the Bresenham stepping it
+ *   replaced, for enlarged and reduced, mirrored and rotated images,
+ *   including the first and last rows and columns.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2006 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Zoom a test image in different ways and check the rows.
+ *   cubic()      - Compute the Catmull-Rom bicubic weight.
+ *   level()      - Round and clamp a weighted sum to a pixel value.
+ *   old_zoom()   - Scale a row like the old zoom_nearest() and
+ *                  zoom_bilinear().
+ *   pixel()      - Compute the test pattern value of a pixel.
+ *   test_best()  - Check bicubic zooming against a floating point
+ *                  reference.
+ *   test_zoom()  - Check nearest-neighbor or bilinear zooming against the
+ *                  old code.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+
+
+/*
+ * Test image size...
+ */
+
+#define WIDTH	101
+#define HEIGHT	67
+
+
+/*
+ * Local functions...
+ */
+
+static double		cubic(double x);
+static void		old_zoom(const cups_ib_t *in, int width, int xsize,
+			         int flip, int bilinear, cups_ib_t *r);
+static int		level(double v);
+static cups_ib_t	pixel(int x, int y, int c);
+static int		test_best(cups_image_t *img, int xsize, int ysize);
+static int		test_zoom(cups_image_t *img, cups_iztype_t type,
+			          int xsize, int ysize, int flip, int rotated);
+
+
+/*
+ * 'main()' - Zoom a test image in different ways and check the rows.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int		x, y, c;		/* Current coordinate and channel */
+  int		i,			/* Looping var */
+		flip,			/* Mirror the image? */
+		rotated,		/* Rotate the image? */
+		errors;			/* Number of failed tests */
+  char		filename[1024];		/* Temporary PPM file */
+  int		fd;			/* File descriptor of PPM file */
+  FILE		*fp;			/* PPM file */
+  cups_image_t	*img;			/* Image */
+  static const int sizes[][2] =		/* Output sizes to test */
+  {
+    { WIDTH, HEIGHT },			/* Same size */
+    { 3 * WIDTH + 7, 2 * HEIGHT + 5 },	/* Enlarged */
+    { WIDTH / 3, HEIGHT / 2 },		/* Reduced */
+    { WIDTH - 1, HEIGHT + 1 },		/* Almost the same size */
+    { 1, 1 }				/* A single pixel */
+  };
+
+
+ /*
+  * Write a test pattern to a temporary PPM file...
+  */
+
+  if ((fd = cupsTempFd(filename, sizeof(filename))) < 0 ||
+      (fp = fdopen(fd, "wb")) == NULL)
+  {
+    perror("testzoom");
+    return (1);
+  }
+
+  fprintf(fp, "P6\n%d %d\n255\n", WIDTH, HEIGHT);
+
+  for (y = 0; y < HEIGHT; y ++)
+    for (x = 0; x < WIDTH; x ++)
+      for (c = 0; c < 3; c ++)
+        putc(pixel(x, y, c), fp);
+
+  fclose(fp);
+
+  img = cupsImageOpen(filename, CUPS_IMAGE_RGB, CUPS_IMAGE_RGB, 100, 0, NULL);
+  unlink(filename);
+
+  if (!img)
+  {
+    perror(filename);
+    return (1);
+  }
+
+ /*
+  * Zoom it...
+  */
+
+  errors = 0;
+
+  for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i ++)
+  {
+    for (rotated = 0; rotated < 2; rotated ++)
+      for (flip = 0; flip < 2; flip ++)
+      {
+	errors += test_zoom(img, CUPS_IZOOM_FAST, sizes[i][0], sizes[i][1],
+	                    flip, rotated);
+	errors += test_zoom(img, CUPS_IZOOM_NORMAL, sizes[i][0], sizes[i][1],
+	                    flip, rotated);
+      }
+
+    errors += test_best(img, sizes[i][0], sizes[i][1]);
+  }
+
+  cupsImageClose(img);
+
+  if (errors)
+  {
+    printf("FAIL: %d tests failed\n", errors);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
+
+
+/*
+ * 'cubic()' - Compute the Catmull-Rom bicubic weight.
+ */
+
+static double				/* O - Weight */
+cubic(double x)				/* I - Distance from sample */
+{
+  x = fabs(x);
+
+  if (x < 1.0)
+    return (1.5 * x * x * x - 2.5 * x * x + 1.0);
+  else if (x < 2.0)
+    return (-0.5 * x * x * x + 2.5 * x * x - 4.0 * x + 2.0);
+  else
+    return (0.0);
+}
+
+
+/*
+ * 'level()' - Round and clamp a weighted sum to a pixel value.
+ */
+
+static int				/* O - Pixel value */
+level(double v)				/* I - Weighted sum */
+{
+  if (v < 0.0)
+    return (0);
+  else if (v > 255.0)
+    return (255);
+  else
+    return ((int)floor(v + 0.5));
+}
+
+
+/*
+ * 'old_zoom()' - Scale a row like the old zoom_nearest() and
+ *                zoom_bilinear().
+ *
+ * The old code read one pixel past the end of a cropped row and blended
+ * mirrored rows with the wrong neighbor; here the last pixel is repeated
+ * and mirrored rows blend with the next pixel in output order, as the new
+ * code does.
+ */
+
+static void
+old_zoom(const cups_ib_t *in,		/* I - Input row */
+         int             width,		/* I - Number of input pixels */
+	 int             xsize,		/* I - Number of output pixels */
+	 int             flip,		/* I - Mirror the row? */
+	 int             bilinear,	/* I - Interpolate? */
+	 cups_ib_t       *r)		/* O - Scaled row */
+{
+  int		x, count,		/* Looping vars */
+		ix,			/* Input pixel */
+		xerr0, xerr1,		/* Bresenham error counters */
+		xmod, xstep;		/* Bresenham steps */
+  const cups_ib_t *p0, *p1;		/* Input pixel and its neighbor */
+
+
+  xmod  = width % xsize;
+  xstep = width / xsize;
+
+  for (x = xsize, xerr0 = xsize, xerr1 = 0, ix = 0; x > 0; x --)
+  {
+    p0 = in + 3 * (flip ? width - 1 - ix : ix);
+    p1 = ix < width - 1 ? p0 + (flip ? -3 : 3) : p0;
+
+    for (count = 0; count < 3; count ++)
+      if (bilinear)
+        *r++ = (p0[count] * xerr0 + p1[count] * xerr1) / xsize;
+      else
+        *r++ = p0[count];
+
+    ix    += xstep;
+    xerr0 -= xmod;
+    xerr1 += xmod;
+
+    if (xerr0 <= 0)
+    {
+      xerr0 += xsize;
+      xerr1 -= xsize;
+      ix ++;
+    }
+  }
+}
+
+
+/*
+ * 'pixel()' - Compute the test pattern value of a pixel.
+ */
+
+static cups_ib_t			/* O - Pixel value */
+pixel(int x,				/* I - Column */
+      int y,				/* I - Row */
+      int c)				/* I - Channel */
+{
+  if (c == 0)
+    return ((cups_ib_t)(x * 255 / (WIDTH - 1)));	/* Horizontal ramp */
+  else if (c == 1)
+    return ((cups_ib_t)(y * 255 / (HEIGHT - 1)));	/* Vertical ramp */
+  else
+    return ((x / 4 + y / 3) & 1 ? 255 : 0);		/* Sharp edges */
+}
+
+
+/*
+ * 'test_best()' - Check bicubic zooming against a floating point reference.
+ *
+ * Every input pixel within two (stretched, when reducing) pixels of the
+ * output pixel's position contributes, with pixels past the edges repeating
+ * the edge pixels.  Like the zoom code, the rows are scaled horizontally to
+ * whole levels first; the fixed-point weights may then still make a
+ * difference of one level...
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_best(cups_image_t *img,		/* I - Image */
+          int          xsize,		/* I - Output width */
+	  int          ysize)		/* I - Output height */
+{
+  int		x, y, c,		/* Output pixel */
+		ix, iy,			/* Input pixel */
+		diff,			/* Difference to the reference */
+		maxdiff;		/* Biggest difference */
+  double	xcenter, ycenter,	/* Position in the input */
+		xstretch, ystretch,	/* Filter stretch for reductions */
+		wx, wy,			/* Weights */
+		hsum, htotal,		/* Horizontal sum and total weight */
+		sum, total;		/* Vertical sum and total weight */
+  cups_izoom_t	*z;			/* Zoom record */
+  cups_ib_t	*r;			/* Output line */
+
+
+  if ((z = _cupsImageZoomNew(img, 0, 0, WIDTH - 1, HEIGHT - 1, xsize, ysize,
+                             0, CUPS_IZOOM_BEST)) == NULL)
+  {
+    printf("bicubic %dx%d: _cupsImageZoomNew failed\n", xsize, ysize);
+    return (1);
+  }
+
+  xstretch = xsize < WIDTH ? (double)WIDTH / xsize : 1.0;
+  ystretch = ysize < HEIGHT ? (double)HEIGHT / ysize : 1.0;
+
+  if (xstretch > 16.0)
+    xstretch = 16.0;
+  if (ystretch > 16.0)
+    ystretch = 16.0;
+
+  for (y = 0, maxdiff = 0; y < ysize; y ++)
+  {
+    _cupsImageZoomLine(z, y);
+    r = z->rows[z->row];
+
+    ycenter = (double)y * HEIGHT / ysize;
+
+    for (x = 0; x < xsize; x ++)
+    {
+      xcenter = (double)x * WIDTH / xsize;
+
+      for (c = 0; c < 3; c ++)
+      {
+	for (iy = (int)floor(ycenter - 2.0 * ystretch), sum = total = 0.0;
+	     iy <= ycenter + 2.0 * ystretch;
+	     iy ++)
+	{
+	  if ((wy = cubic((iy - ycenter) / ystretch)) == 0.0)
+	    continue;
+
+	  for (ix = (int)floor(xcenter - 2.0 * xstretch), hsum = htotal = 0.0;
+	       ix <= xcenter + 2.0 * xstretch;
+	       ix ++)
+	  {
+	    wx     = cubic((ix - xcenter) / xstretch);
+	    hsum   += wx * pixel(ix < 0 ? 0 : ix < WIDTH ? ix : WIDTH - 1,
+	                         iy < 0 ? 0 : iy < HEIGHT ? iy : HEIGHT - 1, c);
+	    htotal += wx;
+	  }
+
+	  sum   += wy * level(hsum / htotal);
+	  total += wy;
+	}
+
+	diff = abs(r[3 * x + c] - level(sum / total));
+
+	if (diff > maxdiff)
+	  maxdiff = diff;
+      }
+    }
+  }
+
+  _cupsImageZoomDelete(z);
+
+  if (maxdiff > 1)
+  {
+    printf("bicubic %dx%d: differs by up to %d\n", xsize, ysize, maxdiff);
+    return (1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'test_zoom()' - Check nearest-neighbor or bilinear zooming against the
+ *                 old code.
+ *
+ * Nearest-neighbor rows must be identical; bilinear rows may only differ
+ * by one level since the weights are now rounded instead of truncated,
+ * except for the first column, which is always an input pixel.  Rows past
+ * the end of the image repeat the last row.
+ */
+
+static int				/* O - 1 on failure, 0 on success */
+test_zoom(cups_image_t  *img,		/* I - Image */
+          cups_iztype_t type,		/* I - Zoom type */
+          int           xsize,		/* I - Output width */
+	  int           ysize,		/* I - Output height */
+	  int           flip,		/* I - Mirror the image? */
+	  int           rotated)	/* I - Rotate the image? */
+{
+  int		iy, x,			/* Looping vars */
+		width,			/* Input pixels per row */
+		height,			/* Input rows */
+		diff,			/* Difference to the old code */
+		maxdiff,		/* Biggest difference */
+		edges;			/* Differences in the first column */
+  cups_izoom_t	*z;			/* Zoom record */
+  cups_ib_t	in[3 * (WIDTH + HEIGHT)],
+					/* Input row */
+		old[3 * 4 * (WIDTH + HEIGHT)],
+					/* Row scaled by the old code */
+		*r;			/* Row scaled by the new code */
+
+
+  if ((z = _cupsImageZoomNew(img, 0, 0, WIDTH - 1, HEIGHT - 1,
+                             flip ? -xsize : xsize, ysize, rotated,
+			     type)) == NULL)
+  {
+    printf("%s %dx%d%s%s: _cupsImageZoomNew failed\n",
+           type == CUPS_IZOOM_FAST ? "nearest" : "bilinear", xsize, ysize,
+	   flip ? " mirrored" : "", rotated ? " rotated" : "");
+    return (1);
+  }
+
+  width  = rotated ? HEIGHT : WIDTH;
+  height = rotated ? WIDTH : HEIGHT;
+
+  for (iy = 0, maxdiff = 0, edges = 0; iy <= height + 1; iy ++)
+  {
+    _cupsImageZoomFill(z, iy);
+    r = z->rows[z->row];
+
+    if (rotated)
+      cupsImageGetCol(img, WIDTH - 1 - (iy < height ? iy : height - 1), 0,
+                      width, in);
+    else
+      cupsImageGetRow(img, 0, iy < height ? iy : height - 1, width, in);
+
+    old_zoom(in, width, xsize, flip, type != CUPS_IZOOM_FAST, old);
+
+    for (x = 0; x < 3 * xsize; x ++)
+    {
+      diff = abs(r[x] - old[x]);
+
+      if (diff > maxdiff)
+        maxdiff = diff;
+
+      if (diff && x < 3)
+        edges ++;
+    }
+  }
+
+  _cupsImageZoomDelete(z);
+
+  if (maxdiff > (type == CUPS_IZOOM_FAST ? 0 : 1) || edges)
+  {
+    printf("%s %dx%d%s%s: differs by up to %d (%d in the first column)\n",
+           type == CUPS_IZOOM_FAST ? "nearest" : "bilinear", xsize, ysize,
+	   flip ? " mirrored" : "", rotated ? " rotated" : "", maxdiff, edges);
+    return (1);
+  }
+
+  return (0);
+}
@@ -24,6 +24,9 @@
  *   format_YMCK()   - Convert image data to YMCK.
  *   make_lut()      - Make a lookup table given gamma and brightness values.
  *   raster_cb()     - Validate the page header.
+ *   render_band()   - Format a band of raster lines.
+ *   render_thread() - Format bands of raster lines in a worker thread.
+ *   write_image()   - Format and write the image data of a plane.
  */
 
 /*
@@ -38,6 +41,50 @@
 #include <math.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/time.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Constants...
+ */
+
+#define RENDER_BAND_HEIGHT	32	/* Lines per band */
+#define RENDER_MAX_THREADS	32	/* Maximum number of render threads */
+
+
+/*
+ * Types...
+ */
+
+typedef struct render_s			/**** Banded renderer state ****/
+{
+  cups_page_header2_t	*header;	/* Page header */
+  cups_image_t		*img;		/* Image to render */
+  cups_izoom_t		*z;		/* Zoom record for the main thread */
+  int			xc0, yc0,	/* Corners of the page in image coords */
+			xc1, yc1,
+			xsize,		/* Zoomed width (negative to flip) */
+			ysize,		/* Zoomed height */
+			rotated,	/* Non-zero if image is rotated */
+			plane;		/* Current color plane */
+  cups_iztype_t		zoom_type;	/* Image zoom type */
+  int			num_bands,	/* Number of bands */
+			*band_iy,	/* Image row at start of each band */
+			*band_yerr0;	/* Top Y error at start of each band */
+  int			num_buffers;	/* Number of band buffers */
+  unsigned char		**buffers;	/* Band buffers */
+  int			*buffer_band;	/* Band last rendered into each buffer */
+  int			next_band,	/* Next band to render */
+			written,	/* Number of bands written */
+			error;		/* Non-zero if rendering failed */
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t	lock;		/* Lock for the fields above */
+  pthread_cond_t	cond;		/* Signalled when a band is done */
+#endif /* HAVE_PTHREAD_H */
+} render_t;
 
 
 /*
@@ -48,7 +95,8 @@ int	Flip = 0,			/* Flip/mirror pages */
 	XPosition = 0,			/* Horizontal position on page */
 	YPosition = 0,			/* Vertical position on page */
 	Collate = 0,			/* Collate copies? */
-	Copies = 1;			/* Number of copies */
+	Copies = 1,			/* Number of copies */
+	NumThreads = 1;			/* Number of render threads */
 int	Floyd16x16[16][16] =		/* Traditional Floyd ordered dither */
 	{
 	  { 0,   128, 32,  160, 8,   136, 40,  168,
@@ -124,6 +172,9 @@ static void	format_YMC(cups_page_header2_t *header, unsigned char *row, int y, i
 static void	format_YMCK(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
 static void	make_lut(cups_ib_t *, int, float, float);
 static int	raster_cb(cups_page_header2_t *header, int preferred_bits);
+static void	render_band(render_t *r, cups_izoom_t *z, int band, unsigned char *buffer);
+static void	*render_thread(void *data);
+static int	write_image(render_t *r, cups_raster_t *ras);
 
 
 /*
@@ -176,15 +227,14 @@ main(int  argc,				/* I - Number of command-line arguments */
   cups_iztype_t		zoom_type;	/* Image zoom type */
   int			primary,	/* Primary image colorspace */
 			secondary;	/* Secondary image colorspace */
-  cups_ib_t		*row,		/* Current row */
-			*r0,		/* Top row */
-			*r1;		/* Bottom row */
-  int			y,		/* Current Y coordinate on page */
-			iy,		/* Current Y coordinate in image */
-			last_iy,	/* Previous Y coordinate in image */
-			yerr0,		/* Top Y error value */
-			yerr1;		/* Bottom Y error value */
+  cups_ib_t		*row;		/* Current row */
+  int			y;		/* Current Y coordinate on page */
+  render_t		render;		/* Banded renderer state */
+  struct timeval	start,		/* Start time of page */
+			end;		/* End time of page */
+  ppd_attr_t		*attr;		/* PPD attribute */
   cups_ib_t		lut[256];	/* Gamma/brightness LUT */
+  const cups_ib_t	*lutptr;	/* LUT to use when loading or NULL */
   int			plane,		/* Current color plane */
 			num_planes;	/* Number of color planes */
   char			filename[1024];	/* Name of file to print */
@@ -466,6 +516,32 @@ main(int  argc,				/* I - Number of command-line arguments */
               !strcasecmp(val, "yes")))
     Flip = 1;
 
+ /*
+  * Number of threads for formatting the raster lines, from the job, the
+  * PPD file, the RIP_THREADS environment variable or the number of CPUs...
+  */
+
+  if ((val = cupsGetOption("render-threads", num_options, options)) != NULL)
+    NumThreads = atoi(val);
+  else if ((attr = ppdFindAttr(ppd, "cupsRenderThreads", NULL)) != NULL &&
+           attr->value)
+    NumThreads = atoi(attr->value);
+  else if ((val = getenv("RIP_THREADS")) != NULL)
+    NumThreads = atoi(val);
+  else
+    NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (NumThreads < 1)
+    NumThreads = 1;
+  else if (NumThreads > RENDER_MAX_THREADS)
+    NumThreads = RENDER_MAX_THREADS;
+
+#ifndef HAVE_PTHREAD_H
+  NumThreads = 1;
+#endif /* !HAVE_PTHREAD_H */
+
+  fprintf(stderr, "DEBUG: Using %d render threads.\n", NumThreads);
+
  /*
   * Set the needed options in the page header...
   */
@@ -688,9 +764,24 @@ main(int  argc,				/* I - Number of command-line arguments */
   if (header.cupsColorSpace == CUPS_CSPACE_CIEXYZ ||
       header.cupsColorSpace == CUPS_CSPACE_CIELab ||
       header.cupsColorSpace >= CUPS_CSPACE_ICC1)
-    img = cupsImageOpen(filename, primary, secondary, sat, hue, NULL);
+    lutptr = NULL;
   else
-    img = cupsImageOpen(filename, primary, secondary, sat, hue, lut);
+    lutptr = lut;
+
+ /*
+  * Decode the image while it is printed instead of loading it first.  A
+  * single copy is usually printed in one pass from top to bottom, so only
+  * keep the rows that are needed; the image library loads the whole image
+  * anyway if we go back.  Such images can only be read by one thread, so
+  * fill the tile cache in the background when the bands are formatted on
+  * several threads or there are more copies.  The pixels are only decoded
+  * once cupsImageSetMinSize() is called below...
+  */
+
+  img = cupsImageOpenStream(filename, primary, secondary, sat, hue, lutptr,
+                            (Copies == 1 && NumThreads == 1) ?
+			        CUPS_IMAGE_STREAM_ROWS :
+				CUPS_IMAGE_STREAM_FILL);
 
   if (argc == 6)
     unlink(filename);
@@ -1142,10 +1233,13 @@ main(int  argc,				/* I - Number of command-line arguments */
   else
     num_planes = 1;
 
-  if (header.cupsBitsPerColor >= 8)
-    zoom_type = CUPS_IZOOM_NORMAL;
-  else
+  if (header.cupsBitsPerColor < 8)
     zoom_type = CUPS_IZOOM_FAST;
+  else if ((val = cupsGetOption("print-quality", num_options,
+                                options)) != NULL && atoi(val) == 5)
+    zoom_type = CUPS_IZOOM_BEST;	/* Bicubic for high quality */
+  else
+    zoom_type = CUPS_IZOOM_NORMAL;
 
  /*
   * See if we need to collate, and if so how we need to do it...
@@ -1197,6 +1291,36 @@ main(int  argc,				/* I - Number of command-line arguments */
         break;
   }
 
+ /*
+  * Images that are much larger than needed for the printed size can be
+  * decoded at a reduced size, which saves most of the decoding and scaling
+  * time for camera photos...
+  */
+
+  if (Orientation & 1)
+  {
+    xtemp = header.HWResolution[1] * xprint * ypages;
+    ytemp = header.HWResolution[0] * yprint * xpages;
+  }
+  else
+  {
+    xtemp = header.HWResolution[0] * xprint * xpages;
+    ytemp = header.HWResolution[1] * yprint * ypages;
+  }
+
+  switch (cupsImageSetMinSize(img, (unsigned)xtemp, (unsigned)ytemp))
+  {
+    case -1 :
+	fputs("ERROR: The print file could not be opened.\n", stderr);
+	ppdClose(ppd);
+	return (1);
+
+    case 1 :
+	fprintf(stderr, "DEBUG: Decoding image at %ux%u for %dx%d pixels\n",
+		img->xsize, img->ysize, xtemp, ytemp);
+	break;
+  }
+
  /*
   * Output the pages...
   */
@@ -1242,6 +1366,8 @@ main(int  argc,				/* I - Number of command-line arguments */
 
         cupsRasterWriteHeader2(ras, &header);
 
+        gettimeofday(&start, NULL);
+
         for (plane = 0; plane < num_planes; plane ++)
 	{
 	 /*
@@ -1286,109 +1412,37 @@ main(int  argc,				/* I - Number of command-line arguments */
 	  * Then write image data...
 	  */
 
-	  for (y = z->ysize, yerr0 = 0, yerr1 = z->ysize, iy = 0, last_iy = -2;
-               y > 0;
-               y --)
+          render.header    = &header;
+          render.img       = img;
+          render.z         = z;
+          render.xc0       = xc0;
+          render.yc0       = yc0;
+          render.xc1       = xc1;
+          render.yc1       = yc1;
+          render.xsize     = Flip ? -xtemp : xtemp;
+          render.ysize     = ytemp;
+          render.rotated   = Orientation & 1;
+          render.plane     = plane;
+          render.zoom_type = zoom_type;
+
+          if (write_image(&render, ras))
 	  {
-	    if (iy != last_iy)
-	    {
-	      if (zoom_type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
-        	_cupsImageZoomFill(z, iy);
-
-              _cupsImageZoomFill(z, iy + z->yincr);
-
-              last_iy = iy;
-	    }
-
-           /*
-	    * Format this line of raster data for the printer...
-	    */
-
-    	    blank_line(&header, row);
+	    fputs("ERROR: Unable to send raster data to the driver.\n",
+		  stderr);
+	    cupsImageClose(img);
+	    exit(1);
+	  }
 
-            r0 = z->rows[z->row];
-            r1 = z->rows[1 - z->row];
+         /*
+	  * The image is decoded while it is printed, so a damaged file only
+	  * shows up now...
+	  */
 
-            switch (header.cupsColorSpace)
-	    {
-	      case CUPS_CSPACE_W :
-	          format_W(&header, row, y, plane, z->xsize, z->ysize,
-		           yerr0, yerr1, r0, r1);
-		  break;
-              default :
-	      case CUPS_CSPACE_RGB :
-	          format_RGB(&header, row, y, plane, z->xsize, z->ysize,
-		             yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_RGBA :
-	      case CUPS_CSPACE_RGBW :
-	          format_RGBA(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_K :
-	      case CUPS_CSPACE_WHITE :
-	      case CUPS_CSPACE_GOLD :
-	      case CUPS_CSPACE_SILVER :
-	          format_K(&header, row, y, plane, z->xsize, z->ysize,
-		           yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_CMY :
-	          format_CMY(&header, row, y, plane, z->xsize, z->ysize,
-		             yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_YMC :
-	          format_YMC(&header, row, y, plane, z->xsize, z->ysize,
-		             yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_CMYK :
-	          format_CMYK(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_YMCK :
-	      case CUPS_CSPACE_GMCK :
-	      case CUPS_CSPACE_GMCS :
-	          format_YMCK(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_KCMYcm :
-	          if (header.cupsBitsPerColor == 1)
-		  {
-	            format_KCMYcm(&header, row, y, plane, z->xsize, z->ysize,
-		                  yerr0, yerr1, r0, r1);
-		    break;
-		  }
-	      case CUPS_CSPACE_KCMY :
-	          format_KCMY(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	    }
-
-           /*
-	    * Write the raster data to the driver...
-	    */
-
-	    if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
-	                              header.cupsBytesPerLine)
-	    {
-	      fputs("ERROR: Unable to send raster data to the driver.\n",
-	            stderr);
-	      cupsImageClose(img);
-	      exit(1);
-	    }
-
-           /*
-	    * Compute the next scanline in the image...
-	    */
-
-	    iy    += z->ystep;
-	    yerr0 += z->ymod;
-	    yerr1 -= z->ymod;
-	    if (yerr1 <= 0)
-	    {
-              yerr0 -= z->ysize;
-              yerr1 += z->ysize;
-              iy    += z->yincr;
-	    }
+	  if (_cupsImageGetError(img))
+	  {
+	    fputs("ERROR: The print file could not be read.\n", stderr);
+	    cupsImageClose(img);
+	    exit(1);
 	  }
 
          /*
@@ -1424,6 +1478,13 @@ main(int  argc,				/* I - Number of command-line arguments */
 
           _cupsImageZoomDelete(z);
         }
+
+        gettimeofday(&end, NULL);
+
+        fprintf(stderr, "DEBUG: Formatted page %d in %.3f seconds using %d "
+			"threads.\n", page,
+		end.tv_sec - start.tv_sec +
+		0.000001 * (end.tv_usec - start.tv_usec), NumThreads);
       }
 
  /*
@@ -4391,3 +4452,400 @@ raster_cb(
   return (0);
 }
 
+
+
+/*
+ * 'render_band()' - Format a band of raster lines.
+ */
+
+static void
+render_band(render_t      *r,		/* I - Renderer state */
+            cups_izoom_t  *z,		/* I - Zoom record to use */
+            int           band,		/* I - Band number */
+	    unsigned char *buffer)	/* O - Raster lines */
+{
+  cups_page_header2_t	*header = r->header;
+					/* Page header */
+  int			count,		/* Lines left in band */
+			y,		/* Current Y coordinate on page */
+			iy,		/* Current Y coordinate in image */
+			last_iy,	/* Previous Y coordinate in image */
+			yerr0,		/* Top Y error value */
+			yerr1;		/* Bottom Y error value */
+  cups_ib_t		*r0,		/* Top row */
+			*r1;		/* Bottom row */
+  unsigned char		*row;		/* Current raster line */
+
+
+ /*
+  * Start with the image position computed for this band; the zoom record
+  * is filled from scratch, so bands do not depend on each other...
+  */
+
+  y       = z->ysize - band * RENDER_BAND_HEIGHT;
+  count   = y < RENDER_BAND_HEIGHT ? y : RENDER_BAND_HEIGHT;
+  iy      = r->band_iy[band];
+  yerr0   = r->band_yerr0[band];
+  yerr1   = z->ysize - yerr0;
+  last_iy = -2;
+
+  for (row = buffer; count > 0; count --, y --, row += header->cupsBytesPerLine)
+  {
+    if (r->zoom_type == CUPS_IZOOM_BEST)
+    {
+     /*
+      * Bicubic zooming does the vertical interpolation as well, so both
+      * rows passed to the format functions are the finished line...
+      */
+
+      _cupsImageZoomLine(z, z->ysize - y);
+    }
+    else if (iy != last_iy)
+    {
+      if (r->zoom_type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
+	_cupsImageZoomFill(z, iy);
+
+      _cupsImageZoomFill(z, iy + z->yincr);
+
+      last_iy = iy;
+    }
+
+   /*
+    * Format this line of raster data for the printer...
+    */
+
+    blank_line(header, row);
+
+    r0 = z->rows[z->row];
+
+    if (r->zoom_type == CUPS_IZOOM_BEST)
+      r1 = r0;
+    else
+      r1 = z->rows[1 - z->row];
+
+    switch (header->cupsColorSpace)
+    {
+      case CUPS_CSPACE_W :
+	  format_W(header, row, y, r->plane, z->xsize, z->ysize,
+		   yerr0, yerr1, r0, r1);
+	  break;
+      default :
+      case CUPS_CSPACE_RGB :
+	  format_RGB(header, row, y, r->plane, z->xsize, z->ysize,
+		     yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_RGBA :
+      case CUPS_CSPACE_RGBW :
+	  format_RGBA(header, row, y, r->plane, z->xsize, z->ysize,
+		      yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_K :
+      case CUPS_CSPACE_WHITE :
+      case CUPS_CSPACE_GOLD :
+      case CUPS_CSPACE_SILVER :
+	  format_K(header, row, y, r->plane, z->xsize, z->ysize,
+		   yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_CMY :
+	  format_CMY(header, row, y, r->plane, z->xsize, z->ysize,
+		     yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_YMC :
+	  format_YMC(header, row, y, r->plane, z->xsize, z->ysize,
+		     yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_CMYK :
+	  format_CMYK(header, row, y, r->plane, z->xsize, z->ysize,
+		      yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_YMCK :
+      case CUPS_CSPACE_GMCK :
+      case CUPS_CSPACE_GMCS :
+	  format_YMCK(header, row, y, r->plane, z->xsize, z->ysize,
+		      yerr0, yerr1, r0, r1);
+	  break;
+      case CUPS_CSPACE_KCMYcm :
+	  if (header->cupsBitsPerColor == 1)
+	  {
+	    format_KCMYcm(header, row, y, r->plane, z->xsize, z->ysize,
+			  yerr0, yerr1, r0, r1);
+	    break;
+	  }
+      case CUPS_CSPACE_KCMY :
+	  format_KCMY(header, row, y, r->plane, z->xsize, z->ysize,
+		      yerr0, yerr1, r0, r1);
+	  break;
+    }
+
+   /*
+    * Compute the next scanline in the image...
+    */
+
+    iy    += z->ystep;
+    yerr0 += z->ymod;
+    yerr1 -= z->ymod;
+    if (yerr1 <= 0)
+    {
+      yerr0 -= z->ysize;
+      yerr1 += z->ysize;
+      iy    += z->yincr;
+    }
+  }
+}
+
+
+/*
+ * 'render_thread()' - Format bands of raster lines in a worker thread.
+ *
+ * Bands are taken in order; a thread waits when all band buffers are still
+ * waiting to be written.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+render_thread(void *data)		/* I - Renderer state */
+{
+#ifdef HAVE_PTHREAD_H
+  render_t	*r = (render_t *)data;	/* Renderer state */
+  cups_izoom_t	*z;			/* Zoom record for this thread */
+  int		band;			/* Current band */
+
+
+  if ((z = _cupsImageZoomNew(r->img, r->xc0, r->yc0, r->xc1, r->yc1,
+                             r->xsize, r->ysize, r->rotated,
+			     r->zoom_type)) == NULL)
+  {
+    pthread_mutex_lock(&r->lock);
+    r->error = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    return (NULL);
+  }
+
+  for (;;)
+  {
+    pthread_mutex_lock(&r->lock);
+
+    while (!r->error && r->next_band < r->num_bands &&
+           r->next_band >= r->written + r->num_buffers)
+      pthread_cond_wait(&r->cond, &r->lock);
+
+    if (r->error || r->next_band >= r->num_bands)
+    {
+      pthread_mutex_unlock(&r->lock);
+      break;
+    }
+
+    band = r->next_band ++;
+
+    pthread_mutex_unlock(&r->lock);
+
+    render_band(r, z, band, r->buffers[band % r->num_buffers]);
+
+    pthread_mutex_lock(&r->lock);
+    r->buffer_band[band % r->num_buffers] = band;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+  }
+
+  _cupsImageZoomDelete(z);
+
+#else
+  (void)data;
+#endif /* HAVE_PTHREAD_H */
+
+  return (NULL);
+}
+
+
+/*
+ * 'write_image()' - Format and write the image data of a plane.
+ *
+ * The image is split into bands of RENDER_BAND_HEIGHT lines.  With more than
+ * one thread the bands are formatted by worker threads into a ring of band
+ * buffers, while this thread writes them to the raster stream in order.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_image(render_t      *r,		/* I - Renderer state */
+            cups_raster_t *ras)		/* I - Raster stream */
+{
+  cups_izoom_t	*z = r->z;		/* Zoom record */
+  int		i,			/* Looping var */
+		band,			/* Current band */
+		count,			/* Lines in band */
+		iy,			/* Current Y coordinate in image */
+		yerr0,			/* Top Y error value */
+		yerr1,			/* Bottom Y error value */
+		num_threads,		/* Number of worker threads */
+		status;			/* Return status */
+  unsigned char	*row;			/* Current raster line */
+#ifdef HAVE_PTHREAD_H
+  pthread_t	threads[RENDER_MAX_THREADS];
+					/* Worker threads */
+#endif /* HAVE_PTHREAD_H */
+
+
+ /*
+  * Compute the image position at the start of each band...
+  */
+
+  r->num_bands = (z->ysize + RENDER_BAND_HEIGHT - 1) / RENDER_BAND_HEIGHT;
+
+  if ((r->band_iy = calloc(r->num_bands, sizeof(int))) == NULL ||
+      (r->band_yerr0 = calloc(r->num_bands, sizeof(int))) == NULL)
+  {
+    free(r->band_iy);
+    return (-1);
+  }
+
+  for (i = 0, iy = 0, yerr0 = 0, yerr1 = z->ysize; i < z->ysize; i ++)
+  {
+    if ((i % RENDER_BAND_HEIGHT) == 0)
+    {
+      r->band_iy[i / RENDER_BAND_HEIGHT]    = iy;
+      r->band_yerr0[i / RENDER_BAND_HEIGHT] = yerr0;
+    }
+
+    iy    += z->ystep;
+    yerr0 += z->ymod;
+    yerr1 -= z->ymod;
+    if (yerr1 <= 0)
+    {
+      yerr0 -= z->ysize;
+      yerr1 += z->ysize;
+      iy    += z->yincr;
+    }
+  }
+
+ /*
+  * Allocate the band buffers...
+  */
+
+  num_threads = NumThreads;
+  if (num_threads > r->num_bands)
+    num_threads = r->num_bands;
+
+  if (_cupsImageIsSequential(r->img))
+    num_threads = 1;			/* Streaming images need rows in order */
+
+  r->num_buffers = num_threads > 1 ? 2 * num_threads : 1;
+  r->buffers     = calloc(r->num_buffers, sizeof(unsigned char *));
+  r->buffer_band = calloc(r->num_buffers, sizeof(int));
+  r->next_band   = 0;
+  r->written     = 0;
+  r->error       = 0;
+  status         = 0;
+
+  if (!r->buffers || !r->buffer_band)
+    status = -1;
+
+  for (i = 0; !status && i < r->num_buffers; i ++)
+  {
+    r->buffer_band[i] = -1;
+
+    if ((r->buffers[i] = malloc(RENDER_BAND_HEIGHT *
+                                r->header->cupsBytesPerLine)) == NULL)
+      status = -1;
+  }
+
+  if (status)
+    num_threads = 0;
+
+#ifdef HAVE_PTHREAD_H
+  if (num_threads > 1)
+  {
+   /*
+    * Start the workers and write the bands as they come in...
+    */
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+
+    for (i = 0; i < num_threads; i ++)
+      if (pthread_create(threads + i, NULL, render_thread, r))
+	break;
+
+    num_threads = i;
+    if (num_threads == 0)
+      status = -1;
+
+    for (band = 0; !status && band < r->num_bands; band ++)
+    {
+      pthread_mutex_lock(&r->lock);
+
+      while (!r->error && r->buffer_band[band % r->num_buffers] != band)
+	pthread_cond_wait(&r->cond, &r->lock);
+
+      if (r->error)
+        status = -1;
+
+      pthread_mutex_unlock(&r->lock);
+
+      count = z->ysize - band * RENDER_BAND_HEIGHT;
+      if (count > RENDER_BAND_HEIGHT)
+        count = RENDER_BAND_HEIGHT;
+
+      for (row = r->buffers[band % r->num_buffers];
+           !status && count > 0;
+	   count --, row += r->header->cupsBytesPerLine)
+	if (cupsRasterWritePixels(ras, row, r->header->cupsBytesPerLine) <
+	        r->header->cupsBytesPerLine)
+	  status = -1;
+
+      pthread_mutex_lock(&r->lock);
+      if (status)
+        r->error = 1;
+      else
+        r->written = band + 1;
+      pthread_cond_broadcast(&r->cond);
+      pthread_mutex_unlock(&r->lock);
+    }
+
+    for (i = 0; i < num_threads; i ++)
+      pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+  }
+  else
+#endif /* HAVE_PTHREAD_H */
+  if (!status)
+  {
+   /*
+    * Format and write one band at a time...
+    */
+
+    for (band = 0; !status && band < r->num_bands; band ++)
+    {
+      render_band(r, z, band, r->buffers[0]);
+
+      count = z->ysize - band * RENDER_BAND_HEIGHT;
+      if (count > RENDER_BAND_HEIGHT)
+        count = RENDER_BAND_HEIGHT;
+
+      for (row = r->buffers[0]; count > 0;
+	   count --, row += r->header->cupsBytesPerLine)
+	if (cupsRasterWritePixels(ras, row, r->header->cupsBytesPerLine) <
+	        r->header->cupsBytesPerLine)
+	{
+	  status = -1;
+	  break;
+	}
+    }
+  }
+
+ /*
+  * Free memory...
+  */
+
+  for (i = 0; r->buffers && i < r->num_buffers; i ++)
+    free(r->buffers[i]);
+
+  free(r->buffers);
+  free(r->buffer_band);
+  free(r->band_iy);
+  free(r->band_yerr0);
+
+  return (status);
+}
@@ -25,6 +25,8 @@
 #include "pdftopdf_processor.h"
 #include "pdftopdf_jcl.h"
 
+#define MAX_PDFTOPDF_THREADS 32
+
 #include <stdarg.h>
 static void error(const char *fmt,...) // {{{
 {
@@ -547,6 +549,23 @@ void getParameters(ppd_file_t *ppd,int num_options,cups_option_t *options,Proces
     }
   }
 
+  // threads for combining the contents of n-up subpages etc.
+  if ((val=cupsGetOption("pdftopdf-threads",num_options,options)) != NULL) {
+    param.numThreads=atoi(val);
+  } else if ((val=getenv("RIP_THREADS")) != NULL) {
+    param.numThreads=atoi(val);
+  } else {
+    param.numThreads=sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (param.numThreads<1) {
+    param.numThreads=1;
+  } else if (param.numThreads>MAX_PDFTOPDF_THREADS) {
+    param.numThreads=MAX_PDFTOPDF_THREADS;
+  }
+#ifndef HAVE_PTHREAD_H
+  param.numThreads=1;
+#endif
+
   param.collate=optGetCollate(num_options,options);
   // FIXME? pdftopdf also considers if ppdCollate is set (only when cupsGetOption is /not/ given) [and if is_true overrides param.collate=true]  -- pstops does not
 
@@ -1189,6 +1208,8 @@ int main(int argc,char **argv)
     }
 */
 
+    proc->setThreads(param.numThreads);
+
     if (!processPDFTOPDF(*proc,param)) {
       ppdClose(ppd);
       return 2;
@@ -91,6 +91,9 @@ void ProcessingParameters::dump() const // {{{
   fprintf(stderr,"autoRotate: %s\n",
 	  (autoRotate)?"true":"false");
 
+  fprintf(stderr,"numThreads: %d\n",
+	  numThreads);
+
   fprintf(stderr,"emitJCL: %s\n",
 	  (emitJCL)?"true":"false");
   fprintf(stderr,"deviceCopies: %d\n",
@@ -142,6 +145,19 @@ std::vector<int> bookletShuffle(int numPages,int signature) // {{{
 }
 // }}}
 
+static std::vector<int> pageShuffle(const ProcessingParameters &param,int numOrigPages) // {{{
+{
+  std::vector<int> shuffle;
+  if (param.booklet!=BOOKLET_OFF) {
+    shuffle=bookletShuffle(numOrigPages,param.bookSignature);
+  } else { // 0 1 2 3 ...
+    shuffle.resize(numOrigPages);
+    std::iota(shuffle.begin(),shuffle.end(),0);
+  }
+  return shuffle;
+}
+// }}}
+
 bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{{
 {
   if (!proc.check_print_permissions()) {
@@ -149,6 +165,32 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
     return false;
   }
 
+  // TODO FIXME? elsewhere
+  if (param.booklet==BOOKLET_ON) { // override options
+    // TODO? specifically "sides=two-sided-short-edge" / DuplexTumble
+    // param.duplex=true;
+    // param.setDuplex=true;  ?    currently done in setFinalPPD()
+    NupParameters::preset(2,param.nup); // TODO?! better
+  }
+
+  int numOrigPages=proc.get_num_pages();
+  std::vector<int> shuffle=pageShuffle(param,numOrigPages);
+
+  // only the pages that end up on a selected output page are needed
+  const int nupPages=param.nup.nupX*param.nup.nupY;
+  std::vector<bool> used(numOrigPages,false);
+  for (int iA=0;iA<(int)shuffle.size();iA++) {
+    if ((shuffle[iA]<numOrigPages)&&(param.withPage(iA/nupPages+1))) {
+      used[shuffle[iA]]=true;
+    }
+  }
+
+  std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> pages=proc.get_pages(used);
+  if ((int)pages.size()!=numOrigPages) { // page tree was broken, all pages had to be loaded
+    numOrigPages=pages.size();
+    shuffle=pageShuffle(param,numOrigPages);
+  }
+
   if (param.autoRotate) {
     const bool dst_lscape =
       (param.paper_is_landscape ==
@@ -156,23 +198,6 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
     proc.autoRotateAll(dst_lscape,param.normal_landscape);
   }
 
-  std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> pages=proc.get_pages();
-  const int numOrigPages=pages.size();
-
-  // TODO FIXME? elsewhere
-  std::vector<int> shuffle;
-  if (param.booklet!=BOOKLET_OFF) {
-    shuffle=bookletShuffle(numOrigPages,param.bookSignature);
-    if (param.booklet==BOOKLET_ON) { // override options
-      // TODO? specifically "sides=two-sided-short-edge" / DuplexTumble
-      // param.duplex=true;
-      // param.setDuplex=true;  ?    currently done in setFinalPPD()
-      NupParameters::preset(2,param.nup); // TODO?! better
-    }
-  } else { // 0 1 2 3 ...
-    shuffle.resize(numOrigPages);
-    std::iota(shuffle.begin(),shuffle.end(),0);
-  }
   const int numPages=std::max(shuffle.size(),pages.size());
 
   std::shared_ptr<PDFTOPDF_PageHandle> curpage;
@@ -268,7 +293,7 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
       }
 
       PageRect rect;
-      if (param.fitplot) {
+      if ((param.fitplot)&&(page)) { // not loaded: not on a selected output page
         rect=page->getRect();
       } else {
         rect.width=param.page.width;
@@ -304,7 +329,7 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
         curpage=proc.new_page(param.page.width,param.page.height);
         outputpage++;
       }
-      if (shuffle[iA]>=numOrigPages) {
+      if ((shuffle[iA]>=numOrigPages)||(!page)) {
         continue;
       }
 
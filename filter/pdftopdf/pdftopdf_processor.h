@@ -34,6 +34,8 @@ ProcessingParameters()
 
     autoRotate(false),
 
+    numThreads(1),
+
     emitJCL(true),deviceCopies(1),
     deviceCollate(false),setDuplex(false),
 
@@ -80,6 +82,8 @@ ProcessingParameters()
 
   bool autoRotate;
 
+  int numThreads; // for preparing the page contents
+
   // ppd/jcl changes
   bool emitJCL;
   int deviceCopies;
@@ -125,7 +129,9 @@ class PDFTOPDF_Processor { // abstract interface
   // TODO? virtual bool may_modify/may_print/?
   virtual bool check_print_permissions() =0;
 
-  virtual std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> get_pages() =0; // shared_ptr because of type erasure (deleter)
+  virtual int get_num_pages() =0;
+  // only the pages with used[page] (0-based) must be loaded, others may be empty
+  virtual std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> get_pages(const std::vector<bool> &used) =0; // shared_ptr because of type erasure (deleter)
 
   virtual std::shared_ptr<PDFTOPDF_PageHandle> new_page(float width,float height) =0;
 
@@ -135,7 +141,9 @@ class PDFTOPDF_Processor { // abstract interface
 
   virtual void multiply(int copies,bool collate) =0;
 
-  virtual void autoRotateAll(bool dst_lscape,Rotation normal_landscape) =0; // TODO elsewhere?!
+  virtual void setThreads(int threads) =0; // independent per-page work
+
+  virtual void autoRotateAll(bool dst_lscape,Rotation normal_landscape) =0; // TODO elsewhere?!  -- only the pages loaded by get_pages()
   virtual void addCM(const char *defaulticc,const char *outputicc) =0;
 
   virtual void setComments(const std::vector<std::string> &comments) =0;
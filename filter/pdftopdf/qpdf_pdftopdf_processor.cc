@@ -3,6 +3,8 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <stdexcept>
+#include <algorithm>
+#include <set>
 #include <qpdf/QPDFWriter.hh>
 #include <qpdf/QUtil.hh>
 #include "qpdf_tools.h"
@@ -24,17 +26,19 @@ static std::string debug_box(const PageRect &box,float xshift,float yshift) // {
 }
 // }}}
 
-QPDF_PDFTOPDF_PageHandle::QPDF_PDFTOPDF_PageHandle(QPDFObjectHandle page,int orig_no) // {{{
+QPDF_PDFTOPDF_PageHandle::QPDF_PDFTOPDF_PageHandle(QPDFObjectHandle page,int orig_no,XObject_Combiner *xocombine) // {{{
   : page(page),
     no(orig_no),
-    rotation(ROT_0)
+    rotation(ROT_0),
+    xocombine(xocombine)
 {
 }
 // }}}
 
-QPDF_PDFTOPDF_PageHandle::QPDF_PDFTOPDF_PageHandle(QPDF *pdf,float width,float height) // {{{
+QPDF_PDFTOPDF_PageHandle::QPDF_PDFTOPDF_PageHandle(QPDF *pdf,float width,float height,XObject_Combiner *xocombine) // {{{
   : no(0),
-    rotation(ROT_0)
+    rotation(ROT_0),
+    xocombine(xocombine)
 {
   assert(pdf);
   page=QPDFObjectHandle::parse(
@@ -91,6 +95,15 @@ QPDFObjectHandle QPDF_PDFTOPDF_PageHandle::get() // {{{
 }
 // }}}
 
+QPDFObjectHandle QPDF_PDFTOPDF_PageHandle::makeSubpageXObject(QPDFObjectHandle subpage) // {{{
+{
+  if (xocombine) {
+    return xocombine->make(subpage.getOwningQPDF(),subpage);
+  }
+  return makeXObject(subpage.getOwningQPDF(),subpage);
+}
+// }}}
+
 // TODO: we probably need a function "ungetRect()"  to transform to page/form space
 // TODO: as member
 static PageRect ungetRect(PageRect rect,const QPDF_PDFTOPDF_PageHandle &ph,Rotation rotation,QPDFObjectHandle page)
@@ -198,7 +211,7 @@ void QPDF_PDFTOPDF_PageHandle::add_subpage(const std::shared_ptr<PDFTOPDF_PageHa
     qsub->page.replaceKey("/TrimBox",makeBox(rect.left,rect.bottom,rect.right,rect.top));
     // TODO? do everything for cropping here?
   }
-  xobjs[xoname]=makeXObject(qsub->page.getOwningQPDF(),qsub->page); // trick: should be the same as page->getOwningQPDF() [only after it's made indirect]
+  xobjs[xoname]=makeSubpageXObject(qsub->page); // trick: should be the same as page->getOwningQPDF() [only after it's made indirect]
 
   Matrix mtx;
   mtx.translate(xpos,ypos);
@@ -232,9 +245,9 @@ void QPDF_PDFTOPDF_PageHandle::mirror() // {{{
     QPDFObjectHandle subpage=get();  // this->page, with rotation
 
     // replace all our data
-    *this=QPDF_PDFTOPDF_PageHandle(subpage.getOwningQPDF(),orig.width,orig.height);
+    *this=QPDF_PDFTOPDF_PageHandle(subpage.getOwningQPDF(),orig.width,orig.height,xocombine);
 
-    xobjs[xoname]=makeXObject(subpage.getOwningQPDF(),subpage); // we can only now set this->xobjs
+    xobjs[xoname]=makeSubpageXObject(subpage); // we can only now set this->xobjs
 
     // content.append(std::string("1 0 0 1 0 0 cm\n  ");
     content.append(xoname+" Do\n");
@@ -358,8 +371,18 @@ void QPDF_PDFTOPDF_PageHandle::debug(const PageRect &rect,float xpos,float ypos)
 }
 // }}}
 
+QPDF_PDFTOPDF_Processor::QPDF_PDFTOPDF_Processor() // {{{
+  : orig_count(0),
+    lazy(false),
+    numThreads(1),
+    hasCM(false)
+{
+}
+// }}}
+
 void QPDF_PDFTOPDF_Processor::closeFile() // {{{
 {
+  xocombine.clear();
   pdf.reset();
   hasCM=false;
 }
@@ -434,17 +457,40 @@ bool QPDF_PDFTOPDF_Processor::loadFilename(const char *name) // {{{
 }
 // }}}
 
+// attributes a page inherits from its page tree nodes
+static const char * const inheritable[]={"/Resources","/MediaBox","/CropBox","/Rotate"};
+
+// Pages are only loaded by get_pages(), so that a page range of a huge
+// document does not need to read the whole page tree.
 void QPDF_PDFTOPDF_Processor::start() // {{{
 {
   assert(pdf);
 
-  pdf->pushInheritedAttributesToPage();
-  orig_pages=pdf->getAllPages();
+  orig_pages.clear();
+  orig_inherited.clear();
+  orig_counts.clear();
+  orig_nodes.clear();
+  lazy=false;
+
+  QPDFObjectHandle tree=pdf->getRoot().getKey("/Pages");
+  if ((tree.isDictionary())&&(tree.getKey("/Kids").isArray())&&
+      (tree.getKey("/Count").isInteger())&&(tree.getKey("/Count").getIntValue()>=0)) {
+    orig_kids=tree.getKey("/Kids");
+    orig_count=tree.getKey("/Count").getIntValue();
+    for (const char *key : inheritable) {
+      if (tree.hasKey(key)) {
+        orig_inherited[key]=tree.getKey(key);
+        tree.removeKey(key); // would be inherited by new pages
+      }
+    }
 
-  // remove them (just unlink, data still there)
-  const int len=orig_pages.size();
-  for (int iA=0;iA<len;iA++) {
-    pdf->removePage(orig_pages[iA]);
+    // unlink them all (data still there)
+    tree.replaceKey("/Kids",QPDFObjectHandle::newArray());
+    tree.replaceKey("/Count",QPDFObjectHandle::newInteger(0));
+    pdf->updateAllPagesCache();
+    lazy=true;
+  } else { // let qpdf sort it out
+    loadAllPages();
   }
 
   // we remove stuff that becomes defunct (probably)  TODO
@@ -455,6 +501,152 @@ void QPDF_PDFTOPDF_Processor::start() // {{{
 }
 // }}}
 
+void QPDF_PDFTOPDF_Processor::loadAllPages() // {{{
+{
+  if (lazy) { // put the page tree back
+    QPDFObjectHandle tree=pdf->getRoot().getKey("/Pages");
+    tree.replaceKey("/Kids",orig_kids);
+    tree.replaceKey("/Count",QPDFObjectHandle::newInteger(orig_count));
+    for (auto it=orig_inherited.begin(),end=orig_inherited.end();it!=end;++it) {
+      tree.replaceKey(it->first,it->second);
+    }
+    pdf->updateAllPagesCache();
+    orig_counts.clear();
+    orig_nodes.clear();
+    lazy=false;
+  }
+
+  pdf->pushInheritedAttributesToPage();
+  orig_pages=pdf->getAllPages();
+
+  // remove them (just unlink, data still there); from the back, so that
+  // qpdf need not renumber the following pages
+  for (int iA=orig_pages.size()-1;iA>=0;iA--) {
+    pdf->removePage(orig_pages[iA]);
+  }
+}
+// }}}
+
+// Cumulative page counts of the kids of a page tree node (entry i: pages in
+// kids 0..i), read once per node; NULL if a kid is broken or the counts do
+// not add up to the node's /Count. Intermediate nodes are remembered, so
+// that get_pages() can unlink them.
+const std::vector<long long> *QPDF_PDFTOPDF_Processor::kidCounts(QPDFObjGen node,QPDFObjectHandle kids,long long count) // {{{
+{
+  auto it=orig_counts.find(node);
+  if (it!=orig_counts.end()) {
+    return &it->second;
+  }
+
+  std::vector<long long> &ret=orig_counts[node];
+  const int len=kids.getArrayNItems();
+  long long sum=0;
+  ret.reserve(len);
+  // every kid's /Count is needed: a node may also hold no pages
+  for (int iA=0;iA<len;iA++) {
+    QPDFObjectHandle kid=kids.getArrayItem(iA);
+    if ((!kid.isDictionary())||(!kid.isIndirect())) {
+      return NULL;
+    }
+    if (kid.hasKey("/Kids")) {
+      QPDFObjectHandle cnt=kid.getKey("/Count");
+      if ((!cnt.isInteger())||(cnt.getIntValue()<0)) {
+        return NULL;
+      }
+      sum+=cnt.getIntValue();
+      orig_nodes.insert(kid.getObjGen());
+    } else {
+      sum++;
+    }
+    ret.push_back(sum);
+  }
+  if (sum!=count) {
+    return NULL;
+  }
+  return &ret;
+}
+// }}}
+
+// Follows /Count through the page tree (only the nodes on the way and their
+// kids are read, each once); uninitialized if the tree does not agree with
+// its /Count entries.
+QPDFObjectHandle QPDF_PDFTOPDF_Processor::findPage(int no) // {{{
+{
+  assert(lazy);
+  QPDFObjectHandle kids=orig_kids;
+  QPDFObjGen node; // the root, its /Kids are unlinked
+  long long count=orig_count;
+  std::map<std::string,QPDFObjectHandle> inherited=orig_inherited;
+
+  if ((no<0)||(no>=orig_count)) {
+    return QPDFObjectHandle();
+  }
+  for (int depth=0;depth<MAX_PAGE_TREE_DEPTH;depth++) {
+    const std::vector<long long> *counts=kidCounts(node,kids,count);
+    if (!counts) {
+      return QPDFObjectHandle();
+    }
+    // the first kid whose pages reach past no
+    const int idx=std::upper_bound(counts->begin(),counts->end(),(long long)no)-counts->begin();
+    if (idx>=(int)counts->size()) {
+      return QPDFObjectHandle();
+    }
+    if (idx>0) {
+      no-=(*counts)[idx-1];
+    }
+    QPDFObjectHandle kid=kids.getArrayItem(idx);
+
+    if (!kid.hasKey("/Kids")) { // the page
+      if (no!=0) {
+        return QPDFObjectHandle();
+      }
+      // like QPDF::pushInheritedAttributesToPage(), for this page only
+      for (auto it=inherited.begin(),end=inherited.end();it!=end;++it) {
+        if (!kid.hasKey(it->first)) {
+          QPDFObjectHandle value=it->second;
+          kid.replaceKey(it->first,(value.isIndirect())?value:value.shallowCopy());
+        }
+      }
+      return kid;
+    }
+
+    for (const char *key : inheritable) {
+      if (kid.hasKey(key)) {
+        inherited[key]=kid.getKey(key);
+      }
+    }
+    node=kid.getObjGen();
+    kids=kid.getKey("/Kids");
+    count=kid.getKey("/Count").getIntValue(); // checked by kidCounts()
+    if (!kids.isArray()) {
+      return QPDFObjectHandle();
+    }
+  }
+  return QPDFObjectHandle();
+}
+// }}}
+
+// The pages that were not selected still have /Parent entries into the
+// original page tree, and a link or annotation of a selected page may refer
+// to them. Replacing the page tree nodes that were read by empty ones keeps
+// the writer from following them to all the other pages, like
+// QPDF::removePage() does for a flattened tree. Nodes below the ones that
+// were read are not known without reading more of the tree; only the pages
+// under them can still be reached that way.
+void QPDF_PDFTOPDF_Processor::unlinkPageTree() // {{{
+{
+  for (const QPDFObjGen &og : orig_nodes) {
+    QPDFObjectHandle stub=QPDFObjectHandle::newDictionary();
+    stub.replaceKey("/Type",QPDFObjectHandle::newName("/Pages"));
+    stub.replaceKey("/Kids",QPDFObjectHandle::newArray());
+    stub.replaceKey("/Count",QPDFObjectHandle::newInteger(0));
+    pdf->replaceObject(og.getObj(),og.getGen(),stub);
+  }
+  orig_nodes.clear();
+  orig_counts.clear();
+}
+// }}}
+
 bool QPDF_PDFTOPDF_Processor::check_print_permissions() // {{{
 {
   if (!pdf) {
@@ -465,7 +657,21 @@ bool QPDF_PDFTOPDF_Processor::check_print_permissions() // {{{
 }
 // }}}
 
-std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> QPDF_PDFTOPDF_Processor::get_pages() // {{{
+int QPDF_PDFTOPDF_Processor::get_num_pages() // {{{
+{
+  if (!pdf) {
+    error("No PDF loaded");
+    assert(0);
+    return 0;
+  }
+  if (lazy) {
+    return orig_count;
+  }
+  return orig_pages.size();
+}
+// }}}
+
+std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> QPDF_PDFTOPDF_Processor::get_pages(const std::vector<bool> &used) // {{{
 {
   std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> ret;
   if (!pdf) {
@@ -473,10 +679,39 @@ std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> QPDF_PDFTOPDF_Processor::get_p
     assert(0);
     return ret;
   }
+
+  if ((lazy)&&((used.size()!=(size_t)orig_count)||
+               (std::find(used.begin(),used.end(),false)==used.end()))) {
+    loadAllPages(); // nothing to skip
+  } else if (lazy) {
+    orig_pages.assign(orig_count,QPDFObjectHandle());
+    std::set<QPDFObjGen> seen;
+    for (int iA=0;iA<orig_count;iA++) {
+      if (!used[iA]) {
+        continue;
+      }
+      QPDFObjectHandle page=findPage(iA);
+      if ((!page.isInitialized())||(!seen.insert(page.getObjGen()).second)) {
+        fprintf(stderr,"DEBUG: pdftopdf: Page tree does not match its /Count, loading all pages.\n");
+        loadAllPages();
+        break;
+      }
+      orig_pages[iA]=page;
+    }
+    if (lazy) { // not loadAllPages()
+      unlinkPageTree();
+    }
+    lazy=false; // the original page tree stays unlinked
+  }
+
   const int len=orig_pages.size();
   ret.reserve(len);
   for (int iA=0;iA<len;iA++) {
-    ret.push_back(std::shared_ptr<PDFTOPDF_PageHandle>(new QPDF_PDFTOPDF_PageHandle(orig_pages[iA],iA+1)));
+    if (orig_pages[iA].isInitialized()) {
+      ret.push_back(std::shared_ptr<PDFTOPDF_PageHandle>(new QPDF_PDFTOPDF_PageHandle(orig_pages[iA],iA+1,&xocombine)));
+    } else {
+      ret.push_back(std::shared_ptr<PDFTOPDF_PageHandle>());
+    }
   }
   return ret;
 }
@@ -489,7 +724,7 @@ std::shared_ptr<PDFTOPDF_PageHandle> QPDF_PDFTOPDF_Processor::new_page(float wid
     assert(0);
     return std::shared_ptr<PDFTOPDF_PageHandle>();
   }
-  return std::shared_ptr<QPDF_PDFTOPDF_PageHandle>(new QPDF_PDFTOPDF_PageHandle(pdf.get(),width,height));
+  return std::shared_ptr<QPDF_PDFTOPDF_PageHandle>(new QPDF_PDFTOPDF_PageHandle(pdf.get(),width,height,&xocombine));
   // return std::make_shared<QPDF_PDFTOPDF_PageHandle>(pdf.get(),width,height);
   // problem: make_shared not friend
 }
@@ -513,14 +748,42 @@ pdf->getRoot().removeKey("/OpenAction");
 pdf->getRoot().removeKey("/PageLabels");
 #endif
 
+// Make the direct resources, content arrays and annotation arrays of a page
+// indirect, so that the shallow copies made for further copies all refer to
+// the same objects and QPDFWriter writes them only once.
+static void shareForCopies(QPDF &pdf,QPDFObjectHandle page) // {{{
+{
+  static const char * const keys[]={"/Resources","/Contents","/Annots"};
+  for (const char *key : keys) {
+    if (!page.hasKey(key)) {
+      continue;
+    }
+    QPDFObjectHandle value=page.getKey(key);
+    if ((!value.isIndirect())&&
+        ((value.isDictionary())||(value.isArray()))) {
+      page.replaceKey(key,pdf.makeIndirectObject(value));
+    }
+  }
+}
+// }}}
+
 void QPDF_PDFTOPDF_Processor::multiply(int copies,bool collate) // {{{
 {
   assert(pdf);
   assert(copies>0);
 
+  if (copies==1) {
+    return;
+  }
+
   std::vector<QPDFObjectHandle> pages=pdf->getAllPages(); // need copy
   const int len=pages.size();
 
+  // only the page dictionaries are repeated, everything else is shared
+  for (int iB=0;iB<len;iB++) {
+    shareForCopies(*pdf,pages[iB]);
+  }
+
   if (collate) {
     for (int iA=1;iA<copies;iA++) {
       for (int iB=0;iB<len;iB++) {
@@ -528,15 +791,28 @@ void QPDF_PDFTOPDF_Processor::multiply(int copies,bool collate) // {{{
       }
     }
   } else {
+    // inserting in the middle renumbers all following pages, so rebuild
+    // the page list by appending instead
+    for (int iB=len-1;iB>=0;iB--) {
+      pdf->removePage(pages[iB]);
+    }
     for (int iB=0;iB<len;iB++) {
+      pdf->addPage(pages[iB],false);
       for (int iA=1;iA<copies;iA++) {
-        pdf->addPageAt(pages[iB].shallowCopy(),false,pages[iB]);
+        pdf->addPage(pages[iB].shallowCopy(),false);
       }
     }
   }
 }
 // }}}
 
+void QPDF_PDFTOPDF_Processor::setThreads(int threads) // {{{
+{
+  assert(threads>0);
+  numThreads=threads;
+}
+// }}}
+
 // TODO? elsewhere?
 void QPDF_PDFTOPDF_Processor::autoRotateAll(bool dst_lscape,Rotation normal_landscape) // {{{
 {
@@ -545,6 +821,9 @@ void QPDF_PDFTOPDF_Processor::autoRotateAll(bool dst_lscape,Rotation normal_land
   const int len=orig_pages.size();
   for (int iA=0;iA<len;iA++) {
     QPDFObjectHandle page=orig_pages[iA];
+    if (!page.isInitialized()) { // not loaded
+      continue;
+    }
 
     Rotation src_rot=getRotate(page);
 
@@ -603,6 +882,7 @@ void QPDF_PDFTOPDF_Processor::emitFile(FILE *f,ArgOwnership take) // {{{
   if (!pdf) {
     return;
   }
+  xocombine.prepare(numThreads);
   QPDFWriter out(*pdf);
   switch (take) {
   case WillStayAlive:
@@ -615,14 +895,7 @@ void QPDF_PDFTOPDF_Processor::emitFile(FILE *f,ArgOwnership take) // {{{
     error("emitFile with MustDuplicate is not supported");
     return;
   }
-  if (hasCM) {
-    out.setMinimumPDFVersion("1.4");
-  } else {
-    out.setMinimumPDFVersion("1.2");
-  }
-  if (!extraheader.empty()) {
-    out.setExtraHeaderText(extraheader);
-  }
+  setupWriter(out);
   out.write();
 }
 // }}}
@@ -632,8 +905,16 @@ void QPDF_PDFTOPDF_Processor::emitFilename(const char *name) // {{{
   if (!pdf) {
     return;
   }
+  xocombine.prepare(numThreads);
   // special case: name==NULL -> stdout
   QPDFWriter out(*pdf,name);
+  setupWriter(out);
+  out.write();
+}
+// }}}
+
+void QPDF_PDFTOPDF_Processor::setupWriter(QPDFWriter &out) // {{{
+{
   if (hasCM) {
     out.setMinimumPDFVersion("1.4");
   } else {
@@ -642,7 +923,6 @@ void QPDF_PDFTOPDF_Processor::emitFilename(const char *name) // {{{
   if (!extraheader.empty()) {
     out.setExtraHeaderText(extraheader);
   }
-  out.write();
 }
 // }}}
 
@@ -2,7 +2,12 @@
 #define QPDF_PDFTOPDF_PROCESSOR_H
 
 #include "pdftopdf_processor.h"
+#include "qpdf_xobject.h"
 #include <qpdf/QPDF.hh>
+#include <qpdf/QPDFWriter.hh>
+#include <set>
+
+#define MAX_PAGE_TREE_DEPTH 64
 
 class QPDF_PDFTOPDF_PageHandle : public PDFTOPDF_PageHandle {
  public:
@@ -20,20 +25,25 @@ class QPDF_PDFTOPDF_PageHandle : public PDFTOPDF_PageHandle {
  private:
   friend class QPDF_PDFTOPDF_Processor;
   // 1st mode: existing
-  QPDF_PDFTOPDF_PageHandle(QPDFObjectHandle page,int orig_no=-1);
+  QPDF_PDFTOPDF_PageHandle(QPDFObjectHandle page,int orig_no=-1,XObject_Combiner *xocombine=NULL);
   QPDFObjectHandle page;
   int no;
 
   // 2nd mode: create new
-  QPDF_PDFTOPDF_PageHandle(QPDF *pdf,float width,float height);
+  QPDF_PDFTOPDF_PageHandle(QPDF *pdf,float width,float height,XObject_Combiner *xocombine=NULL);
   std::map<std::string,QPDFObjectHandle> xobjs;
   std::string content;
 
   Rotation rotation;
+  XObject_Combiner *xocombine; // NULL: combined when writing
+
+  QPDFObjectHandle makeSubpageXObject(QPDFObjectHandle subpage);
 };
 
 class QPDF_PDFTOPDF_Processor : public PDFTOPDF_Processor {
  public:
+  QPDF_PDFTOPDF_Processor();
+
   virtual bool loadFile(FILE *f,ArgOwnership take=WillStayAlive);
   virtual bool loadFilename(const char *name);
 
@@ -42,13 +52,16 @@ class QPDF_PDFTOPDF_Processor : public PDFTOPDF_Processor {
 
   // virtual bool setProcess(const ProcessingParameters &param) =0;
 
-  virtual std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> get_pages();
+  virtual int get_num_pages();
+  virtual std::vector<std::shared_ptr<PDFTOPDF_PageHandle>> get_pages(const std::vector<bool> &used);
   virtual std::shared_ptr<PDFTOPDF_PageHandle> new_page(float width,float height);
 
   virtual void add_page(std::shared_ptr<PDFTOPDF_PageHandle> page,bool front);
 
   virtual void multiply(int copies,bool collate);
 
+  virtual void setThreads(int threads);
+
   virtual void autoRotateAll(bool dst_lscape,Rotation normal_landscape);
   virtual void addCM(const char *defaulticc,const char *outputicc);
 
@@ -62,9 +75,25 @@ class QPDF_PDFTOPDF_Processor : public PDFTOPDF_Processor {
   void closeFile();
   void error(const char *fmt,...);
   void start();
+  void loadAllPages();
+  const std::vector<long long> *kidCounts(QPDFObjGen node,QPDFObjectHandle kids,long long count);
+  QPDFObjectHandle findPage(int no);
+  void unlinkPageTree();
+  void setupWriter(QPDFWriter &out);
  private:
   std::unique_ptr<QPDF> pdf;
-  std::vector<QPDFObjectHandle> orig_pages;
+  std::vector<QPDFObjectHandle> orig_pages; // uninitialized: not loaded
+
+  // page tree of the file, until get_pages() loaded the pages (lazy)
+  QPDFObjectHandle orig_kids;
+  int orig_count;
+  std::map<std::string,QPDFObjectHandle> orig_inherited;
+  std::map<QPDFObjGen,std::vector<long long>> orig_counts; // by node, see kidCounts()
+  std::set<QPDFObjGen> orig_nodes; // intermediate nodes read by findPage()
+  bool lazy;
+
+  XObject_Combiner xocombine;
+  int numThreads;
 
   bool hasCM;
   std::string extraheader;
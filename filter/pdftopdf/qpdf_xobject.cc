@@ -1,12 +1,25 @@
+#include <config.h>
 #include "qpdf_xobject.h"
 //#include <qpdf/Types.h>
 #include <qpdf/QPDF.hh>
 #include <qpdf/Pl_Discard.hh>
 #include <qpdf/Pl_Count.hh>
 #include <qpdf/Pl_Concatenate.hh>
+#include <qpdf/Pl_Buffer.hh>
+#include <qpdf/Pl_Flate.hh>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 #include "qpdf_tools.h"
 #include "qpdf_pdftopdf.h"
 
+// XObjects per thread combined in one go
+#define COMBINE_BATCH 4
+
 // TODO: need to remove  Struct Parent stuff  (or fix)
 
 // NOTE: use /TrimBox to position content inside Nup cell, /BleedBox to clip against
@@ -142,6 +155,192 @@ QPDFObjectHandle makeXObject(QPDF *pdf,QPDFObjectHandle page)
   return ret;
 }
 
+QPDFObjectHandle XObject_Combiner::make(QPDF *pdf,QPDFObjectHandle page)
+{
+  QPDFObjectHandle ret=makeXObject(pdf,page);
+  pending.push_back(std::make_pair(ret,page));
+  return ret;
+}
+
+// QPDF objects must only be touched by one thread: the raw stream data is
+// read before, and the combined stream stored after the threads ran.
+struct CombineJob {
+  std::vector<std::string> raw;
+  std::vector<bool> inflate; // plain /FlateDecode, otherwise decoded
+  bool ready; // false: contents qpdf cannot decode
+  std::string result; // flate compressed
+  bool ok;
+};
+
+static void appendBuffer(std::vector<std::string> &raw,Buffer &data)
+{
+  raw.push_back(std::string((const char *)data.getBuffer(),data.getSize()));
+}
+
+static bool readContents(QPDFObjectHandle page,CombineJob &job)
+{
+  std::vector<QPDFObjectHandle> contents=page.getPageContents();
+  const int clen=contents.size();
+  for (int iA=0;iA<clen;iA++) {
+    QPDFObjectHandle dict=contents[iA].getDict();
+    QPDFObjectHandle filter=dict.getKey("/Filter");
+    if ((filter.isArray())&&(filter.getArrayNItems()==1)) {
+      filter=filter.getArrayItem(0);
+    }
+    QPDFObjectHandle parms=dict.getKey("/DecodeParms");
+    if ((parms.isArray())&&(parms.getArrayNItems()==1)) {
+      parms=parms.getArrayItem(0);
+    }
+    if (filter.isNull()) {
+      job.inflate.push_back(false);
+      appendBuffer(job.raw,*contents[iA].getRawStreamData());
+    } else if ((filter.isName())&&(filter.getName()=="/FlateDecode")&&
+               (parms.isNull())) {
+      job.inflate.push_back(true);
+      appendBuffer(job.raw,*contents[iA].getRawStreamData());
+    } else { // e.g. LZW, predictors, filter arrays: decoded by qpdf here
+      try {
+        appendBuffer(job.raw,*contents[iA].getStreamData());
+      } catch (const std::exception &e) { // not decodable: leave it to qpdf
+        return false;
+      }
+      job.inflate.push_back(false);
+    }
+  }
+  return true;
+}
+
+// same as CombineFromContents_Provider, but compressed
+static void combineJob(CombineJob &job)
+{
+  if (!job.ready) {
+    return;
+  }
+  try {
+    Pl_Buffer out("combined");
+    Pl_Flate deflate("deflate",&out,Pl_Flate::a_deflate);
+    Pl_Concatenate concat("concat",&deflate);
+    const int len=job.raw.size();
+    for (int iA=0;iA<len;iA++) {
+      std::string &raw=job.raw[iA];
+      if (raw.empty()) {
+        continue;
+      }
+      if (job.inflate[iA]) {
+        Pl_Flate inflate("inflate",&concat,Pl_Flate::a_inflate);
+        inflate.write((unsigned char *)&raw[0],raw.size());
+        inflate.finish(); // concat does not pass it on
+      } else {
+        concat.write((unsigned char *)&raw[0],raw.size());
+      }
+      std::string().swap(raw);
+    }
+    concat.manualFinish();
+
+    std::unique_ptr<Buffer> buf(out.getBuffer());
+    job.result.assign((const char *)buf->getBuffer(),buf->getSize());
+    job.ok=true;
+  } catch (const std::exception &e) { // qpdf will report it when writing
+    job.ok=false;
+  }
+}
+
+#ifdef HAVE_PTHREAD_H
+struct CombinePool {
+  std::vector<CombineJob> *jobs;
+  size_t next;
+  pthread_mutex_t lock;
+};
+
+static void *combineThread(void *arg)
+{
+  CombinePool *pool=(CombinePool *)arg;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    const size_t iA=pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (iA>=pool->jobs->size()) {
+      break;
+    }
+    combineJob((*pool->jobs)[iA]);
+  }
+  return NULL;
+}
+#endif
+
+static void runJobs(std::vector<CombineJob> &jobs,int threads)
+{
+  const int len=jobs.size();
+  if (threads>len) {
+    threads=len;
+  }
+#ifdef HAVE_PTHREAD_H
+  if (threads>1) {
+    CombinePool pool;
+    pool.jobs=&jobs;
+    pool.next=0;
+    pthread_mutex_init(&pool.lock,NULL);
+
+    // this thread is one of them
+    std::vector<pthread_t> tids(threads-1);
+    int started=0;
+    for (;started<threads-1;started++) {
+      if (pthread_create(&tids[started],NULL,combineThread,&pool)!=0) {
+        break;
+      }
+    }
+    combineThread(&pool);
+    for (int iA=0;iA<started;iA++) {
+      pthread_join(tids[iA],NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    return;
+  }
+#endif
+  for (int iA=0;iA<len;iA++) {
+    combineJob(jobs[iA]);
+  }
+}
+
+// The XObjects are done in batches of COMBINE_BATCH per thread, so that
+// only the raw contents of one batch are held in memory at a time.
+void XObject_Combiner::prepare(int threads)
+{
+  if (threads<1) {
+    threads=1;
+  }
+  const int len=pending.size();
+  const int batch=threads*COMBINE_BATCH;
+  for (int first=0;first<len;first+=batch) {
+    const int num=std::min(batch,len-first);
+    std::vector<CombineJob> jobs(num);
+    for (int iA=0;iA<num;iA++) {
+      jobs[iA].ok=false;
+      jobs[iA].ready=readContents(pending[first+iA].second,jobs[iA]);
+      if (!jobs[iA].ready) { // left to CombineFromContents_Provider
+        jobs[iA].raw.clear();
+      }
+    }
+
+    runJobs(jobs,threads);
+
+    // commit in order
+    for (int iA=0;iA<num;iA++) {
+      if (jobs[iA].ok) {
+        pending[first+iA].first.replaceStreamData(jobs[iA].result,
+                                                  QPDFObjectHandle::newName("/FlateDecode"),
+                                                  QPDFObjectHandle::newNull());
+      }
+    }
+  }
+  pending.clear();
+}
+
+void XObject_Combiner::clear()
+{
+  pending.clear();
+}
+
 /*
   we will have to fix up the structure tree (e.g. /K in element), when copying  /StructParents;
   (there is /Pg, which has to point to the containing page, /Stm when it's not part of the page's content stream 
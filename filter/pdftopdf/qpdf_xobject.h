@@ -2,7 +2,22 @@
 #define QPDF_XOBJECT_H_
 
 #include <qpdf/QPDFObjectHandle.hh>
+#include <vector>
 
 QPDFObjectHandle makeXObject(QPDF *pdf,QPDFObjectHandle page);
 
+// Subpage XObjects whose contents are combined by prepare()
+class XObject_Combiner {
+ public:
+  QPDFObjectHandle make(QPDF *pdf,QPDFObjectHandle page);
+  // combine the contents of the XObjects made since the last call,
+  // on up to threads threads; otherwise this happens when writing.
+  // Only pages placed as XObjects (n-up, fit-to-page, mirror, ...)
+  // go through here, 1-up pages are compressed by the writer.
+  void prepare(int threads);
+  void clear();
+ private:
+  std::vector<std::pair<QPDFObjectHandle,QPDFObjectHandle>> pending; // xobj,page
+};
+
 #endif
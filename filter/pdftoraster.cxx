@@ -58,6 +58,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <splash/SplashBitmap.h>
 #include <strings.h>
 #include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
 #ifdef USE_LCMS1
 #include <lcms.h>
 #define cmsColorSpaceSignature icColorSpaceSignature
@@ -94,6 +99,12 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define MAX_CHECK_COMMENT_LINES	20
 #define MAX_BYTES_PER_PIXEL 32
+#define MAX_RENDER_THREADS 32	/* Maximum number of conversion threads */
+#define RENDER_BLOCK_LINES 32	/* Lines converted by a thread at a time */
+#define MAX_PAGE_BITMAP_SIZE (256 * 1024 * 1024)
+			/* Largest page rendered at once by default */
+#define BAND_BITMAP_SIZE (16 * 1024 * 1024)
+			/* Size of the bands of larger pages */
 
 namespace {
   typedef unsigned char *(*ConvertLineFunc)(unsigned char *src,
@@ -122,6 +133,8 @@ namespace {
   bool swap_margin_x = false;
   bool swap_margin_y = false;
   bool allocLineBuf = false;
+  int numThreads = 1;
+  int bandHeight = -1; /* rows rendered at a time, 0 = page, -1 = auto */
   ConvertLineFunc convertLineOdd;
   ConvertLineFunc convertLineEven;
   ConvertCSpaceFunc convertCSpace;
@@ -595,6 +608,40 @@ static void parseOpts(int argc, char **argv)
     exit(1);
 #endif /* HAVE_CUPS_1_7 */
   }
+
+  /* number of threads used to convert the rendered pages, from the
+     render-threads option, the cupsRenderThreads PPD attribute, the
+     RIP_THREADS environment variable or the number of CPUs */
+  if ((t = cupsGetOption("render-threads",num_options,options)) != NULL) {
+    numThreads = atoi(t);
+  } else if (ppd && (attr = ppdFindAttr(ppd,"cupsRenderThreads",NULL)) != NULL
+      && attr->value != NULL) {
+    numThreads = atoi(attr->value);
+  } else if ((t = getenv("RIP_THREADS")) != NULL) {
+    numThreads = atoi(t);
+  } else {
+    numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (numThreads < 1) {
+    numThreads = 1;
+  } else if (numThreads > MAX_RENDER_THREADS) {
+    numThreads = MAX_RENDER_THREADS;
+  }
+#ifndef HAVE_PTHREAD_H
+  numThreads = 1;
+#endif /* !HAVE_PTHREAD_H */
+  fprintf(stderr, "DEBUG: Using %d render threads.\n", numThreads);
+
+  /* rows of the page rendered at a time, from the band-height option or
+     the pdftorasterBandHeight PPD attribute; by default only pages whose
+     bitmap would be larger than MAX_PAGE_BITMAP_SIZE are rendered in
+     bands */
+  if ((t = cupsGetOption("band-height",num_options,options)) != NULL) {
+    bandHeight = atoi(t);
+  } else if (ppd && (attr = ppdFindAttr(ppd,"pdftorasterBandHeight",NULL))
+      != NULL && attr->value != NULL) {
+    bandHeight = atoi(attr->value);
+  }
 }
 
 static void parsePDFTOPDFComment(FILE *fp)
@@ -1637,27 +1684,183 @@ static void selectConvertFunc(cups_raster_t *raster)
   }
 }
 
+#ifdef HAVE_PTHREAD_H
+/* state shared by the threads converting one page; blocks of
+   RENDER_BLOCK_LINES output lines are converted in any order into a ring
+   of buffers and written in order by the main thread */
+struct ConvertJob {
+  ConvertLineFunc convertLine;
+  unsigned char *base; /* first pixel of the first row to convert */
+  unsigned int rowsize;
+  bool reverse; /* output the rows from bottom to top */
+  unsigned int firstRow; /* page row of the first row */
+  unsigned int numRows;
+  unsigned int numLines; /* number of output lines of all planes and bands */
+  unsigned int numBlocks;
+  unsigned int numBuffers;
+  unsigned char **buffers;
+  unsigned int *bufferBlock; /* block held by each buffer */
+  unsigned int nextBlock; /* next block to convert */
+  unsigned int written; /* number of blocks written */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void convertBlock(ConvertJob *job, unsigned int block,
+  unsigned char *buf)
+{
+  unsigned int linesPerPlane = job->numRows*nbands;
+  unsigned int i = block*RENDER_BLOCK_LINES;
+  unsigned int end = i+RENDER_BLOCK_LINES;
+
+  if (end > job->numLines) end = job->numLines;
+  for (;i < end;i++, buf += bytesPerLine) {
+    unsigned int plane = i/linesPerPlane;
+    unsigned int row = (i%linesPerPlane)/nbands;
+    unsigned int band = i%nbands;
+    unsigned int h;
+    unsigned char *bp, *dp;
+
+    if (job->reverse) {
+      h = job->firstRow+job->numRows-row;
+      bp = job->base+job->rowsize*(job->numRows-1-row);
+    } else {
+      h = job->firstRow+row;
+      bp = job->base+job->rowsize*row;
+    }
+    /* the line converters that need no line buffer return the source */
+    dp = job->convertLine(bp,buf,h,plane+band,header.cupsWidth,bytesPerLine);
+    if (dp != buf) memcpy(buf,dp,bytesPerLine);
+  }
+}
+
+static void *convertThread(void *arg)
+{
+  ConvertJob *job = (ConvertJob *)arg;
+  unsigned int block;
+
+  pthread_mutex_lock(&job->lock);
+  while ((block = job->nextBlock) < job->numBlocks) {
+    job->nextBlock++;
+    /* wait until the buffer of this block has been written */
+    while (block >= job->written+job->numBuffers)
+      pthread_cond_wait(&job->cond,&job->lock);
+    pthread_mutex_unlock(&job->lock);
+
+    convertBlock(job,block,job->buffers[block%job->numBuffers]);
+
+    pthread_mutex_lock(&job->lock);
+    job->bufferBlock[block%job->numBuffers] = block;
+    pthread_cond_broadcast(&job->cond);
+  }
+  pthread_mutex_unlock(&job->lock);
+  return NULL;
+}
+
+/* convert and write rows of a page on several threads, returns false if
+   no thread could be started */
+static bool writePageImageThreaded(cups_raster_t *raster, unsigned char *base,
+  unsigned int rowsize, ConvertLineFunc convertLine, bool reverse,
+  unsigned int firstRow, unsigned int numRows)
+{
+  ConvertJob job;
+  pthread_t threads[MAX_RENDER_THREADS];
+  int nthreads, started;
+  unsigned int i, block;
+
+  job.convertLine = convertLine;
+  job.base = base;
+  job.rowsize = rowsize;
+  job.reverse = reverse;
+  job.firstRow = firstRow;
+  job.numRows = numRows;
+  job.numLines = nplanes*numRows*nbands;
+  job.numBlocks = (job.numLines+RENDER_BLOCK_LINES-1)/RENDER_BLOCK_LINES;
+  nthreads = numThreads;
+  if ((unsigned int)nthreads > job.numBlocks) nthreads = job.numBlocks;
+  if (nthreads < 2) return false;
+  job.numBuffers = nthreads*2;
+  job.buffers = new unsigned char *[job.numBuffers];
+  job.bufferBlock = new unsigned int [job.numBuffers];
+  for (i = 0;i < job.numBuffers;i++) {
+    job.buffers[i] = new unsigned char [RENDER_BLOCK_LINES*bytesPerLine];
+    job.bufferBlock[i] = UINT_MAX;
+  }
+  job.nextBlock = 0;
+  job.written = 0;
+  pthread_mutex_init(&job.lock,NULL);
+  pthread_cond_init(&job.cond,NULL);
+
+  for (started = 0;started < nthreads;started++) {
+    if (pthread_create(threads+started,NULL,convertThread,&job)) break;
+  }
+
+  if (started > 0) {
+    for (block = 0;block < job.numBlocks;block++) {
+      unsigned int n = job.numLines-block*RENDER_BLOCK_LINES;
+
+      if (n > RENDER_BLOCK_LINES) n = RENDER_BLOCK_LINES;
+      pthread_mutex_lock(&job.lock);
+      while (job.bufferBlock[block%job.numBuffers] != block)
+        pthread_cond_wait(&job.cond,&job.lock);
+      pthread_mutex_unlock(&job.lock);
+
+      cupsRasterWritePixels(raster,job.buffers[block%job.numBuffers],
+        n*bytesPerLine);
+
+      pthread_mutex_lock(&job.lock);
+      job.written = block+1;
+      pthread_cond_broadcast(&job.cond);
+      pthread_mutex_unlock(&job.lock);
+    }
+    for (int t = 0;t < started;t++) pthread_join(threads[t],NULL);
+  }
+
+  pthread_cond_destroy(&job.cond);
+  pthread_mutex_destroy(&job.lock);
+  for (i = 0;i < job.numBuffers;i++) delete[] job.buffers[i];
+  delete[] job.buffers;
+  delete[] job.bufferBlock;
+  return started > 0;
+}
+#endif /* HAVE_PTHREAD_H */
+
+/* write numRows rows of the page starting at page row firstRow, the first
+   of them is at pixel x,y of the bitmap; the rows of the back side of a
+   flipped duplex page are written from the bottom up */
 static void writePageImage(cups_raster_t *raster, SplashBitmap *bitmap,
-  int pageNo)
+  int pageNo, unsigned int firstRow, unsigned int numRows, unsigned int x,
+  unsigned int y)
 {
   ConvertLineFunc convertLine;
   unsigned char *lineBuf = NULL;
   unsigned char *dp;
   unsigned int rowsize = bitmap->getRowSize();
+  unsigned char *base = (unsigned char *)(bitmap->getDataPtr());
+  bool reverse = header.Duplex && (pageNo & 1) == 0 && swap_image_y;
 
-  if (allocLineBuf) lineBuf = new unsigned char [bytesPerLine];
+  base += rowsize * y + popplerBitsPerPixel * x / 8;
   if ((pageNo & 1) == 0) {
     convertLine = convertLineEven;
   } else {
     convertLine = convertLineOdd;
   }
-  if (header.Duplex && (pageNo & 1) == 0 && swap_image_y) {
+#ifdef HAVE_PTHREAD_H
+  bool threaded = numThreads > 1;
+#ifdef USE_LCMS1
+  /* lcms 1 transforms cache the last pixel in the transform itself and
+     cannot be shared between threads */
+  if (colorTransform != NULL) threaded = false;
+#endif
+  if (threaded && writePageImageThreaded(raster,base,rowsize,convertLine,
+        reverse,firstRow,numRows)) return;
+#endif /* HAVE_PTHREAD_H */
+  if (allocLineBuf) lineBuf = new unsigned char [bytesPerLine];
+  if (reverse) {
     for (unsigned int plane = 0;plane < nplanes;plane++) {
-      unsigned char *bp = (unsigned char *)(bitmap->getDataPtr());
+      unsigned char *bp = base + rowsize * (numRows - 1);
 
-      bp += rowsize * (bitmapoffset[1] + header.cupsHeight - 1) +
-        popplerBitsPerPixel * bitmapoffset[0] / 8;
-      for (unsigned int h = header.cupsHeight;h > 0;h--) {
+      for (unsigned int h = firstRow + numRows;h > firstRow;h--) {
         for (unsigned int band = 0;band < nbands;band++) {
           dp = convertLine(bp,lineBuf,h,plane+band,header.cupsWidth,
                  bytesPerLine);
@@ -1668,11 +1871,9 @@ static void writePageImage(cups_raster_t *raster, SplashBitmap *bitmap,
     }
   } else {
     for (unsigned int plane = 0;plane < nplanes;plane++) {
-      unsigned char *bp = (unsigned char *)(bitmap->getDataPtr());
+      unsigned char *bp = base;
 
-      bp += rowsize * bitmapoffset[1] + 
-        popplerBitsPerPixel * bitmapoffset[0] / 8;
-      for (unsigned int h = 0;h < header.cupsHeight;h++) {
+      for (unsigned int h = firstRow;h < firstRow + numRows;h++) {
         for (unsigned int band = 0;band < nbands;band++) {
           dp = convertLine(bp,lineBuf,h,plane+band,header.cupsWidth,
                  bytesPerLine);
@@ -1685,10 +1886,32 @@ static void writePageImage(cups_raster_t *raster, SplashBitmap *bitmap,
   if (allocLineBuf) delete[] lineBuf;
 }
 
+/* number of rows to render at a time, 0 to render the whole page */
+static unsigned int getBandHeight(double paperdimensions[2])
+{
+  double rowBytes = (paperdimensions[0] / 72.0 * header.HWResolution[0])
+    * popplerBitsPerPixel / 8;
+  double pageBytes = rowBytes
+    * (paperdimensions[1] / 72.0 * header.HWResolution[1]);
+  unsigned int rows;
+
+  /* the planes of planar output are written one after the other, so
+     rendering them in bands would render the page once per plane */
+  if (nplanes > 1 || bandHeight == 0) return 0;
+  if (bandHeight > 0) {
+    rows = bandHeight;
+  } else if (pageBytes > MAX_PAGE_BITMAP_SIZE && rowBytes > 0) {
+    rows = BAND_BITMAP_SIZE / rowBytes;
+    if (rows < 1) rows = 1;
+  } else {
+    return 0;
+  }
+  return rows < header.cupsHeight ? rows : 0;
+}
+
 static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
   SplashOutputDev *out, cups_raster_t *raster)
 {
-  SplashBitmap *bitmap;
   Page *page = catalog->getPage(pageNo);
   PDFRectangle mediaBox = *page->getMediaBox();
   int rotate = page->getRotate();
@@ -1698,6 +1921,7 @@ static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
   double l, swap;
   int i;
   bool landscape = 0;
+  unsigned int bandRows;
 
   fprintf(stderr, "DEBUG: mediaBox = [ %f %f %f %f ]; rotate = %d\n",
 	  mediaBox.x1, mediaBox.y1, mediaBox.x2, mediaBox.y2, rotate);
@@ -1816,10 +2040,6 @@ static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
     }
   }
 
-  doc->displayPage(out,pageNo,header.HWResolution[0],
-		   header.HWResolution[1],(landscape == 0 ? 0 : 90),
-		   true,true,true);
-  bitmap = out->getBitmap();
   bitmapoffset[0] = margins[0] / 72.0 * header.HWResolution[0];
   bitmapoffset[1] = margins[3] / 72.0 * header.HWResolution[1];
 
@@ -1868,7 +2088,33 @@ static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
   }
 
   /* write page image */
-  writePageImage(raster,bitmap,pageNo);
+  bandRows = getBandHeight(paperdimensions);
+  if (bandRows == 0) {
+    doc->displayPage(out,pageNo,header.HWResolution[0],
+		     header.HWResolution[1],(landscape == 0 ? 0 : 90),
+		     true,true,true);
+    writePageImage(raster,out->getBitmap(),pageNo,0,header.cupsHeight,
+      bitmapoffset[0],bitmapoffset[1]);
+  } else {
+    /* render the page in slices of bandRows rows, bottom slice first for
+       the back side of a flipped duplex page */
+    unsigned int numBands = (header.cupsHeight + bandRows - 1) / bandRows;
+    bool reverse = header.Duplex && (pageNo & 1) == 0 && swap_image_y;
+
+    fprintf(stderr, "DEBUG: Rendering page %d in %u bands of %u rows\n",
+      pageNo, numBands, bandRows);
+    for (unsigned int b = 0;b < numBands;b++) {
+      unsigned int first = (reverse ? numBands - 1 - b : b) * bandRows;
+      unsigned int rows = header.cupsHeight - first;
+
+      if (rows > bandRows) rows = bandRows;
+      doc->displayPageSlice(out,pageNo,header.HWResolution[0],
+		       header.HWResolution[1],(landscape == 0 ? 0 : 90),
+		       true,true,true,bitmapoffset[0],bitmapoffset[1] + first,
+		       header.cupsWidth,rows);
+      writePageImage(raster,out->getBitmap(),pageNo,first,rows,0,0);
+    }
+  }
 }
 
 static void setPopplerColorProfile()
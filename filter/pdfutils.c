@@ -67,11 +67,20 @@ void pdfOut_putHexString(pdfOut *pdf,const char *str,int len) // {{{ - >len==-1:
   if (len==-1) {
     len=strlen(str);
   }
+  static const char hex[]="0123456789abcdef";
+  char buf[512];
+  int iA=0;
   pdf->filepos+=2*len+2;
   putc('<',stdout);
   for (;len>0;str++,len--) {
-    fprintf(stdout,"%02x",(unsigned char)*str);
+    buf[iA++]=hex[(unsigned char)*str>>4];
+    buf[iA++]=hex[*str&0x0f];
+    if (iA==sizeof(buf)) {
+      fwrite(buf,1,iA,stdout);
+      iA=0;
+    }
   }
+  fwrite(buf,1,iA,stdout);
   putc('>',stdout);
 }
 // }}}
@@ -81,6 +81,7 @@ int		PrinterPlanes,		/* # of color planes */
 		PrinterLength;		/* Length of page */
 cups_lut_t	*DitherLuts[7];		/* Lookup tables for dithering */
 cups_dither_t	*DitherStates[7];	/* Dither state tables */
+cups_screen_t	*DitherScreens[7];	/* Screens used instead of dithering */
 int		OutputFeed;		/* Number of lines to skip */
 int		Canceled;		/* Is the job canceled? */
 
@@ -340,6 +341,10 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
 
     if (!DitherLuts[plane])
       DitherLuts[plane] = cupsLutNew(2, default_lut);
+
+    DitherScreens[plane] = cupsScreenLoad(ppd, colormodel, header->MediaType,
+                                          resolution, DitherLuts[plane],
+					  header->cupsWidth, plane);
   }
 
   if (DitherLuts[0][4095].pixel > 1)
@@ -1159,6 +1164,7 @@ EndPage(ppd_file_t         *ppd,	/* I - PPD file */
   for (i = 0; i < PrinterPlanes; i ++)
   {
     cupsDitherDelete(DitherStates[i]);
+    cupsScreenDelete(DitherScreens[i]);
     cupsLutDelete(DitherLuts[i]);
   }
 
@@ -1621,8 +1627,13 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
 
   for (plane = 0; plane < PrinterPlanes; plane ++)
   {
-    cupsDitherLine(DitherStates[plane], DitherLuts[plane], InputBuffer + plane,
-                   PrinterPlanes, OutputBuffers[plane]);
+    if (DitherScreens[plane])
+      cupsScreenLine(DitherScreens[plane], InputBuffer + plane, PrinterPlanes,
+                     OutputBuffers[plane]);
+    else
+      cupsDitherLine(DitherStates[plane], DitherLuts[plane],
+                     InputBuffer + plane, PrinterPlanes,
+		     OutputBuffers[plane]);
 
     if (DotRowMax == 1)
     {
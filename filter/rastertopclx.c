@@ -61,6 +61,7 @@ unsigned char	*PixelBuffer,		/* Pixel buffer */
 short		*InputBuffer;		/* Color separation buffer */
 cups_lut_t	*DitherLuts[6];		/* Lookup tables for dithering */
 cups_dither_t	*DitherStates[6];	/* Dither state tables */
+cups_screen_t	*DitherScreens[6];	/* Screens used instead of dithering */
 int		PrinterPlanes,		/* Number of color planes */
 		SeedInvalid,		/* Contents of seed buffer invalid? */
 		DotBits[6],		/* Number of bits per color */
@@ -442,6 +443,11 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
 
       if (!DitherLuts[plane])
 	DitherLuts[plane] = cupsLutNew(2, default_lut);
+
+      DitherScreens[plane] = cupsScreenLoad(ppd, colormodel,
+                                            header->MediaType, resolution,
+					    DitherLuts[plane],
+					    header->cupsWidth, plane);
     }
   }
 
@@ -872,6 +878,7 @@ EndPage(ppd_file_t         *ppd,	/* I - PPD file */
     for (plane = 0; plane < PrinterPlanes; plane ++)
     {
       cupsDitherDelete(DitherStates[plane]);
+      cupsScreenDelete(DitherScreens[plane]);
       cupsLutDelete(DitherLuts[plane]);
     }
 
@@ -1775,8 +1782,13 @@ ReadLine(cups_raster_t      *ras,	/* I - Raster stream */
   */
 
   for (plane = 0; plane < PrinterPlanes; plane ++)
-    cupsDitherLine(DitherStates[plane], DitherLuts[plane], InputBuffer + plane,
-                   PrinterPlanes, OutputBuffers[plane]);
+    if (DitherScreens[plane])
+      cupsScreenLine(DitherScreens[plane], InputBuffer + plane, PrinterPlanes,
+                     OutputBuffers[plane]);
+    else
+      cupsDitherLine(DitherStates[plane], DitherLuts[plane],
+                     InputBuffer + plane, PrinterPlanes,
+		     OutputBuffers[plane]);
 
  /*
   * Return 1 to indicate that we have non-blank output...
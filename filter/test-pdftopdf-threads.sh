@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Run time of pdftopdf for an n-up job with 1 to 16 threads combining
+# the contents of the subpages.  Use a large document (hundreds of pages)
+# to see the scaling.  Run it from the build directory:
+#
+#     filter/test-pdftopdf-threads.sh [file.pdf [number-up]]
+
+PDF=${1:-`dirname $0`/../data/default-testpage.pdf}
+NUP=${2:-4}
+
+unset PPD
+export FINAL_CONTENT_TYPE=application/pdf
+
+printf "%-8s %12s %10s\n" threads bytes seconds
+for threads in 1 2 4 8 16; do
+	opts="number-up=$NUP pdftopdf-threads=$threads"
+	start=`date +%s.%N`
+	bytes=`./pdftopdf 1 user title 1 "$opts" "$PDF" 2>/dev/null | wc -c`
+	end=`date +%s.%N`
+	printf "%-8s %12s %10.2f\n" $threads $bytes `echo "$end - $start" | bc`
+done
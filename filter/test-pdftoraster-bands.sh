@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Peak memory of pdftoraster rendering whole pages and rendering them in
+# bands, at increasing resolutions.  Run it from the build directory:
+#
+#     filter/test-pdftoraster-bands.sh [file.pdf [color-mode]]
+#
+# Needs GNU time for the peak resident set size.
+
+PDF=${1:-`dirname $0`/../data/default-testpage.pdf}
+MODE=${2:-cmyk_8}
+TIME=${TIME:-/usr/bin/time}
+
+if ! $TIME -f %M true >/dev/null 2>&1; then
+	echo "$TIME -f %M does not work, GNU time is needed."
+	exit 1
+fi
+
+unset PPD
+export FINAL_CONTENT_TYPE=application/vnd.cups-raster
+
+printf "%-6s %-12s %12s %10s\n" dpi band-height "peak RSS KB" seconds
+for res in 150 300 600 1200; do
+	for band in 0 512 64; do
+		opts="printer-resolution=${res}dpi print-color-mode=$MODE media=iso_a3_297x420mm band-height=$band"
+		start=`date +%s.%N`
+		rss=`$TIME -f %M ./pdftoraster 1 user title 1 "$opts" "$PDF" 2>&1 >/dev/null | tail -1`
+		end=`date +%s.%N`
+		printf "%-6s %-12s %12s %10.2f\n" $res $band "$rss" \
+		       `echo "$end - $start" | bc`
+	done
+done
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Check texttopdf's cache of font lookups: a cached font is used without
+# asking fontconfig, and it is looked up again when its file changed or
+# when the fontconfig state changed.  The cached font is replaced by
+# another font (default: one from the same directory).  Needs
+# charsets/pdf.utf-8 in CUPS_DATADIR; run it from the build directory:
+#
+#     filter/test-texttopdf-fontcache.sh [font.ttf]
+
+DIR=`mktemp -d`
+trap 'rm -rf "$DIR"' 0
+CACHE=$DIR/texttopdf-fonts
+echo "Font cache test" > "$DIR/text.txt"
+
+unset PPD
+
+# name of the first font in the output, without the subset tag
+run() {
+	CUPS_CACHEDIR=$DIR CHARSET=utf-8 ./texttopdf 1 user title 1 "" \
+		"$DIR/text.txt" 2>/dev/null | grep -a /BaseFont | head -n 1 |
+		sed 's,.*[/+],,'
+}
+
+# set the fontconfig state (unless empty) and the monospace entry
+rewrite() {
+	awk -F '\t' -v OFS='\t' -v state="$1" -v file="$2" -v mtime="$3" '
+		NR == 1 && state != "" { $2 = state }
+		$1 == "monospace" { $2 = 0; $3 = mtime; $4 = file }
+		{ print }' "$CACHE" > "$CACHE.new" && mv "$CACHE.new" "$CACHE"
+}
+
+fail() {
+	echo "FAIL: $1"
+	exit 1
+}
+
+font=`run`
+[ -n "$font" ] || fail "no font in the output"
+[ -f "$CACHE" ] || fail "no cache file written"
+file=`awk -F '\t' '$1 == "monospace" { print $4 }' "$CACHE"`
+[ -f "$file" ] || fail "monospace was not cached"
+
+other=$1
+if [ -z "$other" ]; then
+	for other in `dirname "$file"`/*.ttf; do
+		[ "$other" != "$file" ] && break
+	done
+fi
+[ -f "$other" ] && [ "$other" != "$file" ] || fail "no other font to cache"
+mtime=`stat -c %Y "$other"`
+
+rewrite "" "$other" $mtime
+[ "`run`" != "$font" ] || fail "cached font not used"
+grep -q "	$other\$" "$CACHE" || fail "cache rewritten on a hit"
+
+rewrite "" "$other" 1
+[ "`run`" = "$font" ] || fail "changed font file not looked up again"
+grep -q "	$file\$" "$CACHE" || fail "cache entry not updated"
+
+rewrite "0 0 0 0 0 0 0 0" "$other" $mtime
+[ "`run`" = "$font" ] || fail "changed fontconfig state not noticed"
+
+echo PASS
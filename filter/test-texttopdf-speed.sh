@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Run time of texttopdf on a large log file, with the standard Courier
+# fonts and with the embedded fonts of the UTF-8 charset (which needs
+# charsets/pdf.utf-8 in CUPS_DATADIR).  Pass a text file, or the number of
+# lines of a generated log (default 300000, about 23 MB); run it from the
+# build directory:
+#
+#     filter/test-texttopdf-speed.sh [file.txt | lines]
+
+LINES=300000
+if [ $# -gt 0 ] && [ -f "$1" ]; then
+	TEXT=$1
+else
+	[ $# -gt 0 ] && LINES=$1
+	TEXT=`mktemp`
+	trap 'rm -f "$TEXT"' 0
+	awk -v n=$LINES 'BEGIN {
+		srand(1);
+		for (i = 0; i < n; i ++)
+			printf "2016-10-16 12:%02d:%02d host%d kernel: [%8.3f] eth0: link %s, %d packets\n",
+			       int(i / 60) % 60, i % 60, i % 7, i * 0.013,
+			       (rand() < 0.5 ? "up" : "down"), int(rand() * 100000);
+	}' > "$TEXT"
+fi
+
+unset PPD
+
+printf "%-10s %12s %12s %10s\n" charset "text bytes" "pdf bytes" seconds
+for charset in us-ascii utf-8; do
+	start=`date +%s.%N`
+	bytes=`CHARSET=$charset ./texttopdf 1 user title 1 "" "$TEXT" 2>/dev/null | wc -c`
+	end=`date +%s.%N`
+	printf "%-10s %12s %12s %10.2f\n" $charset `wc -c < "$TEXT"` $bytes \
+	       `echo "$end - $start" | bc`
+done
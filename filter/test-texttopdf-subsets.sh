@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Check texttopdf's font-subset-pages option on a text whose pages repeat
+# three glyph sets: with font-subset-pages=1 every page gets its own font
+# resource dictionary, but each of the three subsets is embedded only
+# once.  The xref table must point at the objects, and every object the
+# page resources refer to must be in it.  Needs charsets/pdf.utf-8 in
+# CUPS_DATADIR; run it from the build directory:
+#
+#     filter/test-texttopdf-subsets.sh
+
+LC_ALL=C
+export LC_ALL
+
+DIR=`mktemp -d`
+trap 'rm -rf "$DIR"' 0
+PDF=$DIR/out.pdf
+
+unset PPD
+
+fail() {
+	echo "FAIL: $1"
+	exit 1
+}
+
+# 30 pages of 40 lines, the glyph sets take turns
+awk 'BEGIN {
+	split("ABCDEFGHIJKLMNOPQRST abcdefghijklmnopqrst 0123456789+-*/=<>()",
+	      sets, " ");
+	for (p = 0; p < 30; p ++) {
+		if (p)
+			printf "\f";
+		for (l = 0; l < 40; l ++)
+			print sets[p % 3 + 1] sets[p % 3 + 1];
+	}
+}' > "$DIR/text.txt"
+
+CHARSET=utf-8 ./texttopdf 1 user title 1 "font-subset-pages=1" \
+	"$DIR/text.txt" > "$PDF" 2>/dev/null || fail "texttopdf failed"
+
+pages=`grep -ac '^<</Type/Page$' "$PDF"`
+[ "$pages" -eq 30 ] || fail "$pages pages instead of 30"
+fontfiles=`grep -ac '/FontFile' "$PDF"`
+[ "$fontfiles" -eq 3 ] || fail "$fontfiles font files instead of 3"
+
+# objects in the xref table whose offset points at them
+grep -abo '^[0-9][0-9]* 0 obj' "$PDF" | sed 's/^\([0-9]*\):\([0-9]*\) .*/\1 \2/' \
+	> "$DIR/offsets"
+sed -n '/^xref/,/^trailer/p' "$PDF" | tr -d '\r' |
+	awk 'NR == FNR { at[$1] = $2; next }
+	     NF == 2 { num = $1; next }
+	     $3 == "n" && at[$1 + 0] == num { print num }
+	     NF == 3 { num ++ }' "$DIR/offsets" - > "$DIR/objects"
+
+resdicts=`grep -a '/Resources << /Font [0-9]* 0 R' "$PDF" |
+	sed 's/.*Font \([0-9]*\) 0 R.*/\1/' | sort -u`
+[ `echo "$resdicts" | wc -l` -eq 30 ] || fail "no resources for every page"
+
+for res in $resdicts; do
+	grep -qx "$res" "$DIR/objects" || fail "resources $res not in the xref"
+	fonts=`sed -n "/^$res 0 obj\$/,/^endobj\$/p" "$PDF" |
+		sed -n 's/.* \([0-9]*\) 0 R$/\1/p'`
+	[ -n "$fonts" ] || fail "no fonts in resources $res"
+	for font in $fonts; do
+		grep -qx "$font" "$DIR/objects" ||
+			fail "font $font of resources $res not in the xref"
+	done
+done
+
+echo PASS
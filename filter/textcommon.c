@@ -35,7 +35,8 @@ int	WrapLines = 1,		/* Wrap text in lines */
 	ColumnGutter = 0,	/* Number of characters between text columns */
 	ColumnWidth = 80,	/* Width of each column */
 	PrettyPrint = 0,	/* Do pretty code formatting */
-	Copies = 1;		/* Number of copies */
+	Copies = 1,		/* Number of copies */
+	FontSubsetPages = 0;	/* Pages per font subset, 0 = one for all */
 lchar_t	**Page = NULL;		/* Page characters */
 int	NumPages = 0;		/* Number of pages in document */
 float	CharsPerInch = 10;	/* Number of character columns per inch */
@@ -639,6 +640,20 @@ TextMain(const char *name,	/* I - Name of filter */
     }
   }
 
+  if ((val = cupsGetOption("font-subset-pages", num_options, options)) != NULL)
+  {
+    FontSubsetPages = atoi(val);
+
+    if (FontSubsetPages < 0)
+    {
+      if (fp != stdin)
+        fclose(fp);
+      fprintf(stderr, "ERROR: Bad font-subset-pages value %d.\n",
+	      FontSubsetPages);
+      return (1);
+    }
+  }
+
   if (PrettyPrint)
     PageTop -= 216.0f / LinesPerInch;
 
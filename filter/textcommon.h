@@ -73,7 +73,8 @@ extern int	WrapLines,	/* Wrap text in lines */
 		ColumnGutter,	/* Number of characters between text columns */
 		ColumnWidth,	/* Width of each column */
 		PrettyPrint,	/* Do pretty code formatting? */
-		Copies;		/* Number of copies to produce */
+		Copies,		/* Number of copies to produce */
+		FontSubsetPages;/* Pages per font subset, 0 = one for all */
 extern lchar_t	**Page;		/* Page characters */
 extern int	NumPages;	/* Number of pages in document */
 extern float	CharsPerInch,	/* Number of character columns per inch */
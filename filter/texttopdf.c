@@ -28,6 +28,8 @@
 #include "pdfutils.h"
 #include "fontembed/embed.h"
 #include <assert.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "fontembed/sfnt.h"
 #include <fontconfig/fontconfig.h>
 
@@ -41,19 +43,218 @@ int     UTF8 = 1;               /* Use UTF-8 encoding? */
 
 EMB_PARAMS *font_load(const char *font);
 
+/*
+ * Cache of the font lookups of font_load(), shared by all jobs: asking
+ * fontconfig takes far longer than printing a short text file.  The cache
+ * file has one line per font name, with the index of the font in its file
+ * (-1 for CFF), the modification time and the name of the font file;
+ * names with tabs or newlines are never cached.  Entries whose font file
+ * was changed or removed are looked up again, and the whole cache is
+ * dropped when the fontconfig state changes: the first line has the
+ * modification times of fontconfig's configuration, of its cache
+ * directories (written by fc-cache when fonts are installed or removed)
+ * and of the standard font directories.
+ */
+
+typedef struct font_cache_s {
+  char		*name;		/* Font name as in the charset file */
+  int		index;		/* Index in TTC, -1 for CFF */
+  time_t	mtime;		/* Modification time of font file */
+  char		*file;		/* Font file */
+} font_cache_t;
+
+static font_cache_t *FontCache = NULL;	/* Cached font lookups */
+static int	NumFontCache = -1;	/* Number of cached lookups, -1 = not read */
+static char	FontCacheState[1024];	/* Fontconfig state of the cached lookups */
+
+static void font_cache_state(char *buf, size_t bufsize)
+{
+  const char *confdir = getenv("FONTCONFIG_PATH"),
+	     *conffile = getenv("FONTCONFIG_FILE"),
+	     *xdgcache = getenv("XDG_CACHE_HOME"),
+	     *home = getenv("HOME");
+  char paths[8][1024];
+  struct stat st;
+  size_t len;
+  int i;
+
+  if (!confdir || !*confdir)
+    confdir = "/etc/fonts";
+  snprintf(paths[0], sizeof(paths[0]), "%s", confdir);
+  snprintf(paths[1], sizeof(paths[1]), "%s/conf.d", confdir);
+  snprintf(paths[2], sizeof(paths[2]), "%s/local.conf", confdir);
+  if (conffile && *conffile)
+    snprintf(paths[3], sizeof(paths[3]), "%s", conffile);
+  else
+    snprintf(paths[3], sizeof(paths[3]), "%s/fonts.conf", confdir);
+  snprintf(paths[4], sizeof(paths[4]), "/var/cache/fontconfig");
+  if (xdgcache && *xdgcache)
+    snprintf(paths[5], sizeof(paths[5]), "%s/fontconfig", xdgcache);
+  else if (home && *home)
+    snprintf(paths[5], sizeof(paths[5]), "%s/.cache/fontconfig", home);
+  else
+    paths[5][0] = '\0';
+  snprintf(paths[6], sizeof(paths[6]), "/usr/share/fonts");
+  snprintf(paths[7], sizeof(paths[7]), "/usr/local/share/fonts");
+
+  for (i = 0, len = 0; i < 8 && len < bufsize; i ++) {
+    if (stat(paths[i], &st))
+      st.st_mtime = 0;
+    snprintf(buf + len, bufsize - len, "%s%lld", i ? " " : "",
+	     (long long)st.st_mtime);
+    len += strlen(buf + len);
+  }
+}
+
+static int font_cache_filename(char *buf, size_t bufsize)
+{
+  const char *dir = getenv("CUPS_CACHEDIR");
+
+  if (!dir || !*dir)
+    return 0;
+  snprintf(buf, bufsize, "%s/texttopdf-fonts", dir);
+  return 1;
+}
+
+static void font_cache_read(void)
+{
+  char filename[1024], line[2048], *ptr, *index, *mtime;
+  FILE *fp;
+  font_cache_t *entry;
+
+  NumFontCache = 0;
+  font_cache_state(FontCacheState, sizeof(FontCacheState));
+  if (!font_cache_filename(filename, sizeof(filename)) ||
+      (fp = fopen(filename, "r")) == NULL)
+    return;
+
+  // fonts may have been installed or removed, or the configuration changed
+  if (!fgets(line, sizeof(line), fp) || (ptr = strchr(line, '\n')) == NULL) {
+    fclose(fp);
+    return;
+  }
+  *ptr = '\0';
+  if (strncmp(line, "#\t", 2) || strcmp(line + 2, FontCacheState)) {
+    fclose(fp);
+    return;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    if ((ptr = strchr(line, '\n')) == NULL)
+      continue; // too long
+    *ptr = '\0';
+    if ((index = strchr(line, '\t')) == NULL)
+      continue;
+    *index++ = '\0';
+    if ((mtime = strchr(index, '\t')) == NULL)
+      continue;
+    *mtime++ = '\0';
+    if ((ptr = strchr(mtime, '\t')) == NULL)
+      continue;
+    *ptr++ = '\0';
+
+    if ((entry = realloc(FontCache, (NumFontCache + 1) *
+			 sizeof(font_cache_t))) == NULL)
+      break;
+    FontCache = entry;
+    entry += NumFontCache ++;
+    entry->name = strdup(line);
+    entry->index = atoi(index);
+    entry->mtime = (time_t)strtoll(mtime, NULL, 10);
+    entry->file = strdup(ptr);
+  }
+  fclose(fp);
+}
+
+static void font_cache_write(void)
+{
+  char filename[1024], tempname[1040];
+  FILE *fp;
+  int i;
+
+  if (!font_cache_filename(filename, sizeof(filename)))
+    return;
+  // other jobs may read the cache meanwhile
+  snprintf(tempname, sizeof(tempname), "%s.%d", filename, (int)getpid());
+  if ((fp = fopen(tempname, "w")) == NULL)
+    return;
+  fprintf(fp, "#\t%s\n", FontCacheState);
+  for (i = 0; i < NumFontCache; i ++)
+    fprintf(fp, "%s\t%d\t%lld\t%s\n", FontCache[i].name, FontCache[i].index,
+	    (long long)FontCache[i].mtime, FontCache[i].file);
+  if (fclose(fp) || rename(tempname, filename))
+    unlink(tempname);
+}
+
+/* Returns the font file for >name, or NULL when not cached (any more) */
+static const char *font_cache_lookup(const char *name, int *index)
+{
+  struct stat st;
+  int i;
+
+  if (NumFontCache < 0)
+    font_cache_read();
+  for (i = 0; i < NumFontCache; i ++)
+    if (!strcmp(FontCache[i].name, name)) {
+      if (stat(FontCache[i].file, &st) || st.st_mtime != FontCache[i].mtime)
+	return NULL;
+      *index = FontCache[i].index;
+      return FontCache[i].file;
+    }
+  return NULL;
+}
+
+static void font_cache_add(const char *name, const char *file, int index)
+{
+  struct stat st;
+  font_cache_t *entry;
+  int i;
+
+  // the fields of the cache file are separated by tabs and newlines
+  if (strpbrk(name, "\t\n") || strpbrk(file, "\t\n") || stat(file, &st))
+    return;
+
+  for (i = 0; i < NumFontCache; i ++)
+    if (!strcmp(FontCache[i].name, name))
+      break;
+  if (i == NumFontCache) {
+    if ((entry = realloc(FontCache, (NumFontCache + 1) *
+			 sizeof(font_cache_t))) == NULL)
+      return;
+    FontCache = entry;
+    NumFontCache ++;
+    FontCache[i].name = strdup(name);
+  } else
+    free(FontCache[i].file);
+  FontCache[i].index = index;
+  FontCache[i].mtime = st.st_mtime;
+  FontCache[i].file = strdup(file);
+
+  font_cache_write();
+}
+
 EMB_PARAMS *font_load(const char *font)
 {
   OTF_FILE *otf;
 
   FcPattern *pattern;
   FcFontSet *candidates;
-  FcChar8   *fontname = NULL;
+  FcChar8   *fontfile = NULL;
+  int        fontindex = 0;
+  char       fontname[1024];
+  const char *cached;
   FcResult   result;
   int i;
 
   if ( (font[0]=='/')||(font[0]=='.') ) {
     candidates = NULL;
-    fontname=(FcChar8 *)strdup(font);
+    snprintf(fontname, sizeof(fontname), "%s", font);
+  } else if ((cached = font_cache_lookup(font, &fontindex)) != NULL) {
+    if (fontindex >= 0) {
+      snprintf(fontname, sizeof(fontname), "%s/%d", cached, fontindex);
+    } else {
+      snprintf(fontname, sizeof(fontname), "%s", cached);
+    }
   } else {
     FcInit ();
     pattern = FcNameParse ((const FcChar8 *)font);
@@ -65,6 +266,7 @@ EMB_PARAMS *font_load(const char *font)
     candidates = FcFontSort (0, pattern, FcFalse, 0, &result);
     FcPatternDestroy (pattern);
 
+    fontname[0] = '\0';
     if (candidates) {
       /* In the list of fonts returned by FcFontSort()
 	 find the first one that is both in TrueType format and monospaced */
@@ -74,12 +276,16 @@ EMB_PARAMS *font_load(const char *font)
 	FcPatternGetString  (candidates->fonts[i], FC_FONTFORMAT, 0, &fontformat);
 	FcPatternGetInteger (candidates->fonts[i], FC_SPACING,    0, &spacing);
 
-	if ( (fontformat)&&(spacing == FC_MONO) ) {
+	if ( (fontformat)&&(spacing == FC_MONO)&&
+	     (FcPatternGetString (candidates->fonts[i], FC_FILE, 0, &fontfile) == FcResultMatch) ) {
 	  if (strcmp((const char *)fontformat, "TrueType") == 0) {
-	    fontname = FcPatternFormat (candidates->fonts[i], (const FcChar8 *)"%{file|cescape}/%{index}");
+	    FcPatternGetInteger (candidates->fonts[i], FC_INDEX, 0, &fontindex);
+	    snprintf(fontname, sizeof(fontname), "%s/%d", (const char *)fontfile, fontindex);
+	    font_cache_add(font, (const char *)fontfile, fontindex);
 	    break;
 	  } else if (strcmp((const char *)fontformat, "CFF") == 0) {
-	    fontname = FcPatternFormat (candidates->fonts[i], (const FcChar8 *)"%{file|cescape}"); // TTC only possible with non-cff glyphs!
+	    snprintf(fontname, sizeof(fontname), "%s", (const char *)fontfile); // TTC only possible with non-cff glyphs!
+	    font_cache_add(font, (const char *)fontfile, -1);
 	    break;
 	  }
 	}
@@ -88,14 +294,13 @@ EMB_PARAMS *font_load(const char *font)
     }
   }
 
-  if (!fontname) {
+  if (!fontname[0]) {
     // TODO: try /usr/share/fonts/*/*/%s.ttf
     fprintf(stderr,"No viable font found\n");
     return NULL;
   }
 
-  otf = otf_load((const char *)fontname);
-  free(fontname);
+  otf = otf_load(fontname);
   if (!otf) {
     return NULL;
   }
@@ -161,11 +366,68 @@ main(int  argc,		/* I - Number of command-line arguments */
 
 
 /*
- * 'WriteEpilogue()' - Write the PDF file epilogue.
+ * Font subsets written so far, to reuse them for later pages that need no
+ * other glyphs (with the "font-subset-pages" option).
  */
 
-void
-WriteEpilogue(void)
+typedef struct font_subset_s {
+  EMB_PARAMS	*emb;		/* Font */
+  BITSET	glyphs;		/* Glyphs in the subset */
+  int		obj;		/* Object number of the font */
+} font_subset_t;
+
+static font_subset_t *Subsets = NULL;	/* Font subsets written so far */
+static int	NumSubsets = 0;		/* Number of subsets written */
+
+static int subset_size(EMB_PARAMS *emb) // in ints, as allocated by bitset_new()
+{
+  return (emb->font->sfnt->numGlyphs+8*sizeof(int)-1)/(8*sizeof(int));
+}
+
+/* Returns an already written subset of >emb with all glyphs it needs now */
+static int find_subset(EMB_PARAMS *emb)
+{
+  const int size=subset_size(emb);
+  int i,j;
+
+  for (i = 0; i < NumSubsets; i ++) {
+    if (Subsets[i].emb != emb)
+      continue;
+    for (j = 0; j < size; j ++)
+      if (emb->subset[j] & ~Subsets[i].glyphs[j])
+	break;
+    if (j == size)
+      return Subsets[i].obj;
+  }
+  return 0;
+}
+
+static void add_subset(EMB_PARAMS *emb)
+{
+  const int size=subset_size(emb);
+  font_subset_t *subset;
+
+  if ((subset = realloc(Subsets, (NumSubsets + 1) *
+			sizeof(font_subset_t))) == NULL)
+    return;
+  Subsets = subset;
+  subset += NumSubsets;
+  if ((subset->glyphs = malloc(size * sizeof(int))) == NULL)
+    return;
+  memcpy(subset->glyphs, emb->subset, size * sizeof(int));
+  subset->emb = emb;
+  subset->obj = emb->font->fobj;
+  NumSubsets ++;
+}
+
+
+/*
+ * 'write_fonts()' - Write the fonts used since the last call and the font
+ *                   resource dictionary for these pages.
+ */
+
+static void
+write_fonts(void)
 {
   static char	*names[] =	/* Font names */
 		{ "FN","FB","FI","FBI" };
@@ -179,15 +441,24 @@ WriteEpilogue(void)
       if (emb->font->fobj) { // already embedded
         continue;
       }
-      if ( (!emb->subset)||(bits_used(emb->subset,emb->font->sfnt->numGlyphs)) ) {
+      if (!emb->subset) {
         emb->font->fobj=pdfOut_write_font(pdf,emb);
         assert(emb->font->fobj);
+      } else if (bits_used(emb->subset,emb->font->sfnt->numGlyphs)) {
+        // same glyphs as (or fewer than) in earlier pages?
+        if ((emb->font->fobj=find_subset(emb)) == 0) {
+          emb->font->fobj=pdfOut_write_font(pdf,emb);
+          assert(emb->font->fobj);
+          if (FontSubsetPages) {
+            add_subset(emb);
+          }
+        }
       }
     }
   }
 
   /*
-   * Create the global fontdict
+   * Create the fontdict
    */
 
   // now fix FontResource
@@ -208,9 +479,37 @@ WriteEpilogue(void)
   pdfOut_printf(pdf,">>\n"
                     "endobj\n");
 
+  // start the next subsets empty
+  for (i = PrettyPrint ? 3 : 1; i >= 0; i --) {
+    for (j = 0; j < NumFonts; j ++) {
+      EMB_PARAMS *emb=Fonts[j][i];
+      if (emb->subset) {
+        memset(emb->subset,0,subset_size(emb)*sizeof(int));
+        emb->font->fobj=0;
+      }
+    }
+  }
+}
+
+
+/*
+ * 'WriteEpilogue()' - Write the PDF file epilogue.
+ */
+
+void
+WriteEpilogue(void)
+{
+  int i;
+
+  write_fonts();
+
   pdfOut_finish_pdf(pdf);
 
   pdfOut_free(pdf);
+
+  for (i = 0; i < NumSubsets; i ++)
+    free(Subsets[i].glyphs);
+  free(Subsets);
 }
 
 /*
@@ -262,6 +561,12 @@ WritePage(void)
                     obj,PageWidth,PageLength,content,FontResource);
   pdfOut_add_page(pdf,obj);
 
+  // output the fonts used so far, instead of all at the end
+  if (FontSubsetPages && NumPages % FontSubsetPages == 0) {
+    write_fonts();
+    FontResource=pdfOut_add_xref(pdf);
+  }
+
   memset(Page[0], 0, sizeof(lchar_t) * SizeColumns * SizeLines);
 }
 // }}}
@@ -1079,6 +1384,8 @@ static void write_font_str(float x,float y,int fontid, lchar_t *str, int len)
   unsigned short		ch;		/* Current character */
   static char	*names[] =	/* Font names */
 		{ "FN","FB","FI","FBI" };
+  static char	*run = NULL;	/* Glyphs of the current run */
+  static int	runalloc = 0;	/* Allocated size of run */
 
   if (len==-1) {
     for (len=0;str[len].ch;len++);
@@ -1120,9 +1427,20 @@ static void write_font_str(float x,float y,int fontid, lchar_t *str, int len)
                         FontScaleX*100.0/FontScaleY); // TODO?
     }
 
-    pdfOut_printf(pdf,"  /%s%02x %.3f Tf <",
+    pdfOut_printf(pdf,"  /%s%02x %.3f Tf ",
                       names[fontid],lastfont,FontScaleY);
 
+    // collect the whole run, to output it at once
+    if (runalloc < 2*len) {
+      char *tmp=realloc(run,2*len);
+      if (!tmp) {
+        fprintf(stderr,"ERROR: Cannot allocate memory\n");
+        exit(1);
+      }
+      run=tmp;
+      runalloc=2*len;
+    }
+    int runlen=0;
     while (len > 0)
     {
       if (UTF8) {
@@ -1137,16 +1455,19 @@ static void write_font_str(float x,float y,int fontid, lchar_t *str, int len)
       }
       if (otf) { // TODO 
         const unsigned short gid=emb_get(emb,ch);
-        pdfOut_printf(pdf,"%04x", gid);
+        run[runlen++]=gid>>8;
+        run[runlen++]=gid&0xff;
       } else { // std 14 font with 7-bit us-ascii uses single byte encoding, TODO
-        pdfOut_printf(pdf,"%02x",ch);
+        // no glyph beyond one byte, show that something is missing
+        run[runlen++]=(ch<0x100)?ch:'?';
       }
 
       len --;
       str ++;
     }
 
-    pdfOut_printf(pdf,"> Tj\n");
+    pdfOut_putHexString(pdf,run,runlen);
+    pdfOut_printf(pdf," Tj\n");
   }
   pdfOut_printf(pdf,"ET\n");
 }
@@ -253,8 +253,17 @@ EMB_PDF_FONTWIDTHS *emb_pdf_fw_cidwidths(const BITSET glyphs,int len,int default
   size+=in_region;
 
   if (freq) {
-    default_width=frequent_get(freq,0);
+    // e.g. the few glyphs of one page may be mostly zero-width marks
+    for (iA=0;iA<3;iA++) {
+      default_width=frequent_get(freq,iA);
+      if (default_width>0) {
+        break;
+      }
+    }
     free(freq);
+    if (default_width<=0) {
+      default_width=1000; // PDF's default /DW
+    }
   }
   assert(default_width>0);
 
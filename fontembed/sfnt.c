@@ -1,9 +1,14 @@
+#include "config.h"
 #include "sfnt.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "sfnt_int.h"
 
 // TODO?
@@ -73,12 +78,35 @@ static OTF_FILE *otf_new(FILE *f) // {{{
   if (ret) {
     ret->f=f;
     ret->version=0x00010000;
+#ifdef HAVE_MMAP
+    // map the whole file, tables and glyphs are then used in place;
+    // if this fails, we just read from >f
+    struct stat st;
+    if ( (fstat(fileno(f),&st)==0)&&(st.st_size>0) ) {
+      void *map=mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fileno(f),0);
+      if (map!=MAP_FAILED) {
+        ret->map=map;
+        ret->mapSize=st.st_size;
+      }
+    }
+#endif
   }
 
   return ret;
 }
 // }}}
 
+// pointer to >length bytes at >pos in the mapped file, or NULL
+const char *otf_map_ptr(OTF_FILE *otf,long pos,int length) // {{{
+{
+  if ( (!otf->map)||(pos<0)||(length<0)||
+       ((size_t)pos>otf->mapSize)||((size_t)length>otf->mapSize-pos) ) {
+    return NULL;
+  }
+  return otf->map+pos;
+}
+// }}}
+
 // will alloc, if >buf ==NULL, returns >buf, or NULL on error
 // NOTE: you probably want otf_get_table()
 static char *otf_read(OTF_FILE *otf,char *buf,long pos,int length) // {{{
@@ -92,14 +120,34 @@ static char *otf_read(OTF_FILE *otf,char *buf,long pos,int length) // {{{
     return NULL;
   }
 
+  // (+3)&~3 for checksum...
+  const int pad_len=(length+3)&~3;
+  if (otf->map) {
+    const char *data=otf_map_ptr(otf,pos,length);
+    if (!data) {
+      fprintf(stderr,"Short read\n");
+      return NULL;
+    }
+    if (!buf) {
+      buf=malloc(sizeof(char)*pad_len);
+      if (!buf) {
+        fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
+        return NULL;
+      }
+    }
+    // file size not multiple of 4, pad with zero
+    const int avail=(otf->mapSize-pos<(size_t)pad_len)?(int)(otf->mapSize-pos):pad_len;
+    memcpy(buf,data,avail);
+    memset(buf+avail,0,pad_len-avail);
+    return buf;
+  }
+
   int res=fseek(otf->f,pos,SEEK_SET);
   if (res==-1) {
     fprintf(stderr,"Seek failed: %s\n", strerror(errno));
     return NULL;
   }
 
-  // (+3)&~3 for checksum...
-  const int pad_len=(length+3)&~3;
   if (!buf) {
     ours=buf=malloc(sizeof(char)*pad_len);
     if (!buf) {
@@ -347,11 +395,25 @@ void otf_close(OTF_FILE *otf) // {{{
 {
   assert(otf);
   if (otf) {
-    free(otf->gly);
+    if (!otf->map) {
+      free(otf->gly);
+    }
+    if (otf->unipages) {
+      int iA;
+      for (iA=0;iA<(OTF_UNICODE_MAX>>8);iA++) {
+        free(otf->unipages[iA]);
+      }
+      free(otf->unipages);
+    }
     free(otf->cmap);
     free(otf->name);
     free(otf->hmtx);
     free(otf->glyphOffsets);
+#ifdef HAVE_MMAP
+    if (otf->map) {
+      munmap((void *)otf->map,otf->mapSize);
+    }
+#endif
     fclose(otf->f);
     free(otf->tables);
     free(otf);
@@ -510,9 +572,19 @@ int otf_load_glyf(OTF_FILE *otf) // {{{  - 0 on success
     }
   }
   if (otf->gly) {
-    free(otf->gly);
+    if (!otf->map) {
+      free(otf->gly);
+    }
     assert(0);
   }
+  if (otf->map) { // glyphs are used in place
+    otf->gly=(char *)otf_map_ptr(otf,otf->glyfTable->offset,otf->glyfTable->length);
+    if (!otf->gly) {
+      fprintf(stderr,"Bad glyf table \n");
+      return -1;
+    }
+    return 0;
+  }
   otf->gly=malloc(maxGlyfLen*sizeof(char));
   if (!otf->gly) {
     fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
@@ -620,6 +692,20 @@ int otf_load_cmap(OTF_FILE *otf) // {{{  - 0 on success
       assert(0);
       return -1;
     }
+    if ( (get_USHORT(nrec)==3)&&
+         (get_USHORT(nrec+2)==10)&&
+         (get_USHORT(ndata)==12) ) {
+      // format 12 has 32 bit lengths
+      if ( (offset+16>len)||
+           (get_ULONG(ndata+12)>(len-offset-16)/12) ) {
+        fprintf(stderr,"Bad cmap table \n");
+        free(cmap);
+        assert(0);
+        return -1;
+      }
+      otf->unimap32=ndata;
+      continue;
+    }
     if ( (get_USHORT(nrec)==3)&&
          (get_USHORT(nrec+2)<=1)&&
          (get_USHORT(ndata)==4)&&
@@ -726,6 +812,10 @@ int otf_get_glyph(OTF_FILE *otf,unsigned short gid) // {{{ result in >otf->gly,
   }
 
   assert(otf->glyfTable->length>=otf->glyphOffsets[gid+1]);
+  if (otf->map) { // no copy; the glyf table was checked by otf_load_glyf()
+    otf->gly=(char *)otf->map+otf->glyfTable->offset+otf->glyphOffsets[gid];
+    return len;
+  }
   if (!otf_read(otf,otf->gly,
                 otf->glyfTable->offset+otf->glyphOffsets[gid],len)) {
     return -1;
@@ -735,10 +825,30 @@ int otf_get_glyph(OTF_FILE *otf,unsigned short gid) // {{{ result in >otf->gly,
 }
 // }}}
 
-unsigned short otf_from_unicode(OTF_FILE *otf,int unicode) // {{{ 0 = missing
+static unsigned short otf_find_glyph32(OTF_FILE *otf,int unicode) // {{{ 0 = missing
+{
+  // groups of (startCharCode,endCharCode,startGlyphID), sorted
+  const char *groups=otf->unimap32+16;
+  int lo=0,hi=get_ULONG(otf->unimap32+12);
+  while (lo<hi) {
+    const int mid=(lo+hi)/2;
+    const char *group=groups+12*mid;
+    if (get_ULONG(group+4)<(unsigned int)unicode) {
+      lo=mid+1;
+    } else if (get_ULONG(group)>(unsigned int)unicode) {
+      hi=mid;
+    } else {
+      return (get_ULONG(group+8)+unicode-get_ULONG(group))&0xffff;
+    }
+  }
+  return 0;
+}
+// }}}
+
+unsigned short otf_find_glyph(OTF_FILE *otf,int unicode) // {{{ 0 = missing
 {
   assert(otf);
-  assert( (unicode>=0)&&(unicode<65536) );
+  assert( (unicode>=0)&&(unicode<OTF_UNICODE_MAX) );
 //  assert((otf->flags&OTF_F_FMT_CFF)==0); // not for CFF, other method!
 
   // ensure >cmap and >unimap is there
@@ -748,8 +858,13 @@ unsigned short otf_from_unicode(OTF_FILE *otf,int unicode) // {{{ 0 = missing
       return 0; // TODO?
     }
   }
-  if (!otf->unimap) {
-    fprintf(stderr,"Unicode (3,1) cmap in format 4 not found\n");
+  if ( (!otf->unimap)||(unicode>=65536) ) {
+    if (otf->unimap32) {
+      return otf_find_glyph32(otf,unicode);
+    }
+    if (!otf->unimap) {
+      fprintf(stderr,"Unicode (3,1) cmap in format 4 not found\n");
+    }
     return 0;
   }
 
@@ -785,6 +900,40 @@ unsigned short otf_from_unicode(OTF_FILE *otf,int unicode) // {{{ 0 = missing
 }
 // }}}
 
+// the cmap is searched only once for the 256 characters around >unicode
+unsigned short otf_from_unicode(OTF_FILE *otf,int unicode) // {{{ 0 = missing
+{
+  assert(otf);
+  assert( (unicode>=0)&&(unicode<OTF_UNICODE_MAX) );
+
+  const int page=unicode>>8;
+  if ( (otf->unipages)&&(otf->unipages[page]) ) {
+    return otf->unipages[page][unicode&0xff];
+  }
+
+  const unsigned short gid=otf_find_glyph(otf,unicode); // also loads >cmap
+  if ( (!otf->unimap)&&(!otf->unimap32) ) {
+    return 0;
+  }
+  if (!otf->unipages) {
+    otf->unipages=calloc(OTF_UNICODE_MAX>>8,sizeof(unsigned short *));
+    if (!otf->unipages) {
+      return gid;
+    }
+  }
+  unsigned short *gids=malloc(256*sizeof(unsigned short));
+  if (!gids) {
+    return gid;
+  }
+  int iA;
+  for (iA=0;iA<256;iA++) {
+    gids[iA]=otf_find_glyph(otf,(page<<8)|iA);
+  }
+  otf->unipages[page]=gids;
+  return gid;
+}
+// }}}
+
 /** output stuff **/
 int otf_action_copy(void *param,int table_no,OUTPUT_FN output,void *context) // {{{
 {
@@ -796,6 +945,12 @@ int otf_action_copy(void *param,int table_no,OUTPUT_FN output,void *context) //
     return table->length;
   }
 
+  const char *mapped=otf_map_ptr(otf,table->offset,table->length);
+  if ( (mapped)&&((table->length&3)==0) ) { // output in place
+    (*output)(mapped,table->length,context);
+    return table->length;
+  }
+
 // TODO? copy_block(otf->f,table->offset,(table->length+3)&~3,output,context);
 // problem: PS currently depends on single-output.  also checksum not possible
   char *data=otf_read(otf,NULL,table->offset,table->length);
@@ -12,6 +12,9 @@ typedef struct {
 
 typedef struct {
   FILE *f;
+  // whole file, if it could be memory-mapped; otherwise >f is read
+  const char *map;
+  size_t mapSize;
   unsigned int numTTC,useTTC;
   unsigned int version;
 
@@ -28,8 +31,12 @@ typedef struct {
   unsigned short numberOfHMetrics;
   char *hmtx,*name,*cmap;
   const char *unimap; // ptr to (3,1) or (3,0) cmap start
+  const char *unimap32; // ptr to (3,10) cmap start, in format 12
+  // unicode -> gid, filled by otf_from_unicode() 256 characters at a time
+  unsigned short **unipages;
 
-  // single glyf buffer, allocated large enough by otf_load_more()
+  // single glyf buffer, allocated large enough by otf_load_more();
+  // points into >map instead, if the file is memory-mapped
   char *gly;
   OTF_DIRENT *glyfTable;
 
@@ -50,6 +57,7 @@ char *otf_get_table(OTF_FILE *otf,unsigned int tag,int *ret_len);
 int otf_get_width(OTF_FILE *otf,unsigned short gid);
 const char *otf_get_name(OTF_FILE *otf,int platformID,int encodingID,int languageID,int nameID,int *ret_len);
 int otf_get_glyph(OTF_FILE *otf,unsigned short gid);
+#define OTF_UNICODE_MAX 0x110000
 unsigned short otf_from_unicode(OTF_FILE *otf,int unicode);
 
 #include "bitset.h"
@@ -73,6 +73,8 @@ int otf_load_glyf(OTF_FILE *otf); //  - 0 on success
 int otf_load_more(OTF_FILE *otf); //  - 0 on success
 
 int otf_find_table(OTF_FILE *otf,unsigned int tag); // - table_index  or -1 on error
+unsigned short otf_find_glyph(OTF_FILE *otf,int unicode); // like otf_from_unicode(), without the lookup table
+const char *otf_map_ptr(OTF_FILE *otf,long pos,int length); // - NULL if not memory-mapped or out of bounds
 
 int otf_action_copy(void *param,int csum,OUTPUT_FN output,void *context);
 int otf_action_replace(void *param,int csum,OUTPUT_FN output,void *context);
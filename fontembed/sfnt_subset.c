@@ -255,16 +255,23 @@ int otf_subset_cff(OTF_FILE *otf,BITSET glyphs,OUTPUT_FN output,void *context) /
 }
 // }}}
 
-//int copy_block(FILE *f,long pos,int length,OUTPUT_FN output,void *context);  // copied bytes or -1 (also on premature EOF)
+//int copy_block(OTF_FILE *otf,long pos,int length,OUTPUT_FN output,void *context);  // copied bytes or -1 (also on premature EOF)
 
-static int copy_block(FILE *f,long pos,int length,OUTPUT_FN output,void *context) // {{{
+static int copy_block(OTF_FILE *otf,long pos,int length,OUTPUT_FN output,void *context) // {{{
 {
-  assert(f);
+  assert(otf);
   assert(output);
 
   char buf[4096];
   int iA,ret;
 
+  const char *mapped=otf_map_ptr(otf,pos,length);
+  if (mapped) { // no need to copy
+    (*output)(mapped,length,context);
+    return length;
+  }
+
+  FILE *f=otf->f;
   ret=fseek(f,pos,SEEK_SET);
   if (ret==-1) {
     fprintf(stderr,"Seek failed: %s\n", strerror(errno));
@@ -302,7 +309,7 @@ int otf_cff_extract(OTF_FILE *otf,OUTPUT_FN output,void *context) // {{{ - retur
   }
   const OTF_DIRENT *table=otf->tables+idx;
 
-  return copy_block(otf->f,table->offset,table->length,output,context);
+  return copy_block(otf,table->offset,table->length,output,context);
 }
 // }}}
 
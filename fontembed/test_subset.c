@@ -0,0 +1,99 @@
+#include "sfnt.h"
+#include "sfnt_int.h"
+#include "config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Times subsetting a font to glyph sets of increasing size.
+// Use a large TTF/OTF (or "font.ttc/N" for a TTC collection), e.g. a CJK font:
+//   test_subset [font [repeat]]
+
+static void count_fn(const char *buf,int len,void *context) // {{{
+{
+  *(long *)context+=len;
+}
+// }}}
+
+static double now() // {{{
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+// }}}
+
+static long subset(OTF_FILE *otf,int num) // {{{  - bytes written
+{
+  BITSET glyphs=bitset_new(otf->numGlyphs);
+  assert(glyphs);
+  int iA;
+  for (iA=0;iA<num;iA++) {
+    // spread over the whole font, like the characters of a real text
+    bit_set(glyphs,(int)((long)iA*otf->numGlyphs/num));
+  }
+
+  long len=0;
+  int ret;
+  if (otf->flags&OTF_F_FMT_CFF) {
+    ret=otf_subset_cff(otf,glyphs,count_fn,&len);
+  } else {
+    ret=otf_subset(otf,glyphs,count_fn,&len);
+  }
+  free(glyphs);
+  assert(ret>=0);
+  assert(ret==len);
+  return len;
+}
+// }}}
+
+int main(int argc,char **argv)
+{
+  const char *fn=TESTFONT;
+  int repeat=10;
+  if (argc>=2) {
+    fn=argv[1];
+  }
+  if (argc>=3) {
+    repeat=atoi(argv[2]);
+  }
+  if (repeat<1) {
+    repeat=1;
+  }
+
+  double start=now();
+  int iA;
+  for (iA=0;iA<repeat;iA++) {
+    OTF_FILE *otf=otf_load(fn);
+    assert(otf);
+    otf_close(otf);
+  }
+  printf("%s: load %.3f ms\n",fn,(now()-start)*1000/repeat);
+
+  OTF_FILE *otf=otf_load(fn);
+  assert(otf);
+  printf("num glyphs: %d, %s\n",otf->numGlyphs,
+         (otf->flags&OTF_F_FMT_CFF)?"CFF":"TrueType");
+
+  static const int sizes[]={100,1000,5000,0};
+  int iB;
+  for (iB=0;iB<4;iB++) {
+    const int num=(sizes[iB]&&sizes[iB]<otf->numGlyphs)?sizes[iB]:otf->numGlyphs;
+    long len=0;
+    start=now();
+    for (iA=0;iA<repeat;iA++) {
+      const long res=subset(otf,num);
+      assert( (iA==0)||(res==len) ); // same result every time
+      len=res;
+    }
+    printf("subset %5d glyphs: %8ld bytes, %.3f ms\n",num,len,(now()-start)*1000/repeat);
+    if (num==otf->numGlyphs) {
+      break;
+    }
+  }
+
+  otf_close(otf);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "sfnt.h"
+#include "sfnt_int.h"
+#include "config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Checks otf_from_unicode() against the plain cmap search and times both
+// on a UTF-8 document (default: generated mostly-latin text):
+//   test_unicode [font [document]]
+
+#define GEN_CHARS 4000000
+
+static double now() // {{{
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+// }}}
+
+static int *read_utf8(const char *fn,int *ret_len) // {{{
+{
+  FILE *f=fopen(fn,"rb");
+  if (!f) {
+    return NULL;
+  }
+  int alloc=4096,len=0;
+  int *ret=malloc(alloc*sizeof(int));
+  assert(ret);
+  int ch,uc=0,more=0;
+  while ((ch=getc(f))!=EOF) {
+    if ((ch&0xc0)==0x80) { // continuation
+      if (!more) {
+        continue;
+      }
+      uc=(uc<<6)|(ch&0x3f);
+      if (--more) {
+        continue;
+      }
+    } else if (ch<0x80) {
+      uc=ch;
+      more=0;
+    } else {
+      more=(ch>=0xf0)?3:((ch>=0xe0)?2:1);
+      uc=ch&(0x3f>>more);
+      continue;
+    }
+    if (uc>=OTF_UNICODE_MAX) {
+      continue;
+    }
+    if (len==alloc) {
+      alloc*=2;
+      ret=realloc(ret,alloc*sizeof(int));
+      assert(ret);
+    }
+    ret[len++]=uc;
+  }
+  fclose(f);
+  *ret_len=len;
+  return ret;
+}
+// }}}
+
+int main(int argc,char **argv)
+{
+  const char *fn=TESTFONT;
+  if (argc>=2) {
+    fn=argv[1];
+  }
+  OTF_FILE *otf=otf_load(fn);
+  assert(otf);
+
+  int iA,len;
+  int *text;
+  if (argc>=3) {
+    text=read_utf8(argv[2],&len);
+    assert(text);
+  } else {
+    len=GEN_CHARS;
+    text=malloc(len*sizeof(int));
+    assert(text);
+    srand(1);
+    for (iA=0;iA<len;iA++) {
+      text[iA]=(rand()%10)?0x20+rand()%0x5f:0xa0+rand()%0x2000;
+    }
+  }
+
+  // same glyphs as without the lookup table, also outside the BMP
+  for (iA=0;iA<OTF_UNICODE_MAX;iA++) {
+    assert(otf_from_unicode(otf,iA)==otf_find_glyph(otf,iA));
+  }
+  otf_close(otf);
+
+  otf=otf_load(fn);
+  assert(otf);
+  unsigned int sum1=0,sum2=0;
+  double start=now();
+  for (iA=0;iA<len;iA++) {
+    sum1+=otf_find_glyph(otf,text[iA]);
+  }
+  const double search=now()-start;
+
+  start=now(); // including filling the table
+  for (iA=0;iA<len;iA++) {
+    sum2+=otf_from_unicode(otf,text[iA]);
+  }
+  const double table=now()-start;
+  assert(sum1==sum2);
+
+  printf("%d chars: cmap search %.1f Mchars/s, lookup table %.1f Mchars/s\n",
+         len,len/search/1e6,len/table/1e6);
+
+  otf_close(otf);
+  free(text);
+
+  return 0;
+}
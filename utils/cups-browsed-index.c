@@ -0,0 +1,108 @@
+/***
+  This file is part of cups-filters.
+
+  This file is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  This file is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+  Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with avahi; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+  USA.
+***/
+
+#include "cups-browsed-index.h"
+
+struct printer_index_s {
+  GHashTable *table;	/* Lower-case key -> GList of entries */
+  GCompareFunc order;
+};
+
+static void
+free_bucket (gpointer data)
+{
+  g_list_free ((GList *)data);
+}
+
+printer_index_t *
+printer_index_new (GCompareFunc order)
+{
+  printer_index_t *index = g_new0 (printer_index_t, 1);
+
+  index->table = g_hash_table_new_full (g_str_hash, g_str_equal,
+					g_free, free_bucket);
+  index->order = order;
+  return index;
+}
+
+void
+printer_index_free (printer_index_t *index)
+{
+  if (index == NULL)
+    return;
+  g_hash_table_destroy (index->table);
+  g_free (index);
+}
+
+void
+printer_index_add (printer_index_t *index, const char *key, void *entry)
+{
+  gchar *lkey = g_ascii_strdown (key ? key : "", -1);
+  gpointer orig_key;
+  GList *bucket = NULL;
+
+  if (g_hash_table_lookup_extended (index->table, lkey, &orig_key,
+				    (gpointer *)&bucket)) {
+    if (g_list_find (bucket, entry)) {
+      g_free (lkey);
+      return;
+    }
+    /* Steal the list so that replacing it does not free it */
+    g_hash_table_steal (index->table, lkey);
+    g_free (orig_key);
+  }
+  if (index->order)
+    bucket = g_list_insert_sorted (bucket, entry, index->order);
+  else
+    bucket = g_list_append (bucket, entry);
+  g_hash_table_insert (index->table, lkey, bucket);
+}
+
+void
+printer_index_remove (printer_index_t *index, const char *key, void *entry)
+{
+  gchar *lkey = g_ascii_strdown (key ? key : "", -1);
+  gpointer orig_key;
+  GList *bucket;
+
+  if (g_hash_table_lookup_extended (index->table, lkey, &orig_key,
+				    (gpointer *)&bucket)) {
+    g_hash_table_steal (index->table, lkey);
+    bucket = g_list_remove (bucket, entry);
+    if (bucket)
+      g_hash_table_insert (index->table, orig_key, bucket);
+    else
+      g_free (orig_key);
+  }
+  g_free (lkey);
+}
+
+GList *
+printer_index_lookup (printer_index_t *index, const char *key)
+{
+  gchar *lkey;
+  GList *bucket;
+
+  if (index == NULL || key == NULL)
+    return NULL;
+  lkey = g_ascii_strdown (key, -1);
+  bucket = g_hash_table_lookup (index->table, lkey);
+  g_free (lkey);
+  return bucket;
+}
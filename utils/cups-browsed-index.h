@@ -0,0 +1,40 @@
+/***
+  This file is part of cups-filters.
+
+  This file is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  This file is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+  Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with avahi; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+  USA.
+***/
+
+#ifndef _CUPS_BROWSED_INDEX_H_
+#define _CUPS_BROWSED_INDEX_H_
+
+#include <glib.h>
+
+/* Hash index mapping a case-insensitive key (queue name, DNS-SD service,
+   ...) to all printer entries with this key. The entries with the same
+   key are kept in the order given by the compare function, so that
+   walking through them finds the same entry first as walking through
+   the whole printer list. */
+typedef struct printer_index_s printer_index_t;
+
+extern printer_index_t *printer_index_new(GCompareFunc order);
+extern void printer_index_free(printer_index_t *index);
+extern void printer_index_add(printer_index_t *index, const char *key,
+			      void *entry);
+extern void printer_index_remove(printer_index_t *index, const char *key,
+				 void *entry);
+extern GList *printer_index_lookup(printer_index_t *index, const char *key);
+
+#endif /* !_CUPS_BROWSED_INDEX_H_ */
@@ -23,6 +23,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #if defined(__OpenBSD__)
 #include <sys/socket.h>
 #endif /* __OpenBSD__ */
@@ -35,6 +36,7 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <time.h>
 #include <signal.h>
 #include <regex.h>
@@ -125,6 +127,7 @@ static int	ldap_rebind_proc(LDAP *RebindLDAPHandle,
 #include <cupsfilters/ppdgenerator.h>
 
 #include "cups-notifier.h"
+#include "cups-browsed-index.h"
 
 /* Attribute to mark a CUPS queue as created by us */
 #define CUPS_BROWSED_MARK "cups-browsed"
@@ -150,6 +153,7 @@ static int	ldap_rebind_proc(LDAP *RebindLDAPHandle,
 #define LOCAL_DEFAULT_PRINTER_FILE "/cups-browsed-local-default-printer"
 #define REMOTE_DEFAULT_PRINTER_FILE "/cups-browsed-remote-default-printer"
 #define SAVE_OPTIONS_FILE "/cups-browsed-options-%s"
+#define IPP_CACHE_FILE "/cups-browsed-ipp-%s"
 #define DEBUG_LOG_FILE "/cups-browsed_log"
 
 /* Status of remote printer */
@@ -190,6 +194,9 @@ typedef struct remote_printer_s {
   int netprinter;
   int is_legacy;
   int timeouted;
+  unsigned long seq;		/* Position in remote_printers */
+  char *indexed_name;		/* Keys under which the entry is indexed */
+  char *indexed_service;
 } remote_printer_t;
 
 /* Data structure for network interfaces */
@@ -330,6 +337,11 @@ typedef enum autoshutdown_inactivity_type_e {
 } autoshutdown_inactivity_type_t;
 
 cups_array_t *remote_printers;
+/* Indexes into remote_printers by queue name and by DNS-SD service name,
+   type, and domain, kept up to date by remote_printer_index() */
+static printer_index_t *remote_printers_by_name;
+static printer_index_t *remote_printers_by_service;
+static unsigned long remote_printers_seq = 0;
 static char *alt_config_file = NULL;
 static cups_array_t *command_line_config;
 static cups_array_t *netifs;
@@ -387,11 +399,14 @@ static char *DomainSocket = NULL;
 static unsigned int HttpLocalTimeout = 5;
 static unsigned int HttpRemoteTimeout = 10;
 static unsigned int HttpMaxRetries = 5;
+static unsigned int MaxParallelQueueCreations = 8;
+static unsigned int MaxParallelQueueCreationsPerHost = 2;
 static ip_based_uris_t IPBasedDeviceURIs = IP_BASED_URIS_NO;
 static local_queue_naming_t LocalQueueNamingRemoteCUPS=LOCAL_QUEUE_NAMING_DNSSD;
 static local_queue_naming_t LocalQueueNamingIPPPrinter=LOCAL_QUEUE_NAMING_DNSSD;
 static unsigned int OnlyUnsupportedByCUPS = 0;
 static unsigned int UseCUPSGeneratedPPDs = 1;
+static unsigned int IPPPrinterCache = 1;
 static unsigned int CreateRemoteRawPrinterQueues = 0;
 static unsigned int CreateRemoteCUPSPrinterQueues = 1;
 #ifdef DRIVERLESS_IPP_PRINTERS_AUTO_SETUP
@@ -404,6 +419,7 @@ static int NewIPPPrinterQueuesShared = 0;
 static int AutoClustering = 1;
 static cups_array_t *clusters;
 static load_balancing_type_t LoadBalancingType = QUEUE_ON_CLIENT;
+static unsigned int LoadBalancingPollInterval = 5;
 static char *DefaultOptions = NULL;
 static int terminating = 0; /* received SIGTERM, ignore callbacks,
 			       break loops */
@@ -424,6 +440,7 @@ static char logdir[1024];
 static char local_default_printer_file[1024];
 static char remote_default_printer_file[1024];
 static char save_options_file[1024];
+static char ipp_cache_file[1024];
 static char debug_log_file[1024];
 
 /* Static global variable for indicating we have reached the HTTP timeout */
@@ -2180,16 +2197,78 @@ cancel_subscription (int id)
   ippDelete (resp);
 }
 
+static gint
+remote_printer_order (gconstpointer a, gconstpointer b) {
+  unsigned long seq_a = ((const remote_printer_t *)a)->seq,
+    seq_b = ((const remote_printer_t *)b)->seq;
+
+  return (seq_a < seq_b ? -1 : (seq_a > seq_b ? 1 : 0));
+}
+
+static char *
+remote_printer_service_key (const char *service_name, const char *type,
+			    const char *domain) {
+  return g_strdup_printf("%s\t%s\t%s", service_name ? service_name : "",
+			 type ? type : "", domain ? domain : "");
+}
+
+/* Add the printer entry to the indexes or move it to its new keys if
+   its queue name or its DNS-SD service have changed */
+static void
+remote_printer_index (remote_printer_t *p) {
+  char *service;
+
+  if (p->indexed_name == NULL ||
+      g_ascii_strcasecmp(p->indexed_name, p->queue_name)) {
+    if (p->indexed_name) {
+      printer_index_remove(remote_printers_by_name, p->indexed_name, p);
+      g_free(p->indexed_name);
+    }
+    p->indexed_name = g_strdup(p->queue_name);
+    printer_index_add(remote_printers_by_name, p->indexed_name, p);
+  }
+
+  service = remote_printer_service_key(p->service_name, p->type, p->domain);
+  if (p->indexed_service == NULL ||
+      g_ascii_strcasecmp(p->indexed_service, service)) {
+    if (p->indexed_service) {
+      printer_index_remove(remote_printers_by_service, p->indexed_service,
+			   p);
+      g_free(p->indexed_service);
+    }
+    p->indexed_service = service;
+    printer_index_add(remote_printers_by_service, p->indexed_service, p);
+  } else
+    g_free(service);
+}
+
+static void
+remote_printer_unindex (remote_printer_t *p) {
+  if (p->indexed_name) {
+    printer_index_remove(remote_printers_by_name, p->indexed_name, p);
+    g_free(p->indexed_name);
+    p->indexed_name = NULL;
+  }
+  if (p->indexed_service) {
+    printer_index_remove(remote_printers_by_service, p->indexed_service, p);
+    g_free(p->indexed_service);
+    p->indexed_service = NULL;
+  }
+}
+
 int
 is_created_by_cups_browsed (const char *printer) {
   remote_printer_t *p;
+  GList *l;
 
   if (printer == NULL)
     return 0;
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
+  for (l = printer_index_lookup(remote_printers_by_name, printer);
+       l; l = l->next) {
+    p = (remote_printer_t *)l->data;
     if (!p->slave_of && !strcasecmp(printer, p->queue_name))
       return 1;
+  }
 
   return 0;
 }
@@ -2197,13 +2276,16 @@ is_created_by_cups_browsed (const char *printer) {
 remote_printer_t *
 printer_record (const char *printer) {
   remote_printer_t *p;
+  GList *l;
 
   if (printer == NULL)
     return NULL;
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
+  for (l = printer_index_lookup(remote_printers_by_name, printer);
+       l; l = l->next) {
+    p = (remote_printer_t *)l->data;
     if (!p->slave_of && !strcasecmp(printer, p->queue_name))
       return p;
+  }
 
   return NULL;
 }
@@ -3056,17 +3138,19 @@ join_cluster_if_needed(remote_printer_t *p,
   /* is_cups_queue: -1: Unknown, 0: IPP printer, 1: Remote CUPS queue,
      2: Remote CUPS queue in user-defined cluster      */
 
-  remote_printer_t *q;
+  remote_printer_t *q = NULL;
+  GList *l;
 
-  for (q = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       q;
-       q = (remote_printer_t *)cupsArrayNext(remote_printers))
+  for (l = printer_index_lookup(remote_printers_by_name, p->queue_name);
+       l; l = l->next, q = NULL) {
+    q = (remote_printer_t *)l->data;
     if (q != p &&
 	!strcasecmp(q->queue_name, p->queue_name) && /* Queue with same name
 							on server */
 	!q->slave_of) /* Find the master of the queues with this name,
 			 to avoid "daisy chaining" */
       break;
+  }
   if (q && AutoClustering == 0 && is_cups_queue == 1) {
     debug_printf("We have already created a queue with the name %s for another remote CUPS printer but automatic clustering of equally named printers is turned off nor did we find a manually defined cluster this printer belongs to. Skipping this printer.\n", p->queue_name);
     debug_printf("In cups-browsed.conf try setting \"AutoClustering On\" to cluster equally-named remote CUPS printers, \"LocalQueueNamingRemoteCUPS DNS-SD\" to avoid queue name clashes, or define clusters with the \"Cluster\" directive.\n");
@@ -3096,6 +3180,288 @@ join_cluster_if_needed(remote_printer_t *p,
   return (q ? 1 : 0);
 }
 
+/* State of the members of load-balanced clusters. A background thread
+   polls the servers of the clusters which were used recently, over one
+   persistent connection per server, so that finding a destination for a
+   job does not need to wait for the servers. */
+typedef struct cluster_member_s {
+  char *host;			/* Server of this member */
+  int port;
+  char *queue;			/* Name of the queue on the server */
+  ipp_pstate_t pstate;		/* Polled state */
+  int accepting;
+  int num_jobs;			/* Active jobs, -1 if not polled */
+  time_t updated;		/* Time of last successful poll, 0: never */
+  time_t last_used;		/* Time of last lookup */
+} cluster_member_t;
+
+#define CLUSTER_MEMBER_EXPIRE 600 /* Stop polling a member if no job was
+				     sent to its cluster for 10 minutes */
+
+static GHashTable *cluster_members = NULL; /* "host:port/queue" -> member */
+static pthread_mutex_t cluster_poll_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cluster_poll_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t cluster_poll_thread;
+static int cluster_poll_started = 0;
+static int cluster_poll_stop = 0;
+
+/* Get state, accepting flag and, if needed, number of active jobs of the
+   queue on the CUPS server connected by http. Returns 1 if found, 0 if
+   the server does not have this queue, and -1 on error */
+static int
+cluster_member_poll(http_t *http, const char *queue, ipp_pstate_t *pstate,
+		    int *paccept, int *num_jobs) {
+  ipp_t *request, *response;
+  ipp_attribute_t *attr;
+  const char *pname;
+  cups_job_t *jobs = NULL;
+  int found = 0;
+  static const char *pattrs[] =
+                {
+                  "printer-name",
+                  "printer-state",
+                  "printer-is-accepting-jobs"
+                };
+
+  request = ippNewRequest(CUPS_GET_PRINTERS);
+  ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD,
+		"requested-attributes",
+		sizeof(pattrs) / sizeof(pattrs[0]),
+		NULL, pattrs);
+  ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME,
+	       "requesting-user-name",
+	       NULL, cupsUser());
+  if ((response = cupsDoRequest(http, request, "/")) == NULL)
+    return -1;
+  for (attr = ippFirstAttribute(response); attr != NULL && !found;
+       attr = ippNextAttribute(response)) {
+    while (attr != NULL && ippGetGroupTag(attr) != IPP_TAG_PRINTER)
+      attr = ippNextAttribute(response);
+    if (attr == NULL)
+      break;
+    pname = NULL;
+    *pstate = IPP_PRINTER_IDLE;
+    *paccept = 0;
+    while (attr != NULL && ippGetGroupTag(attr) == IPP_TAG_PRINTER) {
+      if (!strcmp(ippGetName(attr), "printer-name") &&
+	  ippGetValueTag(attr) == IPP_TAG_NAME)
+	pname = ippGetString(attr, 0, NULL);
+      else if (!strcmp(ippGetName(attr), "printer-state") &&
+	       ippGetValueTag(attr) == IPP_TAG_ENUM)
+	*pstate = (ipp_pstate_t)ippGetInteger(attr, 0);
+      else if (!strcmp(ippGetName(attr), "printer-is-accepting-jobs") &&
+	       ippGetValueTag(attr) == IPP_TAG_BOOLEAN)
+	*paccept = ippGetBoolean(attr, 0);
+      attr = ippNextAttribute(response);
+    }
+    if (pname != NULL && !strcasecmp(pname, queue))
+      found = 1;
+    if (attr == NULL)
+      break;
+  }
+  ippDelete(response);
+
+  *num_jobs = -1;
+  if (found && *paccept && *pstate == IPP_PRINTER_PROCESSING &&
+      LoadBalancingType == QUEUE_ON_SERVERS) {
+    *num_jobs = cupsGetJobs2(http, &jobs, queue, 0, CUPS_WHICHJOBS_ACTIVE);
+    cupsFreeJobs(*num_jobs, jobs);
+  } else if (found && *pstate == IPP_PRINTER_IDLE)
+    *num_jobs = 0;
+  return found;
+}
+
+static void
+cluster_member_free(gpointer data) {
+  cluster_member_t *m = (cluster_member_t *)data;
+
+  free(m->host);
+  free(m->queue);
+  free(m);
+}
+
+static void
+cluster_connection_close(gpointer data) {
+  httpClose((http_t *)data);
+}
+
+static void *
+cluster_poll_worker(void *data) {
+  GHashTable *connections;
+  GHashTableIter iter;
+  gpointer key, value;
+  cluster_member_t *m, **todo;
+  struct timespec wakeup;
+  http_t *http;
+  char server[1024];
+  ipp_pstate_t pstate;
+  int i, num_todo, paccept, num_jobs, found;
+
+  debug_printf("cluster_poll_worker() in THREAD %ld\n", pthread_self());
+
+  /* Persistent connections to the servers, "host:port" -> http_t */
+  connections = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+				      cluster_connection_close);
+
+  pthread_mutex_lock(&cluster_poll_lock);
+  while (!cluster_poll_stop) {
+    /* Take a copy of the members to poll, so that we do not hold the
+       lock while waiting for the servers */
+    num_todo = 0;
+    todo = (cluster_member_t **)calloc(g_hash_table_size(cluster_members) + 1,
+				       sizeof(cluster_member_t *));
+    g_hash_table_iter_init(&iter, cluster_members);
+    while (todo && g_hash_table_iter_next(&iter, &key, &value)) {
+      m = (cluster_member_t *)value;
+      if (time(NULL) - m->last_used > CLUSTER_MEMBER_EXPIRE) {
+	g_hash_table_iter_remove(&iter);
+	continue;
+      }
+      if ((todo[num_todo] = calloc(1, sizeof(cluster_member_t))) == NULL)
+	break;
+      todo[num_todo]->host = strdup(m->host);
+      todo[num_todo]->port = m->port;
+      todo[num_todo]->queue = strdup(m->queue);
+      num_todo ++;
+    }
+    pthread_mutex_unlock(&cluster_poll_lock);
+
+    for (i = 0; i < num_todo; i ++) {
+      m = todo[i];
+      snprintf(server, sizeof(server), "%s:%d", m->host, m->port);
+      if ((http = g_hash_table_lookup(connections, server)) == NULL) {
+	if ((http = httpConnectEncryptShortTimeout(m->host, m->port,
+						   HTTP_ENCRYPT_IF_REQUESTED))
+	    == NULL) {
+	  debug_printf("Cannot connect to %s to poll the state of remote printer %s.\n",
+		       server, m->queue);
+	  continue;
+	}
+	httpSetTimeout(http, HttpRemoteTimeout, NULL, NULL);
+	g_hash_table_insert(connections, g_strdup(server), http);
+      }
+      found = cluster_member_poll(http, m->queue, &pstate, &paccept,
+				  &num_jobs);
+      if (found < 0)
+	/* Reconnect in the next round */
+	g_hash_table_remove(connections, server);
+      pthread_mutex_lock(&cluster_poll_lock);
+      snprintf(server, sizeof(server), "%s:%d/%s", m->host, m->port,
+	       m->queue);
+      if ((m = g_hash_table_lookup(cluster_members, server)) != NULL) {
+	if (found > 0) {
+	  m->pstate = pstate;
+	  m->accepting = paccept;
+	  m->num_jobs = num_jobs;
+	  m->updated = time(NULL);
+	} else
+	  m->updated = 0;
+      }
+      pthread_mutex_unlock(&cluster_poll_lock);
+    }
+    for (i = 0; i < num_todo; i ++)
+      cluster_member_free(todo[i]);
+    free(todo);
+
+    pthread_mutex_lock(&cluster_poll_lock);
+    clock_gettime(CLOCK_REALTIME, &wakeup);
+    wakeup.tv_sec += LoadBalancingPollInterval;
+    /* New members and the shutdown wake us up early */
+    if (!cluster_poll_stop)
+      pthread_cond_timedwait(&cluster_poll_cond, &cluster_poll_lock,
+			     &wakeup);
+  }
+  pthread_mutex_unlock(&cluster_poll_lock);
+
+  g_hash_table_destroy(connections);
+  return NULL;
+}
+
+/* Look up the polled state of a cluster member, and get the member
+   polled from now on. Returns 1 if a recent state is available */
+static int
+cluster_member_cached_state(const char *host, int port, const char *queue,
+			    ipp_pstate_t *pstate, int *paccept,
+			    int *num_jobs) {
+  cluster_member_t *m;
+  char *key;
+  int found = 0;
+
+  if (LoadBalancingPollInterval == 0)
+    return 0;
+
+  key = g_strdup_printf("%s:%d/%s", host, port, queue);
+  pthread_mutex_lock(&cluster_poll_lock);
+  if (cluster_members == NULL)
+    cluster_members = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    g_free, cluster_member_free);
+  if ((m = g_hash_table_lookup(cluster_members, key)) == NULL) {
+    if ((m = calloc(1, sizeof(cluster_member_t))) != NULL) {
+      m->host = strdup(host);
+      m->port = port;
+      m->queue = strdup(queue);
+      m->num_jobs = -1;
+      g_hash_table_insert(cluster_members, key, m);
+      key = NULL;
+      /* Poll the new member right away */
+      pthread_cond_signal(&cluster_poll_cond);
+    }
+  } else if (m->updated &&
+	     time(NULL) - m->updated <= 3 * LoadBalancingPollInterval) {
+    *pstate = m->pstate;
+    *paccept = m->accepting;
+    *num_jobs = m->num_jobs;
+    found = 1;
+  }
+  if (m)
+    m->last_used = time(NULL);
+  if (!cluster_poll_started && !cluster_poll_stop) {
+    if (pthread_create(&cluster_poll_thread, NULL, cluster_poll_worker,
+		       NULL) == 0)
+      cluster_poll_started = 1;
+    else
+      debug_printf("ERROR: Unable to start polling the members of load-balanced clusters.\n");
+  }
+  pthread_mutex_unlock(&cluster_poll_lock);
+  g_free(key);
+  return found;
+}
+
+/* A job was sent to this member, count it until the next poll */
+static void
+cluster_member_job_sent(const char *host, int port, const char *queue,
+			int num_jobs) {
+  cluster_member_t *m;
+  char *key;
+
+  if (LoadBalancingPollInterval == 0 || cluster_members == NULL)
+    return;
+
+  key = g_strdup_printf("%s:%d/%s", host, port, queue);
+  pthread_mutex_lock(&cluster_poll_lock);
+  if ((m = g_hash_table_lookup(cluster_members, key)) != NULL &&
+      m->updated) {
+    m->pstate = IPP_PRINTER_PROCESSING;
+    m->num_jobs = (num_jobs >= 0 ? num_jobs : 0) + 1;
+  }
+  pthread_mutex_unlock(&cluster_poll_lock);
+  g_free(key);
+}
+
+static void
+cluster_poll_shutdown(void) {
+  pthread_mutex_lock(&cluster_poll_lock);
+  cluster_poll_stop = 1;
+  pthread_cond_signal(&cluster_poll_cond);
+  pthread_mutex_unlock(&cluster_poll_lock);
+  if (cluster_poll_started)
+    pthread_join(cluster_poll_thread, NULL);
+  cluster_poll_started = 0;
+  if (cluster_members)
+    g_hash_table_destroy(cluster_members);
+  cluster_members = NULL;
+}
+
 static void
 on_printer_state_changed (CupsNotifier *object,
                           const gchar *text,
@@ -3112,12 +3478,11 @@ on_printer_state_changed (CupsNotifier *object,
   http_t *http = NULL;
   ipp_t *request, *response;
   ipp_attribute_t *attr;
-  const char *pname = NULL;
   char *remote_cups_queue;
   ipp_pstate_t pstate = IPP_PRINTER_IDLE;
   int paccept = 0;
   int num_jobs, min_jobs = 99999999;
-  cups_job_t *jobs = NULL;
+  int found, dest_jobs = 0;
   const char *dest_host = NULL;
   int dest_port = 0;
   char dest_name[1024];
@@ -3127,12 +3492,6 @@ on_printer_state_changed (CupsNotifier *object,
   int job_id = 0;
   int num_options;
   cups_option_t *options;
-  static const char *pattrs[] =
-                {
-                  "printer-name",
-                  "printer-state",
-                  "printer-is-accepting-jobs"
-                };
   static const char *jattrs[] =
 		{
 		  "job-id",
@@ -3291,117 +3650,76 @@ on_printer_state_changed (CupsNotifier *object,
 	if (!strcasecmp(p->queue_name, printer) &&
 	    p->status == STATUS_CONFIRMED) {
 	  remote_cups_queue = strrchr(p->uri, '/') + 1;
-	  debug_printf("Checking state of remote printer %s on host %s, IP %s, port %d.\n", remote_cups_queue, p->host, p->ip, p->port);
-	  http = httpConnectEncryptShortTimeout (p->ip ? p->ip : p->host,
-						 p->port,
-						 HTTP_ENCRYPT_IF_REQUESTED);
-	  debug_printf("HTTP connection to %s:%d established.\n", p->host,
-		       p->port);
-	  if (http) {
-	    /* Check whether the printer is idle, processing, or disabled */
-	    httpSetTimeout(http, HttpRemoteTimeout, http_timeout_cb, NULL);
-	    request = ippNewRequest(CUPS_GET_PRINTERS);
-	    ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD,
-			  "requested-attributes",
-			  sizeof(pattrs) / sizeof(pattrs[0]),
-			  NULL, pattrs);
-	    ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME,
-			 "requesting-user-name",
-			 NULL, cupsUser());
-	    if ((response = cupsDoRequest(http, request, "/")) !=
-		NULL) {
-	      debug_printf("IPP request to %s:%d successful.\n", p->host,
+	  found = cluster_member_cached_state(p->ip ? p->ip : p->host,
+					      p->port, remote_cups_queue,
+					      &pstate, &paccept, &num_jobs);
+	  if (found)
+	    debug_printf("Using polled state of remote printer %s on host %s, port %d.\n",
+			 remote_cups_queue, p->host, p->port);
+	  else {
+	    debug_printf("Checking state of remote printer %s on host %s, IP %s, port %d.\n", remote_cups_queue, p->host, p->ip, p->port);
+	    http = httpConnectEncryptShortTimeout (p->ip ? p->ip : p->host,
+						   p->port,
+						   HTTP_ENCRYPT_IF_REQUESTED);
+	    if (http) {
+	      debug_printf("HTTP connection to %s:%d established.\n", p->host,
 			   p->port);
-	      pname = NULL;
-	      pstate = IPP_PRINTER_IDLE;
-	      paccept = 0;
-	      for (attr = ippFirstAttribute(response); attr != NULL;
-		   attr = ippNextAttribute(response)) {
-		while (attr != NULL && ippGetGroupTag(attr) != IPP_TAG_PRINTER)
-		  attr = ippNextAttribute(response);
-		if (attr == NULL)
-		  break;
-		pname = NULL;
-		pstate = IPP_PRINTER_IDLE;
-		paccept = 0;
-		while (attr != NULL && ippGetGroupTag(attr) ==
-		       IPP_TAG_PRINTER) {
-		  if (!strcmp(ippGetName(attr), "printer-name") &&
-		      ippGetValueTag(attr) == IPP_TAG_NAME)
-		    pname = ippGetString(attr, 0, NULL);
-		  else if (!strcmp(ippGetName(attr), "printer-state") &&
-			   ippGetValueTag(attr) == IPP_TAG_ENUM)
-		    pstate = (ipp_pstate_t)ippGetInteger(attr, 0);
-		  else if (!strcmp(ippGetName(attr),
-				   "printer-is-accepting-jobs") &&
-			   ippGetValueTag(attr) == IPP_TAG_BOOLEAN)
-		    paccept = ippGetBoolean(attr, 0);
-		  attr = ippNextAttribute(response);
-		}
-		if (pname == NULL) {
-		  if (attr == NULL)
-		    break;
-		  else
-		    continue;
-		}
-		if (!strcasecmp(pname, remote_cups_queue)) {
-		  if (paccept) {
-		    debug_printf("Printer %s on host %s, port %d is accepting jobs.\n", remote_cups_queue, p->host, p->port);
-		    switch (pstate) {
-		    case IPP_PRINTER_IDLE:
-		      valid_dest_found = 1;
-		      dest_host = p->ip ? p->ip : p->host;
-		      dest_port = p->port;
-		      strncpy(dest_name, remote_cups_queue, sizeof(dest_name));
-		      if (strlen(remote_cups_queue) > 1023)
-		        dest_name[1023] = '\0';
-		      dest_index = i;
-		      debug_printf("Printer %s on host %s, port %d is idle, take this as destination and stop searching.\n",
-				   remote_cups_queue, p->host, p->port);
-		      break;
-		    case IPP_PRINTER_PROCESSING:
-		      valid_dest_found = 1;
-		      if (LoadBalancingType == QUEUE_ON_SERVERS) {
-			num_jobs = 0;
-			jobs = NULL;
-			num_jobs =
-			  cupsGetJobs2(http, &jobs, remote_cups_queue, 0,
-				       CUPS_WHICHJOBS_ACTIVE);
-			if (num_jobs >= 0 && num_jobs < min_jobs) {
-			  min_jobs = num_jobs;
-			  dest_host = p->ip ? p->ip : p->host;
-			  dest_port = p->port;
-			  strncpy(dest_name, remote_cups_queue, sizeof(dest_name));
-			  if (strlen(remote_cups_queue) > 1023)
-			    dest_name[1023] = '\0';
-			  dest_index = i;
-			}
-			debug_printf("Printer %s on host %s, port %d is printing and it has %d jobs.\n",
-				     remote_cups_queue, p->host, p->port,
-				     num_jobs);
-		      } else
-			debug_printf("Printer %s on host %s, port %d is printing.\n", remote_cups_queue, p->host, p->port);
-		      break;
-		    case IPP_PRINTER_STOPPED:
-		      debug_printf("Printer %s on host %s, port %d is disabled, skip it.\n", remote_cups_queue, p->host, p->port);
-		      break;
-		    }
-		  } else {
-		    debug_printf("Printer %s on host %s, port %d is not accepting jobs, skip it.\n", remote_cups_queue, p->host, p->port);
+	      httpSetTimeout(http, HttpRemoteTimeout, http_timeout_cb, NULL);
+	      found = (cluster_member_poll(http, remote_cups_queue, &pstate,
+					   &paccept, &num_jobs) > 0);
+	      httpClose(http);
+	      http = NULL;
+	    }
+	  }
+	  if (found) {
+	    if (paccept) {
+	      debug_printf("Printer %s on host %s, port %d is accepting jobs.\n", remote_cups_queue, p->host, p->port);
+	      switch (pstate) {
+	      case IPP_PRINTER_IDLE:
+		valid_dest_found = 1;
+		dest_host = p->ip ? p->ip : p->host;
+		dest_port = p->port;
+		strncpy(dest_name, remote_cups_queue, sizeof(dest_name));
+		if (strlen(remote_cups_queue) > 1023)
+		  dest_name[1023] = '\0';
+		dest_index = i;
+		dest_jobs = num_jobs;
+		debug_printf("Printer %s on host %s, port %d is idle, take this as destination and stop searching.\n",
+			     remote_cups_queue, p->host, p->port);
+		break;
+	      case IPP_PRINTER_PROCESSING:
+		valid_dest_found = 1;
+		if (LoadBalancingType == QUEUE_ON_SERVERS) {
+		  if (num_jobs >= 0 && num_jobs < min_jobs) {
+		    min_jobs = num_jobs;
+		    dest_host = p->ip ? p->ip : p->host;
+		    dest_port = p->port;
+		    strncpy(dest_name, remote_cups_queue, sizeof(dest_name));
+		    if (strlen(remote_cups_queue) > 1023)
+		      dest_name[1023] = '\0';
+		    dest_index = i;
+		    dest_jobs = num_jobs;
 		  }
-		  break;
-		}
-	      }
-	      if (pstate == IPP_PRINTER_IDLE && paccept) {
-		q->last_printer = i;
+		  debug_printf("Printer %s on host %s, port %d is printing and it has %d jobs.\n",
+			       remote_cups_queue, p->host, p->port,
+			       num_jobs);
+		} else
+		  debug_printf("Printer %s on host %s, port %d is printing.\n", remote_cups_queue, p->host, p->port);
+		break;
+	      case IPP_PRINTER_STOPPED:
+		debug_printf("Printer %s on host %s, port %d is disabled, skip it.\n", remote_cups_queue, p->host, p->port);
 		break;
 	      }
-	    } else
-	      debug_printf("IPP request to %s:%d failed.\n", p->host,
-			   p->port);
-	    httpClose(http);
-	    http = NULL;
-	  }
+	    } else {
+	      debug_printf("Printer %s on host %s, port %d is not accepting jobs, skip it.\n", remote_cups_queue, p->host, p->port);
+	    }
+	    if (pstate == IPP_PRINTER_IDLE && paccept) {
+	      q->last_printer = i;
+	      break;
+	    }
+	  } else
+	    debug_printf("IPP request to %s:%d failed.\n", p->host,
+			 p->port);
 	}
 	if (i == q->last_printer)
 	  break;
@@ -3452,6 +3770,9 @@ on_printer_state_changed (CupsNotifier *object,
 		   "requesting-user-name", NULL, cupsUser());
       if (dest_host) {
 	q->last_printer = dest_index;
+	/* Until the next poll assume that the destination is busy with our
+	   job, so that the next job goes to another member */
+	cluster_member_job_sent(dest_host, dest_port, dest_name, dest_jobs);
 	snprintf(buf, sizeof(buf), "\"%d %s:%d/%s\"", job_id, dest_host,
 		 dest_port, dest_name);
 	debug_printf("Destination for job %d to %s: %s:%d, queue %s\n",
@@ -3786,6 +4107,7 @@ on_printer_modified (CupsNotifier *object,
 	} else {
 	  free(p->queue_name);
 	  p->queue_name = new_queue_name;
+	  remote_printer_index(p);
 	  /* Check whether the queue under its new name will be stand-alone or part of
 	     a cluster */
 	  if (join_cluster_if_needed(p, is_cups_queue) < 0) {
@@ -3836,6 +4158,362 @@ on_printer_modified (CupsNotifier *object,
 }
 
 #ifdef HAVE_CUPS_1_6
+/*
+ * Cache of the IPP attributes of network printers and of the PPD files
+ * generated from them, in files named after the printer's UUID:
+ *
+ *   <key>.info        config-change-time and hash of the cached PPD
+ *   <key>.attributes  response to get-printer-attributes
+ *   <key>.ppd         PPD generated from these attributes
+ *
+ * As long as the printer reports the same printer-config-change-time,
+ * its attributes are taken from the cache, and as long as the attributes
+ * (without the ones describing the printer's current state) and the PPD
+ * generator's input are the same, the PPD file is taken from the cache.
+ */
+
+typedef struct ipp_cache_info_s {
+  int config_change_time;
+  char ppd_hash[65];
+} ipp_cache_info_t;
+
+/* Held while writing cache files, as the prefetch threads save the
+   attributes of several printers at once. The files are written under a
+   temporary name and renamed when complete, so that readers never see a
+   partially written file. */
+static pthread_mutex_t ipp_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+ipp_cache_filename(const char *uuid, const char *ext, char *buf,
+		   size_t bufsize) {
+  char key[256], *k;
+
+  if (uuid == NULL)
+    return -1;
+  if (!strncasecmp(uuid, "urn:uuid:", 9))
+    uuid += 9;
+  for (k = key; *uuid && k < key + sizeof(key) - 1; uuid ++)
+    if (isalnum(*uuid & 255) || *uuid == '-')
+      *k++ = *uuid;
+  *k = '\0';
+  if (key[0] == '\0')
+    return -1;
+  snprintf(buf, bufsize, ipp_cache_file, key);
+  strncat(buf, ext, bufsize - strlen(buf) - 1);
+  return 0;
+}
+
+static int
+ipp_cache_read_info(const char *uuid, ipp_cache_info_t *info) {
+  char filename[1024], line[1024];
+  FILE *fp;
+
+  memset(info, 0, sizeof(ipp_cache_info_t));
+  info->config_change_time = -1;
+  if (ipp_cache_filename(uuid, ".info", filename, sizeof(filename)) < 0 ||
+      (fp = fopen(filename, "r")) == NULL)
+    return -1;
+  while (fgets(line, sizeof(line), fp)) {
+    if (!strncmp(line, "config-change-time ", 19))
+      info->config_change_time = atoi(line + 19);
+    else if (!strncmp(line, "ppd-hash ", 9))
+      sscanf(line + 9, "%64s", info->ppd_hash);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/* Call with ipp_cache_lock held */
+static int
+ipp_cache_write_info(const char *uuid, const ipp_cache_info_t *info) {
+  char filename[1024], tempname[1024 + 4];
+  FILE *fp;
+  int ok;
+
+  if (ipp_cache_filename(uuid, ".info", filename, sizeof(filename)) < 0)
+    return -1;
+  snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+  if ((fp = fopen(tempname, "w")) == NULL) {
+    debug_printf("ERROR: Failed creating file %s\n", tempname);
+    return -1;
+  }
+  fprintf(fp, "config-change-time %d\n", info->config_change_time);
+  if (info->ppd_hash[0])
+    fprintf(fp, "ppd-hash %s\n", info->ppd_hash);
+  ok = !ferror(fp);
+  if (fclose(fp) != 0)
+    ok = 0;
+  if (!ok || rename(tempname, filename) < 0) {
+    debug_printf("ERROR: Failed writing file %s\n", filename);
+    unlink(tempname);
+    return -1;
+  }
+  return 0;
+}
+
+static const char *
+ipp_cache_uuid(ipp_t *attrs) {
+  ipp_attribute_t *attr;
+
+  if (attrs &&
+      (attr = ippFindAttribute(attrs, "printer-uuid", IPP_TAG_URI)) != NULL)
+    return ippGetString(attr, 0, NULL);
+  return NULL;
+}
+
+static int
+ipp_cache_config_change_time(ipp_t *attrs) {
+  ipp_attribute_t *attr;
+
+  if (attrs &&
+      (attr = ippFindAttribute(attrs, "printer-config-change-time",
+			       IPP_TAG_INTEGER)) != NULL)
+    return ippGetInteger(attr, 0);
+  return -1;
+}
+
+/* Feeds an attribute into the hash value by value, so that there is no
+   limit on its length (media-col-database easily gets very long) */
+static void
+ipp_cache_hash_attr(GChecksum *sum, ipp_attribute_t *attr) {
+  ipp_tag_t tag = ippGetValueTag(attr);
+  int i, count = ippGetCount(attr), lower, upper, xres, yres, len;
+  ipp_res_t units;
+  ipp_t *col;
+  ipp_attribute_t *member;
+  const char *name = ippGetName(attr), *str;
+  const void *data;
+  char buf[256];
+
+  snprintf(buf, sizeof(buf), "%s %d %d", name ? name : "", tag, count);
+  g_checksum_update(sum, (const guchar *)buf, strlen(buf) + 1);
+  for (i = 0; i < count; i ++) {
+    buf[0] = '\0';
+    switch (tag) {
+    case IPP_TAG_INTEGER:
+    case IPP_TAG_ENUM:
+      snprintf(buf, sizeof(buf), "%d", ippGetInteger(attr, i));
+      break;
+    case IPP_TAG_BOOLEAN:
+      snprintf(buf, sizeof(buf), "%d", ippGetBoolean(attr, i));
+      break;
+    case IPP_TAG_RANGE:
+      lower = ippGetRange(attr, i, &upper);
+      snprintf(buf, sizeof(buf), "%d-%d", lower, upper);
+      break;
+    case IPP_TAG_RESOLUTION:
+      xres = ippGetResolution(attr, i, &yres, &units);
+      snprintf(buf, sizeof(buf), "%dx%d %d", xres, yres, units);
+      break;
+    case IPP_TAG_DATE:
+      g_checksum_update(sum, (const guchar *)ippGetDate(attr, i), 11);
+      break;
+    case IPP_TAG_STRING:
+      len = 0;
+      if ((data = ippGetOctetString(attr, i, &len)) != NULL && len > 0)
+	g_checksum_update(sum, (const guchar *)data, len);
+      snprintf(buf, sizeof(buf), "%d", len);
+      break;
+    case IPP_TAG_TEXT:
+    case IPP_TAG_NAME:
+    case IPP_TAG_KEYWORD:
+    case IPP_TAG_URI:
+    case IPP_TAG_URISCHEME:
+    case IPP_TAG_CHARSET:
+    case IPP_TAG_LANGUAGE:
+    case IPP_TAG_MIMETYPE:
+    case IPP_TAG_TEXTLANG:
+    case IPP_TAG_NAMELANG:
+      if ((str = ippGetString(attr, i, NULL)) != NULL)
+	g_checksum_update(sum, (const guchar *)str, strlen(str));
+      break;
+    case IPP_TAG_BEGIN_COLLECTION:
+      col = ippGetCollection(attr, i);
+      for (member = ippFirstAttribute(col); member;
+	   member = ippNextAttribute(col))
+	ipp_cache_hash_attr(sum, member);
+      snprintf(buf, sizeof(buf), "end-collection");
+      break;
+    default:
+      /* Out-of-band values, the tag says it all */
+      break;
+    }
+    g_checksum_update(sum, (const guchar *)buf, strlen(buf) + 1);
+  }
+}
+
+/* Hash of what the PPD generator gets, without the attributes which only
+   describe the current state of the printer */
+static void
+ipp_cache_ppd_hash(ipp_t *attrs, const char *make_model, const char *pdl,
+		   int color, int duplex, char *hash) {
+  static const char * const volatile_attrs[] =
+  {
+    "marker-",
+    "printer-alert",
+    "printer-config-change-",
+    "printer-current-time",
+    "printer-state",
+    "printer-supply",
+    "printer-up-time",
+    "queued-job-count"
+  };
+  GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+  ipp_attribute_t *attr;
+  const char *name;
+  char buf[64];
+  size_t i;
+
+  for (attr = ippFirstAttribute(attrs); attr; attr = ippNextAttribute(attrs)) {
+    if ((name = ippGetName(attr)) == NULL)
+      continue;
+    for (i = 0; i < sizeof(volatile_attrs) / sizeof(volatile_attrs[0]); i ++)
+      if (!strncmp(name, volatile_attrs[i], strlen(volatile_attrs[i])))
+	break;
+    if (i < sizeof(volatile_attrs) / sizeof(volatile_attrs[0]))
+      continue;
+    ipp_cache_hash_attr(sum, attr);
+  }
+  if (make_model)
+    g_checksum_update(sum, (const guchar *)make_model, strlen(make_model));
+  g_checksum_update(sum, (const guchar *)"\n", 1);
+  if (pdl)
+    g_checksum_update(sum, (const guchar *)pdl, strlen(pdl));
+  snprintf(buf, sizeof(buf), "\n%d %d\n" VERSION, color, duplex);
+  g_checksum_update(sum, (const guchar *)buf, strlen(buf));
+  snprintf(hash, 65, "%s", g_checksum_get_string(sum));
+  g_checksum_free(sum);
+}
+
+static ipp_t *
+ipp_cache_load_attributes(const char *uuid, int config_change_time) {
+  char filename[1024];
+  ipp_cache_info_t info;
+  ipp_t *attrs;
+  int fd;
+
+  if (config_change_time < 0 ||
+      ipp_cache_read_info(uuid, &info) < 0 ||
+      info.config_change_time != config_change_time ||
+      ipp_cache_filename(uuid, ".attributes", filename, sizeof(filename)) < 0 ||
+      (fd = open(filename, O_RDONLY)) < 0)
+    return NULL;
+  attrs = ippNew();
+  if (ippReadFile(fd, attrs) != IPP_STATE_DATA) {
+    ippDelete(attrs);
+    attrs = NULL;
+  }
+  close(fd);
+  return attrs;
+}
+
+static void
+ipp_cache_save_attributes(ipp_t *attrs) {
+  char filename[1024], tempname[1024 + 4];
+  const char *uuid = ipp_cache_uuid(attrs);
+  ipp_cache_info_t info;
+  int fd, ok;
+
+  if (ipp_cache_filename(uuid, ".attributes", filename, sizeof(filename)) < 0)
+    return;
+  snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+  pthread_mutex_lock(&ipp_cache_lock);
+  if ((fd = open(tempname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    debug_printf("ERROR: Failed creating file %s\n", tempname);
+    pthread_mutex_unlock(&ipp_cache_lock);
+    return;
+  }
+  ippSetState(attrs, IPP_STATE_IDLE);
+  ok = (ippWriteFile(fd, attrs) == IPP_STATE_DATA);
+  if (close(fd) < 0)
+    ok = 0;
+  if (!ok || rename(tempname, filename) < 0) {
+    unlink(tempname);
+    pthread_mutex_unlock(&ipp_cache_lock);
+    return;
+  }
+  /* The PPD stays valid if the attributes did not change, its hash tells */
+  ipp_cache_read_info(uuid, &info);
+  info.config_change_time = ipp_cache_config_change_time(attrs);
+  ipp_cache_write_info(uuid, &info);
+  pthread_mutex_unlock(&ipp_cache_lock);
+}
+
+/* Like ppdCreateFromIPP(), but takes the PPD from the cache if it was
+   generated from the same input */
+static char *
+ppd_create_from_ipp_cached(char *buffer, size_t bufsize, ipp_t *attrs,
+			   const char *make_model, const char *pdl,
+			   int color, int duplex) {
+  char filename[1024], hash[65], buf[8192];
+  const char *uuid = ipp_cache_uuid(attrs);
+  ipp_cache_info_t info;
+  int in, out, ok;
+  ssize_t n;
+
+  if (!IPPPrinterCache ||
+      ipp_cache_filename(uuid, ".ppd", filename, sizeof(filename)) < 0)
+    return ppdCreateFromIPP(buffer, bufsize, attrs, make_model, pdl, color,
+			    duplex);
+
+  ipp_cache_ppd_hash(attrs, make_model, pdl, color, duplex, hash);
+  if (ipp_cache_read_info(uuid, &info) == 0 && !strcmp(info.ppd_hash, hash) &&
+      (in = open(filename, O_RDONLY)) >= 0) {
+    /* The caller removes the PPD file when done, so hand out a copy */
+    ok = 0;
+    if ((out = cupsTempFd(buffer, bufsize)) >= 0) {
+      ok = 1;
+      while ((n = read(in, buf, sizeof(buf))) > 0)
+	if (write(out, buf, n) != n) {
+	  ok = 0;
+	  break;
+	}
+      if (n < 0)
+	ok = 0;
+      close(out);
+      if (!ok)
+	unlink(buffer);
+    }
+    close(in);
+    if (ok) {
+      snprintf(ppdgenerator_msg, sizeof(ppdgenerator_msg),
+	       "PPD file taken from cache %s", filename);
+      return buffer;
+    }
+  }
+
+  if (ppdCreateFromIPP(buffer, bufsize, attrs, make_model, pdl, color,
+		       duplex) == NULL)
+    return NULL;
+
+  /* Keep a copy for the next time */
+  if ((in = open(buffer, O_RDONLY)) >= 0) {
+    ok = 0;
+    if ((out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0) {
+      ok = 1;
+      while ((n = read(in, buf, sizeof(buf))) > 0)
+	if (write(out, buf, n) != n) {
+	  ok = 0;
+	  break;
+	}
+      if (n < 0)
+	ok = 0;
+      close(out);
+    }
+    close(in);
+    if (ok) {
+      pthread_mutex_lock(&ipp_cache_lock);
+      ipp_cache_read_info(uuid, &info);
+      snprintf(info.ppd_hash, sizeof(info.ppd_hash), "%s", hash);
+      info.config_change_time = ipp_cache_config_change_time(attrs);
+      ipp_cache_write_info(uuid, &info);
+      pthread_mutex_unlock(&ipp_cache_lock);
+    } else
+      unlink(filename);
+  }
+  return buffer;
+}
+
 static ipp_t *
 get_printer_attributes(const char* uri) {
   int uri_status, host_port, i;
@@ -3851,6 +4529,11 @@ get_printer_attributes(const char* uri) {
     "printer-description",
     "media-col-database"
   };
+  static const char * const cache_pattrs[] =
+  {
+    "printer-config-change-time",
+    "printer-uuid"
+  };
   /* Request printer properties via IPP to generate a PPD file for the
      printer (mainly driverless-capable printers)
      If we work with Systen V interface scripts use this info to set
@@ -3869,12 +4552,43 @@ get_printer_attributes(const char* uri) {
 		 uri);
     return NULL;
   }
+
+  if (IPPPrinterCache) {
+    /* Only ask whether the printer's configuration changed */
+    request = ippNewRequest(IPP_OP_GET_PRINTER_ATTRIBUTES);
+    ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_URI, "printer-uri", NULL,
+		 uri);
+    ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD,
+		  "requested-attributes",
+		  sizeof(cache_pattrs) / sizeof(cache_pattrs[0]),
+		  NULL, cache_pattrs);
+    response = cupsDoRequest(http_printer, request, resource);
+    if (response) {
+      ipp_t *cached =
+	ipp_cache_load_attributes(ipp_cache_uuid(response),
+				  ipp_cache_config_change_time(response));
+      ippDelete(response);
+      response = NULL;
+      if (cached) {
+	debug_printf("Printer with URI %s did not change its configuration, using its cached IPP attributes.\n",
+		     uri);
+	httpClose(http_printer);
+	return cached;
+      }
+    }
+  }
+
   request = ippNewRequest(IPP_OP_GET_PRINTER_ATTRIBUTES);
   ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_URI, "printer-uri", NULL, uri);
   ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD,
 		"requested-attributes", sizeof(pattrs) / sizeof(pattrs[0]),
 		NULL, pattrs);
   response = cupsDoRequest(http_printer, request, resource);
+  httpClose(http_printer);
+
+  if (response && IPPPrinterCache &&
+      ipp_cache_config_change_time(response) >= 0)
+    ipp_cache_save_attributes(response);
 
   if (response) {
     /* Log all printer attributes for debugging */
@@ -3902,6 +4616,226 @@ get_printer_attributes(const char* uri) {
 }
 #endif /* HAVE_CUPS_1_6 */
 
+#ifdef HAVE_CUPS_1_6
+/*
+ * Check whether an IPP network printer supports the driverless printing
+ * protocol selected with CreateIPPPrinterQueues, based on the IPP
+ * attributes polled from the printer. Returns 1 if the printer is
+ * accepted, 0 if not.
+ */
+
+static int
+check_driverless_support(remote_printer_t *p)
+{
+  int i;
+  ipp_attribute_t *attr;
+  char valuebuffer[65536];
+  int is_pwgraster = 0;
+  int is_appleraster = 0;
+  int is_pclm = 0;
+  int is_pdf = 0;
+
+  /* If we have opted for only printers designed for driverless use (PWG
+     Raster + Apple Raster + PCLm + PDF) being set up automatically, we check
+     first, whether our printer supports IPP 2.0 or newer. If not, we
+     skip this printer */
+  if (CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
+    valuebuffer[0] = '\0';
+    debug_printf("Checking whether printer %s supports IPP 2.x or newer:\n",
+		 p->queue_name);
+    if ((attr = ippFindAttribute(p->prattrs,
+				 "ipp-versions-supported",
+				 IPP_TAG_KEYWORD)) != NULL) {
+      debug_printf("  Attr: %s\n", ippGetName(attr));
+      for (i = 0; i < ippGetCount(attr); i ++) {
+	strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
+	if (strlen(ippGetString(attr, i, NULL)) > 65535)
+	  valuebuffer[65535] = '\0';
+	debug_printf("  Keyword: %s\n", valuebuffer);
+	if (valuebuffer[0] > '1')
+	  break;
+      }
+    }
+    if (!attr || valuebuffer[0] == '\0' || valuebuffer[0] <= '1') {
+      debug_printf("  --> cups-browsed is configured to auto-setup only printers which are designed for driverless printing. These printers require IPP 2.x or newer, but this printer only supports IPP 1.x or older. Skipping.\n");
+      return 0;
+    } else
+      debug_printf("  --> Printer supports IPP 2.x or newer.\n");
+  }
+
+  /* If we have opted for only PWG Raster printers or for only printers 
+     designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
+     being set up automatically, we check whether the printer has a non-empty
+     string in its "pwg-raster-document-resolution-supported" IPP attribute
+     to see whether we have a PWG Raster printer. */
+  if (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
+      CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
+    valuebuffer[0] = '\0';
+    debug_printf("Checking whether printer %s is PWG Raster:\n",
+		 p->queue_name);
+    if ((attr = ippFindAttribute(p->prattrs,
+				 "pwg-raster-document-resolution-supported",
+				 IPP_TAG_KEYWORD)) != NULL) {
+      debug_printf("  Attr: %s\n", ippGetName(attr));
+      ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
+      debug_printf("  Value: %s\n", valuebuffer);
+      if (valuebuffer[0] == '\0') {
+	for (i = 0; i < ippGetCount(attr); i ++) {
+	  strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
+	  if (strlen(ippGetString(attr, i, NULL)) > 65535)
+	    valuebuffer[65535] = '\0';
+	  debug_printf("  Keyword: %s\n", valuebuffer);
+	  if (valuebuffer[0] != '\0')
+	    break;
+	}
+      }
+    }
+    if (attr && valuebuffer[0] != '\0')
+      is_pwgraster = 1;
+    debug_printf("  --> Printer %s PWG Raster.\n",
+		 is_pwgraster ? "supports" : "does not support");
+  }
+
+#ifdef CUPS_RASTER_HAVE_APPLERASTER
+  /* If we have opted for only Apple Raster printers or for only printers 
+     designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
+     being set up automatically, we check whether the printer has a non-empty
+     string in its "urf-supported" IPP attribute to see whether we have an
+     Apple Raster printer. */
+  if (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
+      CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
+    valuebuffer[0] = '\0';
+    debug_printf("Checking whether printer %s understands Apple Raster:\n",
+		 p->queue_name);
+    if ((attr = ippFindAttribute(p->prattrs, "urf-supported", IPP_TAG_KEYWORD)) != NULL) {
+      debug_printf("  Attr: %s\n", ippGetName(attr));
+      ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
+      debug_printf("  Value: %s\n", valuebuffer);
+      if (valuebuffer[0] == '\0') {
+	for (i = 0; i < ippGetCount(attr); i ++) {
+	  strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
+	  if (strlen(ippGetString(attr, i, NULL)) > 65535)
+	    valuebuffer[65535] = '\0';
+	  debug_printf("  Keyword: %s\n", valuebuffer);
+	  if (valuebuffer[0] != '\0')
+	    break;
+	}
+      }
+    }
+    if (attr && valuebuffer[0] != '\0')
+      is_appleraster = 1;
+    debug_printf("  --> Printer %s Apple Raster.\n",
+		 is_appleraster ? "supports" : "does not support");
+  }
+#endif
+
+#ifdef QPDF_HAVE_PCLM
+  /* If we have opted for only PCLm printers or for only printers 
+     designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
+     being set up automatically, we check whether the printer has a non-empty
+     string in its "pclm-compression-method-preferred" IPP attribute to see
+     whether we have a PCLm printer. */
+  if (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
+      CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
+    valuebuffer[0] = '\0';
+    debug_printf("Checking whether printer %s understands PCLm:\n",
+		 p->queue_name);
+    if ((attr = ippFindAttribute(p->prattrs,
+				 "pclm-compression-method-preferred",
+				 IPP_TAG_KEYWORD)) != NULL) {
+      debug_printf("  Attr: %s\n", ippGetName(attr));
+      ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
+      debug_printf("  Value: %s\n", p->queue_name, valuebuffer);
+      if (valuebuffer[0] == '\0') {
+	for (i = 0; i < ippGetCount(attr); i ++) {
+	  strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
+	  if (strlen(ippGetString(attr, i, NULL)) > 65535)
+	    valuebuffer[65535] = '\0';
+	  debug_printf("  Keyword: %s\n", valuebuffer);
+	  if (valuebuffer[0] != '\0')
+	    break;
+	}
+      }
+    }
+    if (attr && valuebuffer[0] != '\0')
+      is_pclm = 1;
+    debug_printf("  --> Printer %s PCLm.\n",
+		 is_pclm ? "supports" : "does not support");
+  }
+#endif
+
+  /* If we have opted for only PDF printers or for only printers 
+     designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
+     being set up automatically, we check whether the printer has 
+     "application/pdf" under its PDLs. */
+  if (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
+      CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
+      debug_printf("Checking whether printer %s understands PDF: PDLs: %s\n",
+		   p->queue_name, p->pdl);
+    if(strcasestr(p->pdl, "application/pdf"))
+      is_pdf = 1;
+    debug_printf("  --> Printer %s PDF.\n",
+		 is_pdf ? "supports" : "does not support");
+  }
+
+  /* If the printer is not the driverless printer we opted for, we skip
+     this printer. */
+  if ((CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS &&
+       is_pwgraster == 0 && is_appleraster == 0 && is_pclm == 0 &&
+       is_pdf == 0) ||
+      (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER &&
+       is_pwgraster == 0) ||
+      (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER &&
+       is_appleraster == 0) ||
+      (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM &&
+       is_pclm == 0) ||
+      (CreateIPPPrinterQueues == IPP_PRINTERS_PDF &&
+       is_pdf == 0)) {
+    debug_printf("Printer %s (%s%s%s%s%s%s%s%s%s%s%s%s%s) does not support the driverless printing protocol cups-browsed is configured to accept for setting up such printers automatically, ignoring this printer.\n",
+		 p->queue_name, p->uri,
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  ", " : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  (is_pwgraster ? "" : "not ") : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  "PWG Raster" : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  ", " : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  (is_appleraster ? "" : "not ") : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  "Apple Raster" : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  ", " : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  (is_pclm ? "" : "not ") : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  "PCLm" : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  ", " : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  (is_pdf ? "" : "not ") : ""),
+		 (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
+		  CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
+		  "PDF" : ""));
+    return 0;
+  }
+
+  return 1;
+}
+#endif /* HAVE_CUPS_1_6 */
+
 static remote_printer_t *
 create_remote_printer_entry (const char *queue_name,
 			     const char *location,
@@ -3922,15 +4856,6 @@ create_remote_printer_entry (const char *queue_name,
   remote_printer_t *p;
   remote_printer_t *q;
   http_t *http_printer = NULL;
-#ifdef HAVE_CUPS_1_6
-  int i;
-  ipp_attribute_t *attr;
-  char valuebuffer[65536];
-  int is_pwgraster = 0;
-  int is_appleraster = 0;
-  int is_pclm = 0;
-  int is_pdf = 0;
-#endif /* HAVE_CUPS_1_6 */
 
   if (!queue_name || !location || !info || !uri || !host || !service_name ||
       !type || !domain) {
@@ -4114,220 +5039,20 @@ create_remote_printer_entry (const char *queue_name,
     }
 
     /* Check whether we have an equally named queue already */
-    for (q = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 q;
-	 q = (remote_printer_t *)cupsArrayNext(remote_printers))
-      if (!strcasecmp(q->queue_name, p->queue_name)) {/* Queue with same name */
-	debug_printf("We have already created a queue with the name %s for another printer. Skipping this printer.\n", p->queue_name);
-	debug_printf("Try setting \"LocalQueueNamingIPPPrinter DNS-SD\" in cups-browsed.conf.\n");
-	goto fail;
-      }
-
-    p->slave_of = NULL;
-    p->netprinter = 1;
-    p->prattrs = get_printer_attributes(p->uri);
-    if (p->prattrs == NULL) {
-      debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
-		   p->queue_name, p->uri);
+    if (printer_index_lookup(remote_printers_by_name, p->queue_name)) {
+      /* Queue with same name */
+      debug_printf("We have already created a queue with the name %s for another printer. Skipping this printer.\n", p->queue_name);
+      debug_printf("Try setting \"LocalQueueNamingIPPPrinter DNS-SD\" in cups-browsed.conf.\n");
       goto fail;
     }
 
-    /* If we have opted for only printers designed for driverless use (PWG
-       Raster + Apple Raster + PCLm + PDF) being set up automatically, we check
-       first, whether our printer supports IPP 2.0 or newer. If not, we
-       skip this printer */
-    if (CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
-      valuebuffer[0] = '\0';
-      debug_printf("Checking whether printer %s supports IPP 2.x or newer:\n",
-		   p->queue_name);
-      if ((attr = ippFindAttribute(p->prattrs,
-				   "ipp-versions-supported",
-				   IPP_TAG_KEYWORD)) != NULL) {
-	debug_printf("  Attr: %s\n", ippGetName(attr));
-	for (i = 0; i < ippGetCount(attr); i ++) {
-	  strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
-	  if (strlen(ippGetString(attr, i, NULL)) > 65535)
-	    valuebuffer[65535] = '\0';
-	  debug_printf("  Keyword: %s\n", valuebuffer);
-	  if (valuebuffer[0] > '1')
-	    break;
-	}
-      }
-      if (!attr || valuebuffer[0] == '\0' || valuebuffer[0] <= '1') {
-	debug_printf("  --> cups-browsed is configured to auto-setup only printers which are designed for driverless printing. These printers require IPP 2.x or newer, but this printer only supports IPP 1.x or older. Skipping.\n");
-	goto fail;
-      } else
-	debug_printf("  --> Printer supports IPP 2.x or newer.\n");
-    }
-
-    /* If we have opted for only PWG Raster printers or for only printers 
-       designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
-       being set up automatically, we check whether the printer has a non-empty
-       string in its "pwg-raster-document-resolution-supported" IPP attribute
-       to see whether we have a PWG Raster printer. */
-    if (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
-	CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
-      valuebuffer[0] = '\0';
-      debug_printf("Checking whether printer %s is PWG Raster:\n",
-		   p->queue_name);
-      if ((attr = ippFindAttribute(p->prattrs,
-				   "pwg-raster-document-resolution-supported",
-				   IPP_TAG_KEYWORD)) != NULL) {
-	debug_printf("  Attr: %s\n", ippGetName(attr));
-	ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
-	debug_printf("  Value: %s\n", valuebuffer);
-	if (valuebuffer[0] == '\0') {
-	  for (i = 0; i < ippGetCount(attr); i ++) {
-	    strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
-	    if (strlen(ippGetString(attr, i, NULL)) > 65535)
-	      valuebuffer[65535] = '\0';
-	    debug_printf("  Keyword: %s\n", valuebuffer);
-	    if (valuebuffer[0] != '\0')
-	      break;
-	  }
-	}
-      }
-      if (attr && valuebuffer[0] != '\0')
-        is_pwgraster = 1;
-      debug_printf("  --> Printer %s PWG Raster.\n",
-		   is_pwgraster ? "supports" : "does not support");
-    }
-
-#ifdef CUPS_RASTER_HAVE_APPLERASTER
-    /* If we have opted for only Apple Raster printers or for only printers 
-       designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
-       being set up automatically, we check whether the printer has a non-empty
-       string in its "urf-supported" IPP attribute to see whether we have an
-       Apple Raster printer. */
-    if (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
-	CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
-      valuebuffer[0] = '\0';
-      debug_printf("Checking whether printer %s understands Apple Raster:\n",
-		   p->queue_name);
-      if ((attr = ippFindAttribute(p->prattrs, "urf-supported", IPP_TAG_KEYWORD)) != NULL) {
-	debug_printf("  Attr: %s\n", ippGetName(attr));
-	ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
-	debug_printf("  Value: %s\n", valuebuffer);
-	if (valuebuffer[0] == '\0') {
-	  for (i = 0; i < ippGetCount(attr); i ++) {
-	    strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
-	    if (strlen(ippGetString(attr, i, NULL)) > 65535)
-	      valuebuffer[65535] = '\0';
-	    debug_printf("  Keyword: %s\n", valuebuffer);
-	    if (valuebuffer[0] != '\0')
-	      break;
-	  }
-	}
-      }
-      if (attr && valuebuffer[0] != '\0')
-        is_appleraster = 1;
-      debug_printf("  --> Printer %s Apple Raster.\n",
-		   is_appleraster ? "supports" : "does not support");
-    }
-#endif
-
-#ifdef QPDF_HAVE_PCLM
-    /* If we have opted for only PCLm printers or for only printers 
-       designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
-       being set up automatically, we check whether the printer has a non-empty
-       string in its "pclm-compression-method-preferred" IPP attribute to see
-       whether we have a PCLm printer. */
-    if (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
-	CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
-      valuebuffer[0] = '\0';
-      debug_printf("Checking whether printer %s understands PCLm:\n",
-		   p->queue_name);
-      if ((attr = ippFindAttribute(p->prattrs,
-				   "pclm-compression-method-preferred",
-				   IPP_TAG_KEYWORD)) != NULL) {
-	debug_printf("  Attr: %s\n", ippGetName(attr));
-	ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
-	debug_printf("  Value: %s\n", p->queue_name, valuebuffer);
-	if (valuebuffer[0] == '\0') {
-	  for (i = 0; i < ippGetCount(attr); i ++) {
-	    strncpy(valuebuffer, ippGetString(attr, i, NULL), sizeof(valuebuffer));
-	    if (strlen(ippGetString(attr, i, NULL)) > 65535)
-	      valuebuffer[65535] = '\0';
-	    debug_printf("  Keyword: %s\n", valuebuffer);
-	    if (valuebuffer[0] != '\0')
-	      break;
-	  }
-	}
-      }
-      if (attr && valuebuffer[0] != '\0')
-        is_pclm = 1;
-      debug_printf("  --> Printer %s PCLm.\n",
-		   is_pclm ? "supports" : "does not support");
-    }
-#endif
-
-    /* If we have opted for only PDF printers or for only printers 
-       designed for driverless use (PWG Raster + Apple Raster + PCLm + PDF)
-       being set up automatically, we check whether the printer has 
-       "application/pdf" under its PDLs. */
-    if (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
-	CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS) {
-	debug_printf("Checking whether printer %s understands PDF: PDLs: %s\n",
-		     p->queue_name, pdl);
-      if(strcasestr(pdl, "application/pdf"))
-        is_pdf = 1;
-      debug_printf("  --> Printer %s PDF.\n",
-		   is_pdf ? "supports" : "does not support");
-    }
-
-    /* If the printer is not the driverless printer we opted for, we skip
-       this printer. */
-    if ((CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS &&
-	 is_pwgraster == 0 && is_appleraster == 0 && is_pclm == 0 &&
-	 is_pdf == 0) ||
-	(CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER &&
-	 is_pwgraster == 0) ||
-	(CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER &&
-	 is_appleraster == 0) ||
-	(CreateIPPPrinterQueues == IPP_PRINTERS_PCLM &&
-	 is_pclm == 0) ||
-	(CreateIPPPrinterQueues == IPP_PRINTERS_PDF &&
-	 is_pdf == 0)) {
-      debug_printf("Printer %s (%s%s%s%s%s%s%s%s%s%s%s%s%s) does not support the driverless printing protocol cups-browsed is configured to accept for setting up such printers automatically, ignoring this printer.\n",
-		   p->queue_name, p->uri,
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    ", " : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    (is_pwgraster ? "" : "not ") : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PWGRASTER ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    "PWG Raster" : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    ", " : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    (is_appleraster ? "" : "not ") : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_APPLERASTER ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    "Apple Raster" : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    ", " : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    (is_pclm ? "" : "not ") : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PCLM ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    "PCLm" : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    ", " : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    (is_pdf ? "" : "not ") : ""),
-		   (CreateIPPPrinterQueues == IPP_PRINTERS_PDF ||
-		    CreateIPPPrinterQueues == IPP_PRINTERS_DRIVERLESS ?
-		    "PDF" : ""));
-      goto fail;
-    }
+    p->slave_of = NULL;
+    p->netprinter = 1;
+    /* The printer's IPP attributes get polled and checked against
+       CreateIPPPrinterQueues by update_cups_queues(), so that the
+       polling of many newly discovered printers can be done in
+       parallel (see prefetch_printer_attributes()) */
+    p->prattrs = NULL;
 
 #endif /* HAVE_CUPS_1_6 */
   }
@@ -4335,6 +5060,8 @@ create_remote_printer_entry (const char *queue_name,
   /* Add the new remote printer entry */
   log_all_printers();
   cupsArrayAdd(remote_printers, p);
+  p->seq = remote_printers_seq ++;
+  remote_printer_index(p);
   log_all_printers();
 
   /* If auto shutdown is active we have perhaps scheduled a timer to shut down
@@ -4425,6 +5152,161 @@ remove_printer_entry(remote_printer_t *p) {
   p->timeout = time(NULL) + TIMEOUT_REMOVE;
 }
 
+#ifdef HAVE_CUPS_1_6
+/* Pool of threads which polls the IPP attributes of the network printers
+   for which queues are about to get created. All the rest of the queue
+   creation (PPD generation, requests to CUPS) stays in the main thread,
+   as the PPD generator and the connection to the local CUPS are not
+   thread-safe. */
+typedef enum prefetch_state_e {
+  PREFETCH_PENDING,
+  PREFETCH_RUNNING,
+  PREFETCH_DONE
+} prefetch_state_t;
+
+typedef struct prefetch_job_s {
+  remote_printer_t *p;
+  prefetch_state_t state;
+  ipp_t *prattrs;
+} prefetch_job_t;
+
+typedef struct prefetch_pool_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  prefetch_job_t *jobs;
+  int num_jobs;
+  int num_pending;
+} prefetch_pool_t;
+
+/* Next job which can be started without exceeding the per-host limit,
+   call with the pool lock held */
+static prefetch_job_t *
+prefetch_next_job(prefetch_pool_t *pool) {
+  int i, j, running;
+
+  for (i = 0; i < pool->num_jobs; i ++) {
+    if (pool->jobs[i].state != PREFETCH_PENDING)
+      continue;
+    running = 0;
+    for (j = 0; j < pool->num_jobs; j ++)
+      if (pool->jobs[j].state == PREFETCH_RUNNING &&
+	  !strcasecmp(pool->jobs[j].p->host, pool->jobs[i].p->host))
+	running ++;
+    if (running < MaxParallelQueueCreationsPerHost)
+      return &(pool->jobs[i]);
+  }
+  return NULL;
+}
+
+static void *
+prefetch_worker(void *data) {
+  prefetch_pool_t *pool = (prefetch_pool_t *)data;
+  prefetch_job_t *job;
+  ipp_t *prattrs;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->num_pending > 0) {
+    if ((job = prefetch_next_job(pool)) == NULL) {
+      /* All hosts of the pending jobs are busy, wait for a job to finish */
+      pthread_cond_wait(&pool->cond, &pool->lock);
+      continue;
+    }
+    job->state = PREFETCH_RUNNING;
+    pool->num_pending --;
+    pthread_mutex_unlock(&pool->lock);
+
+    /* The remote printer entry is not modified while the pool runs, as
+       the main thread is waiting for the pool to finish */
+    debug_printf("Polling IPP attributes of printer %s (%s) in THREAD %ld\n",
+		 job->p->queue_name, job->p->uri, pthread_self());
+    prattrs = get_printer_attributes(job->p->uri);
+
+    pthread_mutex_lock(&pool->lock);
+    job->prattrs = prattrs;
+    job->state = PREFETCH_DONE;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/* Get the IPP attributes of all network printers due for queue creation
+   in parallel, so that update_cups_queues() does not need to wait for
+   each printer one after the other. The results are assigned to the
+   printer entries in the order of the printer list. */
+static void
+prefetch_printer_attributes(time_t current_time) {
+  remote_printer_t *p;
+  prefetch_pool_t pool;
+  pthread_t *threads;
+  int i, num_threads, started;
+
+  if (MaxParallelQueueCreations <= 1 || terminating || in_shutdown)
+    return;
+
+  if ((pool.jobs = (prefetch_job_t *)
+       calloc(cupsArrayCount(remote_printers), sizeof(prefetch_job_t))) ==
+      NULL)
+    return;
+  pool.num_jobs = 0;
+  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
+       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
+    if (p->status == STATUS_TO_BE_CREATED && p->slave_of == NULL &&
+	p->timeout <= current_time && p->timeouted < HttpMaxRetries &&
+	p->netprinter == 1 && p->prattrs == NULL) {
+      pool.jobs[pool.num_jobs].p = p;
+      pool.jobs[pool.num_jobs].state = PREFETCH_PENDING;
+      pool.num_jobs ++;
+    }
+  pool.num_pending = pool.num_jobs;
+
+  /* Not worth the threads for a single printer */
+  if (pool.num_jobs <= 1) {
+    free(pool.jobs);
+    return;
+  }
+
+  num_threads = MaxParallelQueueCreations;
+  if (num_threads > pool.num_jobs)
+    num_threads = pool.num_jobs;
+  if ((threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t))) ==
+      NULL) {
+    free(pool.jobs);
+    return;
+  }
+  debug_printf("Polling IPP attributes of %d printers with %d threads (at most %d per host).\n",
+	       pool.num_jobs, num_threads, MaxParallelQueueCreationsPerHost);
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.cond, NULL);
+  for (started = 0; started < num_threads; started ++)
+    if (pthread_create(&threads[started], NULL, prefetch_worker, &pool) != 0)
+      break;
+  if (started == 0)
+    /* No thread could be started, do the work in this thread */
+    prefetch_worker(&pool);
+  for (i = 0; i < started; i ++)
+    pthread_join(threads[i], NULL);
+  pthread_cond_destroy(&pool.cond);
+  pthread_mutex_destroy(&pool.lock);
+
+  /* Commit the results in the order of the printer list, failed printers
+     get removed right away, as update_cups_queues() would do it */
+  for (i = 0; i < pool.num_jobs; i ++) {
+    p = pool.jobs[i].p;
+    if ((p->prattrs = pool.jobs[i].prattrs) == NULL) {
+      debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
+		   p->queue_name, p->uri);
+      p->status = STATUS_DISAPPEARED;
+      p->timeout = time(NULL) + TIMEOUT_IMMEDIATELY;
+    }
+  }
+
+  free(threads);
+  free(pool.jobs);
+}
+#endif /* HAVE_CUPS_1_6 */
+
 gboolean update_cups_queues(gpointer unused) {
   remote_printer_t *p, *q, *r;
   http_t *http, *remote_http;
@@ -4486,6 +5368,9 @@ gboolean update_cups_queues(gpointer unused) {
 
   debug_printf("Processing printer list ...\n");
   log_all_printers();
+#ifdef HAVE_CUPS_1_6
+  prefetch_printer_attributes(time(NULL));
+#endif /* HAVE_CUPS_1_6 */
   for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
        p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
 
@@ -4641,6 +5526,7 @@ gboolean update_cups_queues(gpointer unused) {
          of an element and especially no reading beyond the end of the
          array. */
       cupsArrayRemove(remote_printers, p);
+      remote_printer_unindex(p);
       if (p->queue_name) free (p->queue_name);
       if (p->location) free (p->location);
       if (p->info) free (p->info);
@@ -4703,6 +5589,25 @@ gboolean update_cups_queues(gpointer unused) {
 	continue;
       }
 
+#ifdef HAVE_CUPS_1_6
+      /* Poll the IPP attributes of an IPP network printer, if
+	 prefetch_printer_attributes() did not already do so, and check
+	 whether it is a printer we want to set up */
+      if (p->netprinter == 1) {
+	if (p->prattrs == NULL)
+	  p->prattrs = get_printer_attributes(p->uri);
+	if (p->prattrs == NULL)
+	  debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
+		       p->queue_name, p->uri);
+	if (p->prattrs == NULL || !check_driverless_support(p)) {
+	  p->status = STATUS_DISAPPEARED;
+          current_time = time(NULL);
+	  p->timeout = current_time + TIMEOUT_IMMEDIATELY;
+	  goto cannot_create;
+	}
+      }
+#endif /* HAVE_CUPS_1_6 */
+
       debug_printf("Creating/Updating CUPS queue %s\n",
 		   p->queue_name);
 
@@ -4872,16 +5777,6 @@ gboolean update_cups_queues(gpointer unused) {
          or if we want to use a System V interface script for our IPP network
 	 printer, we proceed here */
       if (p->netprinter == 1) {
-	if (p->prattrs == NULL)
-	  p->prattrs = get_printer_attributes(p->uri);
-	if (p->prattrs == NULL) {
-	  debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
-		       p->queue_name, p->uri);
-	  p->status = STATUS_DISAPPEARED;
-          current_time = time(NULL);
-	  p->timeout = current_time + TIMEOUT_IMMEDIATELY;
-	  goto cannot_create;
-	}
 	if (IPPPrinterQueueType == PPD_YES) {
 	  p->nickname = NULL;
 	  if (ppdfile == NULL) {
@@ -4889,8 +5784,9 @@ gboolean update_cups_queues(gpointer unused) {
 	       CUPS-generated PPD, for example if CUPS does not create a 
 	       temporary queue for this printer, we generate a PPD by
 	       ourselves */
-	    if (!ppdCreateFromIPP(buffer, sizeof(buffer), p->prattrs, p->make_model,
-				  p->pdl, p->color, p->duplex)) {
+	    if (!ppd_create_from_ipp_cached(buffer, sizeof(buffer), p->prattrs,
+					    p->make_model, p->pdl, p->color,
+					    p->duplex)) {
 	      if (errno != 0)
 		debug_printf("Unable to create PPD file: %s\n", strerror(errno));
 	      else
@@ -5741,6 +6637,7 @@ examine_discovered_printer_record(const char *host,
   char *note_value = NULL;
 #endif /* HAVE_AVAHI */
   remote_printer_t *p = NULL;
+  GList *l;
   char *local_queue_name = NULL;
   int is_cups_queue;
   int raw_queue = 0;
@@ -5927,8 +6824,10 @@ examine_discovered_printer_record(const char *host,
 
   /* Check if we have already created a queue for the discovered
      printer */
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
+  for (l = printer_index_lookup(remote_printers_by_name, local_queue_name),
+	 p = NULL;
+       l; l = l->next, p = NULL) {
+    p = (remote_printer_t *)l->data;
     if (!strcasecmp(p->queue_name, local_queue_name) &&
 	(p->host[0] == '\0' ||
 	 p->status == STATUS_UNCONFIRMED ||
@@ -5940,6 +6839,7 @@ examine_discovered_printer_record(const char *host,
 	  strlen(p->uri) - strlen(resource) > 0 &&
 	  !strcasecmp(p->uri + strlen(p->uri) - strlen(resource), resource))))
       break;
+  }
 
   /* Is there a local queue with the same URI as the remote queue? */
   if (!p && g_hash_table_find (local_printers,
@@ -6085,6 +6985,7 @@ examine_discovered_printer_record(const char *host,
       p->domain = strdup(domain);
     }
     p->netprinter = is_cups_queue ? 0 : 1;
+    remote_printer_index(p);
   } else {
 
     /* We need to create a local queue pointing to the
@@ -6702,6 +7603,8 @@ static void browse_callback(
   /* A service (remote printer) has disappeared */
   case AVAHI_BROWSER_REMOVE: {
     remote_printer_t *p;
+    GList *l;
+    char *key;
 
     if (name == NULL || type == NULL || domain == NULL)
       return;
@@ -6716,14 +7619,18 @@ static void browse_callback(
     }
 
     /* Check whether we have listed this printer */
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
+    key = remote_printer_service_key(name, type, domain);
+    for (l = printer_index_lookup(remote_printers_by_service, key), p = NULL;
+	 l; l = l->next, p = NULL) {
+      p = (remote_printer_t *)l->data;
       if (p->status != STATUS_DISAPPEARED &&
 	  p->status != STATUS_TO_BE_RELEASED &&
 	  !strcasecmp(p->service_name, name) &&
 	  !strcasecmp(p->type, type) &&
 	  !strcasecmp(p->domain, domain))
 	break;
+    }
+    g_free(key);
     if (p) {
       remove_printer_entry(p);
       debug_printf("DNS-SD IDs: Service name: \"%s\", Service type: \"%s\", Domain: \"%s\"\n",
@@ -8079,6 +8986,21 @@ read_configuration (const char *filename)
       } else
 	debug_printf("Invalid %s value: %d\n",
 		     line, t);
+    } else if ((!strcasecmp(line, "MaxParallelQueueCreations") ||
+		!strcasecmp(line, "MaxParallelQueueCreationsPerHost")) &&
+	       value) {
+      int t = atoi(value);
+      if (t > 0) {
+	if (!strcasecmp(line, "MaxParallelQueueCreations"))
+	  MaxParallelQueueCreations = t;
+	else
+	  MaxParallelQueueCreationsPerHost = t;
+
+	debug_printf("Set %s to %d.\n",
+		     line, t);
+      } else
+	debug_printf("Invalid %s value: %d\n",
+		     line, t);
     } else if (!strcasecmp(line, "IPBasedDeviceURIs") && value) {
       if (!strcasecmp(value, "IPv4") || !strcasecmp(value, "IPv4Only"))
 	IPBasedDeviceURIs = IP_BASED_URIS_IPV4_ONLY;
@@ -8118,6 +9040,13 @@ read_configuration (const char *filename)
       else if (!strcasecmp(value, "no") || !strcasecmp(value, "false") ||
 	  !strcasecmp(value, "off") || !strcasecmp(value, "0"))
 	UseCUPSGeneratedPPDs = 0;
+    } else if (!strcasecmp(line, "IPPPrinterCache") && value) {
+      if (!strcasecmp(value, "yes") || !strcasecmp(value, "true") ||
+	  !strcasecmp(value, "on") || !strcasecmp(value, "1"))
+	IPPPrinterCache = 1;
+      else if (!strcasecmp(value, "no") || !strcasecmp(value, "false") ||
+	  !strcasecmp(value, "off") || !strcasecmp(value, "0"))
+	IPPPrinterCache = 0;
     } else if (!strcasecmp(line, "CreateRemoteRawPrinterQueues") && value) {
       if (!strcasecmp(value, "yes") || !strcasecmp(value, "true") ||
 	  !strcasecmp(value, "on") || !strcasecmp(value, "1"))
@@ -8261,6 +9190,16 @@ read_configuration (const char *filename)
 	LoadBalancingType = QUEUE_ON_CLIENT;
       else if (!strncasecmp(value, "QueueOnServers", 14))
 	LoadBalancingType = QUEUE_ON_SERVERS;
+    } else if (!strcasecmp(line, "LoadBalancingPollInterval") && value) {
+      int t = atoi(value);
+      if (t >= 0) {
+	LoadBalancingPollInterval = t;
+
+	debug_printf("Set %s to %d sec.\n",
+		     line, t);
+      } else
+	debug_printf("Invalid %s value: %d\n",
+		     line, t);
     } else if (!strcasecmp(line, "DefaultOptions") && value) {
       if (DefaultOptions == NULL && strlen(value) > 0)
 	DefaultOptions = strdup(value);
@@ -8619,6 +9558,11 @@ int main(int argc, char*argv[]) {
   strncpy(save_options_file + strlen(cachedir),
 	  SAVE_OPTIONS_FILE,
 	  sizeof(save_options_file) - strlen(cachedir) - 1);
+  strncpy(ipp_cache_file, cachedir,
+	  sizeof(ipp_cache_file) - 1);
+  strncpy(ipp_cache_file + strlen(cachedir),
+	  IPP_CACHE_FILE,
+	  sizeof(ipp_cache_file) - strlen(cachedir) - 1);
   strncpy(debug_log_file, logdir,
 	  sizeof(debug_log_file) - 1);
   strncpy(debug_log_file + strlen(logdir),
@@ -8710,6 +9654,8 @@ int main(int argc, char*argv[]) {
     free(val);
   }
   remote_printers = cupsArrayNew(NULL, NULL);
+  remote_printers_by_name = printer_index_new(remote_printer_order);
+  remote_printers_by_service = printer_index_new(remote_printer_order);
   g_hash_table_foreach (local_printers, find_previous_queue, NULL);
 
   /* Redirect SIGINT and SIGTERM so that we do a proper shutdown, removing
@@ -8931,6 +9877,8 @@ fail:
   if (cups_notifier)
     g_object_unref (cups_notifier);
 
+  cluster_poll_shutdown ();
+
   if (BrowsePoll) {
     size_t index;
     for (index = 0;
@@ -8976,6 +9924,8 @@ fail:
 
   g_hash_table_destroy (local_printers);
   g_hash_table_destroy (cups_supported_remote_printers);
+  printer_index_free (remote_printers_by_name);
+  printer_index_free (remote_printers_by_service);
 
   if (BrowseLocalProtocols & BROWSE_CUPS)
     g_list_free_full (browse_data, browse_data_free);
@@ -0,0 +1,189 @@
+/*
+ * Replay a burst of synthetic DNS-SD (Avahi) events against the printer
+ * indexes of cups-browsed and against a linear scan of the printer list,
+ * as cups-browsed did before, check that both find the same printers and
+ * report the time both need.
+ *
+ *     test_printer_index [number-of-events]
+ */
+
+#include "cups-browsed-index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define NUM_EVENTS 10000
+
+typedef struct printer_s {
+  char queue_name[64];
+  char service_name[64];
+  char type[16];
+  char domain[16];
+  unsigned long seq;
+} printer_t;
+
+typedef struct event_s {
+  int remove;
+  int id;
+} event_t;
+
+static gint
+printer_order (gconstpointer a, gconstpointer b)
+{
+  unsigned long seq_a = ((const printer_t *)a)->seq,
+    seq_b = ((const printer_t *)b)->seq;
+
+  return (seq_a < seq_b ? -1 : (seq_a > seq_b ? 1 : 0));
+}
+
+static char *
+service_key (const char *name, const char *type, const char *domain)
+{
+  return g_strdup_printf ("%s\t%s\t%s", name, type, domain);
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+make_names (int id, char *queue_name, char *service_name)
+{
+  /* Some printers share their queue name, like a cluster */
+  sprintf (queue_name, "Printer_%d", id % 7 ? id : id / 7);
+  sprintf (service_name, "Printer %d @ host%d", id, id % 97);
+}
+
+/* Returns a checksum of the printers found, to compare both methods */
+static unsigned long
+replay (const event_t *events, int num_events, int indexed)
+{
+  GPtrArray *printers = g_ptr_array_new ();
+  printer_index_t *by_name = printer_index_new (printer_order),
+    *by_service = printer_index_new (printer_order);
+  char queue_name[64], service_name[64], *key;
+  unsigned long seq = 0, sum = 0;
+  printer_t *p;
+  GList *l;
+  guint j;
+  int i;
+
+  for (i = 0; i < num_events; i ++) {
+    make_names (events[i].id, queue_name, service_name);
+    p = NULL;
+    if (events[i].remove) {
+      /* Avahi browser REMOVE: find the printer by its DNS-SD service */
+      if (indexed) {
+	key = service_key (service_name, "_ipp._tcp", "local");
+	for (l = printer_index_lookup (by_service, key); l;
+	     l = l->next, p = NULL) {
+	  p = (printer_t *)l->data;
+	  if (!strcasecmp (p->service_name, service_name))
+	    break;
+	}
+	g_free (key);
+      } else
+	for (j = 0; j < printers->len; j ++, p = NULL) {
+	  p = g_ptr_array_index (printers, j);
+	  if (!strcasecmp (p->service_name, service_name) &&
+	      !strcasecmp (p->type, "_ipp._tcp") &&
+	      !strcasecmp (p->domain, "local"))
+	    break;
+	}
+      if (p) {
+	sum += p->seq;
+	g_ptr_array_remove (printers, p);
+	key = service_key (p->service_name, p->type, p->domain);
+	printer_index_remove (by_name, p->queue_name, p);
+	printer_index_remove (by_service, key, p);
+	g_free (key);
+	free (p);
+      }
+    } else {
+      /* Avahi browser NEW: is there already an entry for this queue? */
+      if (indexed) {
+	for (l = printer_index_lookup (by_name, queue_name); l;
+	     l = l->next, p = NULL) {
+	  p = (printer_t *)l->data;
+	  if (!strcasecmp (p->queue_name, queue_name) &&
+	      !strcasecmp (p->service_name, service_name))
+	    break;
+	}
+      } else
+	for (j = 0; j < printers->len; j ++, p = NULL) {
+	  p = g_ptr_array_index (printers, j);
+	  if (!strcasecmp (p->queue_name, queue_name) &&
+	      !strcasecmp (p->service_name, service_name))
+	    break;
+	}
+      if (p)
+	sum += p->seq;
+      else {
+	p = calloc (1, sizeof (printer_t));
+	strcpy (p->queue_name, queue_name);
+	strcpy (p->service_name, service_name);
+	strcpy (p->type, "_ipp._tcp");
+	strcpy (p->domain, "local");
+	p->seq = seq ++;
+	g_ptr_array_add (printers, p);
+	key = service_key (p->service_name, p->type, p->domain);
+	printer_index_add (by_name, p->queue_name, p);
+	printer_index_add (by_service, key, p);
+	g_free (key);
+      }
+    }
+  }
+
+  sum += printers->len;
+  for (j = 0; j < printers->len; j ++)
+    free (g_ptr_array_index (printers, j));
+  g_ptr_array_free (printers, TRUE);
+  printer_index_free (by_name);
+  printer_index_free (by_service);
+  return sum;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int num_events = (argc > 1 ? atoi (argv[1]) : NUM_EVENTS), i;
+  event_t *events;
+  unsigned long sum_linear, sum_indexed;
+  double start, linear, indexed;
+
+  if (num_events <= 0)
+    num_events = NUM_EVENTS;
+  events = calloc (num_events, sizeof (event_t));
+
+  /* Mostly new printers showing up at startup, some announced again,
+     some going away */
+  srand (1);
+  for (i = 0; i < num_events; i ++) {
+    events[i].remove = (rand () % 10 == 0);
+    events[i].id = (rand () % 4 == 0 && i > 0 ? rand () % i : i);
+  }
+
+  start = now ();
+  sum_linear = replay (events, num_events, 0);
+  linear = now () - start;
+
+  start = now ();
+  sum_indexed = replay (events, num_events, 1);
+  indexed = now () - start;
+
+  printf ("%d events: linear scan %.3f s, indexed %.3f s\n",
+	  num_events, linear, indexed);
+  free (events);
+
+  if (sum_linear != sum_indexed) {
+    printf ("FAIL: indexed lookups found other printers than linear scans\n");
+    return 1;
+  }
+  return 0;
+}